@@ -17,6 +17,8 @@ protected:
     double dpi = 1.0;
     double stepSize = 0.05;
     bool keyScaling = true;
+    QTimer *rescaleTimer;
+    bool rescalePending = false;
 
 signals:
     void screenChanged(QScreen*);
@@ -42,6 +44,18 @@ public:
         setFocusPolicy(Qt::StrongFocus);
         setFocus();
 
+        /* Scale steps that follow each other quickly are applied together */
+        rescaleTimer = new QTimer(this);
+        rescaleTimer->setSingleShot(true);
+        rescaleTimer->setInterval(40);
+        connect(rescaleTimer, &QTimer::timeout, this, [this]()
+        {
+            if (!rescalePending)
+                return;
+            applyDpiScale();
+            rescaleTimer->start();
+        });
+
         /* DPI settings */
         screenScale = screen()->logicalDotsPerInchX() / 96.0;
         if (scale)
@@ -106,10 +120,36 @@ public:
     void setDpiScale(double scale)
     {
         dpi = std::min(100, std::max(1, qRound(scale/stepSize))) * stepSize;
-        setStyleSheet(settings.getScaledStyleSheet(dpi));
+
+        if (rescaleTimer->isActive())
+        {
+            rescalePending = true;
+            return;
+        }
+
+        applyDpiScale();
+        rescaleTimer->start();
+    }
+
+    void applyDpiScale()
+    {
+        rescalePending = false;
+
+        /* All widgets are resized before the window is painted again */
+        bool updates = updatesEnabled();
+        setUpdatesEnabled(false);
+
+        /* Setting the same stylesheet again would polish every widget */
+        QString sheet = settings.getScaledStyleSheet(dpi);
+        if (styleSheet() != sheet)
+            setStyleSheet(sheet);
+
+        HiDpiExtensions::setDpiScale(dpi);
         updateScaling();
         emit dpiScaleChanged(dpi);
-     }
+
+        setUpdatesEnabled(updates);
+    }
 
     void increaseDpiScale()
     {
@@ -128,9 +168,11 @@ public:
 
     void updateDpiScale(double scale)
     {
+        /* A new scale is propagated once, by setDpiScale */
         if (std::abs(dpi-scale) > 1e-3)
             setDpiScale(scale);
-        HdMainWindow::updateDpiScale(dpi);
+        else
+            HdMainWindow::updateDpiScale(dpi);
     }
 
     void setEnableKeyScaling(bool enable)
@@ -23,6 +23,7 @@
 #include <QKeyEvent>
 #include <QLabel>
 #include <QLineEdit>
+#include <QListWidget>
 #include <QMainWindow>
 #include <QMenu>
 #include <QMenuBar>
@@ -40,7 +41,7 @@
 #include <QStatusBar>
 #include <QStyleOption>
 #include <QTabBar>
-#include <QTableWidget>
+#include <QTableView>
 #include <QTextBrowser>
 #include <QTextEdit>
 #include <QToolBar>
@@ -216,14 +217,29 @@ public:
     void updateScaling()
     {
         if (bHasDynamicWidth)
-            _widget->setFixedWidth( std::max(1,int(dpi*dynamicWidth)) );
+            applyFixedWidth( std::max(1,int(dpi*dynamicWidth)) );
         else if (bUseSizeHintWidth)
-            _widget->setFixedWidth( _widget->sizeHint().width() );
+            applyFixedWidth( _widget->sizeHint().width() );
 
         if (bHasDynamicHeight)
-            _widget->setFixedHeight( std::max(1,int(dpi*dynamicHeight)) );
+            applyFixedHeight( std::max(1,int(dpi*dynamicHeight)) );
         else if (bUseSizeHintHeight)
-            _widget->setFixedHeight( _widget->sizeHint().height() );
+            applyFixedHeight( _widget->sizeHint().height() );
+    }
+
+private:
+    /* Unchanged sizes do not post layout requests, most widgets keep their
+       size when only some of them are rescaled */
+    void applyFixedWidth(int w)
+    {
+        if (_widget->minimumWidth() != w || _widget->maximumWidth() != w)
+            _widget->setFixedWidth(w);
+    }
+
+    void applyFixedHeight(int h)
+    {
+        if (_widget->minimumHeight() != h || _widget->maximumHeight() != h)
+            _widget->setFixedHeight(h);
     }
 
 };
@@ -617,6 +633,28 @@ public slots:
 };
 
 
+class HdListWidget : public QListWidget, public HiDpiExtensions
+{
+    Q_OBJECT
+
+signals:
+    void dpiScaleChanged(double);
+
+public:
+    explicit HdListWidget(QWidget *parent = Q_NULLPTR) : QListWidget(parent), HiDpiExtensions(this)
+    { }
+
+public slots:
+    void updateDpiScale(double scale)
+    {
+        if (HiDpiExtensions::setDpiScale(scale))
+            emit dpiScaleChanged(getDpiScale());
+
+        HiDpiExtensions::updateScaling();
+    }
+};
+
+
 class HdMainWindow : public QMainWindow, public HiDpiExtensions
 {
     Q_OBJECT
@@ -1182,7 +1220,7 @@ public slots:
 };
 
 
-class HdTableWidget : public QTableWidget, public HiDpiExtensions
+class HdTableView : public QTableView, public HiDpiExtensions
 {
     Q_OBJECT
 
@@ -1201,14 +1239,10 @@ protected:
 
 signals:
     void dpiScaleChanged(double);
-    void rowInserted(int);
-    void columnInserted(int);
-    void rowRemoved(int);
-    void columnRemoved(int);
 
 public:
 
-    explicit HdTableWidget(QWidget *parent = Q_NULLPTR) : QTableWidget(parent), HiDpiExtensions(this)
+    explicit HdTableView(QWidget *parent = Q_NULLPTR) : QTableView(parent), HiDpiExtensions(this)
     {
         setEditTriggers(QAbstractItemView::DoubleClicked | QAbstractItemView::SelectedClicked | QAbstractItemView::AnyKeyPressed);
 
@@ -1220,16 +1254,14 @@ public:
         setShowGrid(true);
     }
 
-    explicit HdTableWidget(int rows, int columns, QWidget *parent = Q_NULLPTR) : QTableWidget(rows, columns, parent), HiDpiExtensions(this)
+    int rowCount() const
     {
-        setEditTriggers(QAbstractItemView::DoubleClicked | QAbstractItemView::SelectedClicked | QAbstractItemView::AnyKeyPressed);
-
-        horizontalHeader()->setSectionResizeMode(QHeaderView::Interactive);
-        horizontalHeader()->setDefaultAlignment(Qt::AlignVCenter | Qt::AlignLeft);
-        verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+        return model() != Q_NULLPTR ? model()->rowCount() : 0;
+    }
 
-        setAlternatingRowColors(false);
-        setShowGrid(true);
+    int columnCount() const
+    {
+        return model() != Q_NULLPTR ? model()->columnCount() : 0;
     }
 
     void setDynamicColumnWidth(int w)
@@ -1254,7 +1286,7 @@ public:
             hasDynamicColumnWidth = false;
             hasDynamicMinimumColumnWidth = true;
             dynamicMinimumColumnWidth = w;
-            QTableWidget::resizeColumnsToContents();
+            QTableView::resizeColumnsToContents();
 
             for (int i = 0; i < columnCount(); ++i)
                 if (horizontalHeader()->sectionSize(i) < std::max(1, int(getDpiScale()*dynamicMinimumColumnWidth)) )
@@ -1315,7 +1347,6 @@ public:
             if (verticalScrollBar()->isVisible())
                 w = verticalScrollBar()->sizeHint().width();
             setFixedWidth(viewportSizeHint().width() + w);
-
         }
         else
         {
@@ -1361,26 +1392,31 @@ public:
         return QPair<bool, bool>(rowsResizable, columnsResizable);
     }
 
+    bool isCellEditable(int row, int col)
+    {
+        return model()->flags(model()->index(row, col)).testFlag(Qt::ItemIsEditable);
+    }
+
+    QString itemText(int row, int col)
+    {
+        return model()->data(model()->index(row, col), Qt::DisplayRole).toString();
+    }
+
     void setItemText(int row, int col, const QString &text)
     {
         if ((row >= rowCount() && !rowsResizable) || (col >= columnCount() && !columnsResizable))
             return;
-        else if (row >= rowCount())
-            setRowCount(row+1);
-        else if (col >= columnCount())
-            setColumnCount(col+1);
 
-        if (item(row, col) != Q_NULLPTR)
-        {
-            if (!(item(row, col)->flags() & Qt::ItemIsEditable))
-                return;
-            else if (text.isEmpty())
-                setItem(row, col, Q_NULLPTR);
-            else
-                item(row, col)->setText(text);
-        }
-        else if (!text.isEmpty())
-            setItem(row, col, new QTableWidgetItem(text));
+        /* The model grows the table, cells of the new rows and columns are empty */
+        if (row >= rowCount())
+            model()->insertRows(rowCount(), row + 1 - rowCount());
+        if (col >= columnCount())
+            model()->insertColumns(columnCount(), col + 1 - columnCount());
+
+        if (!isCellEditable(row, col))
+            return;
+
+        model()->setData(model()->index(row, col), text, Qt::EditRole);
     }
 
     void insertRow(int row)
@@ -1388,9 +1424,7 @@ public:
         if (!rowsResizable)
             return;
 
-        row = std::min(row, rowCount());
-        QTableWidget::insertRow(row);
-        emit rowInserted(row);
+        model()->insertRow(std::min(row, rowCount()));
     }
 
     void insertColumn(int column)
@@ -1398,9 +1432,7 @@ public:
         if (!columnsResizable)
             return;
 
-        column = std::min(column, columnCount());
-        QTableWidget::insertColumn(column);
-        emit columnInserted(column);
+        model()->insertColumn(std::min(column, columnCount()));
     }
 
     void removeRow(int row)
@@ -1408,8 +1440,7 @@ public:
         if (!rowsResizable)
             return;
 
-        QTableWidget::removeRow(row);
-        emit rowRemoved(row);
+        model()->removeRow(row);
     }
 
     void removeColumn(int column)
@@ -1417,8 +1448,7 @@ public:
         if (!columnsResizable)
             return;
 
-        QTableWidget::removeColumn(column);
-        emit columnRemoved(column);
+        model()->removeColumn(column);
     }
 
 public slots:
@@ -1428,7 +1458,7 @@ public slots:
         if (hasDynamicColumnWidth)
             return;
 
-        QTableWidget::resizeColumnsToContents();
+        QTableView::resizeColumnsToContents();
 
         if (hasDynamicMinimumColumnWidth)
         {
@@ -1510,17 +1540,13 @@ protected:
 
         if(!selected_rows.isEmpty() && rowsResizable)
         {
-            for (int i = 0; i < selected_rows.length(); ++i)
-                insertRow(selected_rows.first().row());
-
+            model()->insertRows(selected_rows.first().row(), int(selected_rows.length()));
             updateViewportSizeHintHeight();
         }
 
         else if(!selected_cols.isEmpty() && columnsResizable)
         {
-            for (int j = 0; j < selected_cols.length(); ++j)
-                insertColumn(selected_cols.first().column());
-
+            model()->insertColumns(selected_cols.first().column(), int(selected_cols.length()));
             updateViewportSizeHintWidth();
         }
     }
@@ -1535,17 +1561,13 @@ protected:
 
         if(!selected_rows.isEmpty() && rowsResizable)
         {
-            for (int i = 0; i < selected_rows.length(); ++i)
-                insertRow(selected_rows.last().row()+1);
-
+            model()->insertRows(selected_rows.last().row()+1, int(selected_rows.length()));
             updateViewportSizeHintHeight();
         }
 
         else if(!selected_cols.isEmpty() && columnsResizable)
         {
-            for (int j = 0; j < selected_cols.length(); ++j)
-                insertColumn(selected_cols.last().column()+1);
-
+            model()->insertColumns(selected_cols.last().column()+1, int(selected_cols.length()));
             updateViewportSizeHintWidth();
         }
     }
@@ -1564,10 +1586,9 @@ protected:
             for (int n = 0; n < selected_rows.length(); ++n)
             {
                 int i = selected_rows.at(n).row();
-                for (int j = 0; j < rowCount(); ++j)
-                    if (item(i,j) != Q_NULLPTR)
-                        if (!(item(i,j)->flags() & Qt::ItemIsEditable))
-                            return;
+                for (int j = 0; j < columnCount(); ++j)
+                    if (!isCellEditable(i,j))
+                        return;
             }
 
             for (int n = 0; n < selected_rows.length(); ++n)
@@ -1581,10 +1602,9 @@ protected:
             for (int n = 0; n < selected_cols.length(); ++n)
             {
                 int j = selected_cols.at(n).column();
-                for (int i = 0; i < columnCount(); ++i)
-                    if (item(i,j) != Q_NULLPTR)
-                        if (!(item(i,j)->flags() & Qt::ItemIsEditable))
-                            return;
+                for (int i = 0; i < rowCount(); ++i)
+                    if (!isCellEditable(i,j))
+                        return;
             }
 
             for (int n = 0; n < selected_cols.length(); ++n)
@@ -1595,14 +1615,13 @@ protected:
         /* Or clear selected cells */
         else
         {
-            QTableWidgetSelectionRange start = selectedRanges().constFirst();
-            QTableWidgetSelectionRange stop = selectedRanges().constLast();
+            QItemSelectionRange start = selectionModel()->selection().constFirst();
+            QItemSelectionRange stop = selectionModel()->selection().constLast();
 
-            for (int i = start.topRow(); i <= stop.bottomRow(); ++i)
-                for (int j = start.leftColumn(); j <= stop.rightColumn(); ++j)
-                    if (item(i,j) != Q_NULLPTR)
-                        if (item(i,j)->flags() & Qt::ItemIsEditable)
-                            setItem(i,j,Q_NULLPTR);
+            for (int i = start.top(); i <= stop.bottom(); ++i)
+                for (int j = start.left(); j <= stop.right(); ++j)
+                    if (isCellEditable(i,j) && !itemText(i,j).isEmpty())
+                        model()->setData(model()->index(i,j), QString(), Qt::EditRole);
 
             updateViewportSizeHint();
         }
@@ -1613,22 +1632,21 @@ protected:
         if (!selectionModel()->hasSelection())
             return;
 
-        QTableWidgetSelectionRange start = selectedRanges().constFirst();
-        QTableWidgetSelectionRange stop = selectedRanges().constLast();
+        QItemSelectionRange start = selectionModel()->selection().constFirst();
+        QItemSelectionRange stop = selectionModel()->selection().constLast();
         QString text;
 
-        for (int i = start.topRow(); i <= stop.bottomRow(); ++i)
+        for (int i = start.top(); i <= stop.bottom(); ++i)
         {
-            if (i > start.topRow())
+            if (i > start.top())
                 text += "\n";
 
-            for (int j = start.leftColumn(); j <= stop.rightColumn(); ++j)
+            for (int j = start.left(); j <= stop.right(); ++j)
             {
-                if (j > start.leftColumn())
+                if (j > start.left())
                     text += "\t";
 
-                if (item(i,j) != Q_NULLPTR)
-                    text += this->item(i,j)->text().replace("\t","  ");
+                text += itemText(i,j).replace("\t","  ");
             }
         }
 
@@ -1640,27 +1658,25 @@ protected:
         if (!selectionModel()->hasSelection())
             return;
 
-        QTableWidgetSelectionRange start = selectedRanges().constFirst();
-        QTableWidgetSelectionRange stop = selectedRanges().constLast();
+        QItemSelectionRange start = selectionModel()->selection().constFirst();
+        QItemSelectionRange stop = selectionModel()->selection().constLast();
         QString text;
 
-        for (int i = start.topRow(); i <= stop.bottomRow(); ++i)
+        for (int i = start.top(); i <= stop.bottom(); ++i)
         {
-            if (i > start.topRow())
+            if (i > start.top())
                 text += "\n";
 
-            for (int j = start.leftColumn(); j <= stop.rightColumn(); ++j)
+            for (int j = start.left(); j <= stop.right(); ++j)
             {
-                if (j > start.leftColumn())
+                if (j > start.left())
                     text += "\t";
 
-                if (item(i,j) != Q_NULLPTR)
-                {
-                    text += item(i,j)->text().replace("\t","  ");
+                QString cell = itemText(i,j);
+                text += cell.replace("\t","  ");
 
-                    if (item(i,j)->flags() & Qt::ItemIsEditable)
-                        setItem(i,j,Q_NULLPTR);
-                }
+                if (!cell.isEmpty() && isCellEditable(i,j))
+                    model()->setData(model()->index(i,j), QString(), Qt::EditRole);
             }
         }
 
@@ -1668,18 +1684,18 @@ protected:
         updateViewportSizeHint();
     }
 
-    void paste()
+    virtual void paste()
     {
         if (!selectionModel()->hasSelection())
             return;
 
-        QTableWidgetSelectionRange start = selectedRanges().constFirst();
-        QTableWidgetSelectionRange stop = selectedRanges().constLast();
+        QItemSelectionRange start = selectionModel()->selection().constFirst();
+        QItemSelectionRange stop = selectionModel()->selection().constLast();
 
-        int top = start.topRow();
-        int bottom = stop.bottomRow();
-        int left = start.leftColumn();
-        int right = stop.rightColumn();
+        int top = start.top();
+        int bottom = stop.bottom();
+        int left = start.left();
+        int right = stop.right();
 
         QString clipboardtext = QApplication::clipboard()->text();
 
@@ -1731,7 +1747,7 @@ protected:
         else if (event->key() == Qt::Key_D && event->modifiers() == Qt::ShiftModifier)
             clearSelection();
         else
-            QTableWidget::keyPressEvent(event);
+            QTableView::keyPressEvent(event);
     }
 };
 
@@ -0,0 +1,61 @@
+#ifndef PYBATCHRUNNER_H
+#define PYBATCHRUNNER_H
+
+#include <QFile>
+#include <QObject>
+#include <QStringList>
+#include <pugixml.hpp>
+
+class PyProcess;
+
+/* Runs one module of a session without a display.
+ *
+ * The session is loaded and serialized with the same code as the main
+ * window, but no widgets are created: output of the run goes to stdout,
+ * errors and messages go to stderr, and requests that would open a dialog
+ * are answered with their default. The exit code follows the result of
+ * the run, so the runner can be driven from cron jobs and CI pipelines:
+ *
+ *     PyTools --run session.xml [--module name] [--python executable] */
+
+class PyBatchRunner : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum ExitCode
+    {
+        EXIT_SUCCEEDED = 0,
+        EXIT_FAILED = 1,
+        EXIT_TERMINATED = 2,
+        EXIT_INVALID = 3
+    };
+
+private:
+    PyProcess *process;
+    pugi::xml_document document;
+    QString moduleName;
+    QFile standardOutput;
+    QFile standardError;
+
+public:
+    explicit PyBatchRunner(QObject *parent = Q_NULLPTR);
+    ~PyBatchRunner() override;
+
+    bool load(QString sessionfile, QString modulename);
+    bool start(QString python = QString());
+
+    static bool isRequested(int argc, char *argv[]);
+    static int exec(QStringList arguments);
+
+private:
+    pugi::xml_node moduleNode();
+    void writeOutput(QString text);
+    void writeError(QString text);
+    void readXml(QString fpath);
+    void writeXml(QString fpath);
+    void finish(int exitcode);
+
+};
+
+#endif
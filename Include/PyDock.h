@@ -1,12 +1,14 @@
 #ifndef PYDOCK_H
 #define PYDOCK_H
 
-#include <QTextEdit>
+#include <QTimer>
 #include <HdWidgets.h>
 #include <FramelessDockWidget.h>
 #include <FramelessDockButtons.h>
+#include <PyTerminal.h>
 
 class PyProcess;
+class PyRunScheduler;
 class PyTools;
 
 class PyDock : public FramelessDockWidget
@@ -17,7 +19,9 @@ private:
     PyTools *pyTools;
     HdToolBar *toolBar;
     FramelessDockButton *runButton, *dockingButton;
-    QTextEdit *terminal;
+    PyTerminal *terminal;
+    HdListWidget *jobList;
+    PyRunScheduler *scheduler = Q_NULLPTR;
     PyProcess *pyProcess;
     QColor textColor;
     qreal indent = 0.0;
@@ -27,6 +31,21 @@ private:
     int barHeight = 30;
     bool dynamicBarHeight = false;
     bool printsEnabled = true;
+    bool terminalPristine = false;
+
+    /* Output waiting for the next terminal flush */
+    struct TerminalChunk
+    {
+        QString text;
+        QColor color;
+    };
+    QList<TerminalChunk> pendingOutput;
+    qsizetype pendingSize = 0;
+    qsizetype skippedLines = 0;
+    qint64 linesReceived = 0;
+    QTimer *flushTimer;
+    QTimer *throughputTimer;
+    HdLabel *throughputLabel = Q_NULLPTR;
 
 signals:
     void buttonSizeChange(int, int);
@@ -44,9 +63,11 @@ public:
     void setDynamicTitleBarHeight(int h);
     void setStatusBar(HdStatusBar *statusbar);
     void setProgressBar(HdProgressBar *progressbar);
+    void setScheduler(PyRunScheduler *runscheduler);
 
     void refreshRunButton();
-    void clearTerminal();    
+    void clearTerminal();
+    void onInterpreterProbed(QString executable);
     void setTextColor(QColor color);
     void setBlockFormat();
     void updateDpiScaleTerminal();
@@ -61,10 +82,19 @@ public:
     void resetIndent();
     void terminalPrint(QString text);
     void terminalErrorPrint(QString text);
+    void flushOutput();
     void onScreenChanged();
 
 private:
 
+    void queueOutput(QString text, QColor color);
+    void updateJob(int id);
+    void removeJob(int id);
+    void updateJobListVisibility();
+    void showJobListMenu(const QPoint &pos);
+    void openJobOutput(QListWidgetItem *item);
+    void printBatchSummary(int batch);
+    void updateThroughput();
     void showEvent(QShowEvent *event) override;
     void keyPressEvent(QKeyEvent *event) override;
 
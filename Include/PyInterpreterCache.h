@@ -0,0 +1,59 @@
+#ifndef PYINTERPRETERCACHE_H
+#define PYINTERPRETERCACHE_H
+
+#include <QMap>
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+
+
+struct PyInterpreterInfo
+{
+    QString executable;
+    qint64 size = -1;
+    qint64 modified = -1;
+    QString version;
+    QString architecture;
+    QStringList sysPath;
+    QStringList sitePackages;
+
+    bool isValid() const
+    {
+        return !version.isEmpty();
+    }
+};
+
+
+class PyInterpreterCache : public QObject
+{
+    Q_OBJECT
+
+private:
+    QMap<QString, PyInterpreterInfo> interpreters;
+    QSet<QString> probing;
+    QString cacheFilePath;
+
+signals:
+    void interpreterProbed(QString executable);
+
+public:
+    explicit PyInterpreterCache(QObject *parent = Q_NULLPTR);
+
+    void load();
+    void save();
+    PyInterpreterInfo getInfo(QString executable);
+    bool isProbing(QString executable);
+    void refresh(QString executable);
+
+private:
+    static QString cacheKey(QString executable);
+    bool isCurrent(const PyInterpreterInfo &info);
+    void probe(QString executable);
+    void parseProbeOutput(QString executable, QByteArray output);
+
+};
+
+extern PyInterpreterCache interpreterCache;
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef PYIPCCHANNEL_H
+#define PYIPCCHANNEL_H
+
+#include <QByteArray>
+#include <QLocalSocket>
+#include <QMap>
+#include <QObject>
+
+/* Persistent, framed connection between a Python client and PyProcess.
+ *
+ * The client opens one connection per run and sends the 4 byte handshake
+ * "PTF1", which the server echoes. All further traffic consists of frames
+ * with little-endian integers:
+ *
+ *   request:  u32 length | u32 id | u8 opcode | { u16 key size | key | u32 value size | value }*
+ *   reply:    u32 length | u32 id | u8 status | payload
+ *
+ * The length counts the bytes following the length field. Keys and values
+ * are UTF-8 and match the attributes of the XML requests. Every request is
+ * answered with its id, so clients can pipeline requests and match replies
+ * out of order. */
+
+class PyIpcChannel : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Opcode : quint8
+    {
+        OP_PING = 0,
+        OP_SPAM = 1,
+        OP_SIMPLE_QUESTION = 2,
+        OP_USER_INPUT = 3,
+        OP_GET_OPEN_FILE = 4,
+        OP_GET_SAVE_FILE = 5,
+        OP_STATUS_UPDATE = 6,
+        OP_TASK_KILL = 7,
+        OP_DELETE_TASK_KILL = 8,
+        OP_XML_READ = 9,
+        OP_XML_WRITE = 10,
+        OP_ENABLE_PRINTS = 11,
+        OP_DISABLE_PRINTS = 12,
+        OP_PRINT_REGULAR = 13,
+        OP_PRINT_BOLD = 14,
+        OP_PRINT_CURSIVE = 15,
+        OP_PRINT_BOLD_CURSIVE = 16,
+        OP_PRINT_PROPORTIONAL_FONT = 17,
+        OP_PRINT_MONOSPACE_FONT = 18,
+        OP_INCREASE_INDENT = 19,
+        OP_DECREASE_INDENT = 20,
+        OP_RESET_INDENT = 21,
+        OP_RESTART_MODULE = 22
+    };
+
+    enum Status : quint8
+    {
+        STATUS_OK = 0,
+        STATUS_UNKNOWN_REQUEST = 1
+    };
+
+private:
+    QLocalSocket *socket;
+    QByteArray buffer;
+    bool handshakeDone = false;
+    bool reading = false;
+
+signals:
+    void requestReceived(quint32 id, QString requestType, QMap<QString, QString> args);
+    void channelClosed();
+
+public:
+    explicit PyIpcChannel(QLocalSocket *client, QObject *parent = Q_NULLPTR);
+    ~PyIpcChannel() override;
+
+    static QByteArray handshake();
+    static bool isFramedHandshake(QByteArray bytes);
+    static QString requestType(quint8 opcode);
+
+    void start(QByteArray received = QByteArray());
+    void sendReply(quint32 id, QByteArray reply, quint8 status = STATUS_OK);
+    void close();
+    bool isOpen();
+
+private:
+    void readFrames();
+
+};
+
+#endif
@@ -6,23 +6,49 @@
 #include <QLocalServer>
 #include <QLocalSocket>
 #include <QProcess>
+#include <QTemporaryFile>
+#include <functional>
 
+class PyIpcChannel;
+class PyRunLog;
 class PyTools;
 
 class PyProcess : public QProcess
 {
     Q_OBJECT
 
+public:
+    enum RunResult
+    {
+        RUN_SUCCEEDED,
+        RUN_FAILED,
+        RUN_TERMINATED
+    };
+
 private:
     PyTools *pyTools;
     QLocalServer *localServer;
+    PyRunLog *runLog;
+    QTemporaryFile *inputFile = Q_NULLPTR;
     QProcessEnvironment processEnvironment;
     QElapsedTimer timer;
     QList<QPair<QString, int>> taskKillList;
     QList<QPair<QMessageBox*,QString>> handles;
+    QList<PyIpcChannel*> channels;
+    QHash<QLocalSocket*, QByteArray> pendingClients;
     bool printsEnabled = true;
     bool terminatedByUser;
     bool errorTermination;
+    bool runActive = false;
+    bool warmInterpreter = false;
+    bool keepWarm = false;
+    bool headless = false;
+    bool outputFinished = false;
+    bool errorFinished = false;
+    int runExitCode = 0;
+    int runCount = 0;
+    bool runLoadedModules = false;
+    RunResult lastRunResult = RUN_SUCCEEDED;
 
 signals:
     void pyProcessCancelled();
@@ -50,16 +76,36 @@ public:
     void startPyProcess(QString script, QString stdinput);
     void killPyProcess();
     bool isRunning();
+    void warmUp();
+    void recycleInterpreter();
+    void shutdownInterpreter();
+    void setKeepWarm(bool enable);
+    void setHeadless(bool enable);
+    bool isHeadless();
+    bool isWarm();
+    int getRunCount();
+    bool hasLoadedModules();
+    RunResult getLastRunResult();
     static QString getPythonVersion(bool shortstring = false);
     static QString getEmbeddedPythonVersion(bool shortstring = false);
+    static QString getInterpreterVersion(QString executable, bool shortstring = false);
     static bool processIsRunning(QString name, int pid = 0, int timeout = 10000);
     static bool terminateProcess(QString name, int pid = 0);
     void closeExcelBooks(int pid=0);
 
 private:
     void finalizePyProcess(int exitcode, QProcess::ExitStatus exitstatus);
+    void onInterpreterFinished(int exitcode, QProcess::ExitStatus exitstatus);
+    void checkRunFinished();
+    QString takeRunFinishedMarker(QString text, bool error);
+    typedef std::function<void(const QByteArray &reply)> ReplyCallback;
     void onNewConnection();
-    void processClientRequest(QLocalSocket *client);
+    void readClientRequest(QLocalSocket *client);
+    void processClientRequest(QLocalSocket *client, QString requestType, QMap<QString, QString> args);
+    void processChannelRequest(quint32 id, QString requestType, QMap<QString, QString> args);
+    bool dispatchRequest(QString requestType, const QMap<QString, QString> &args, ReplyCallback respond);
+    bool writeInputFile(const QByteArray &input);
+    void removeInputFile();
     void addKillLaterTask(QString imageName, int pid = 0);
     void readStandardOutput();
     void readStandardError();
@@ -0,0 +1,33 @@
+#ifndef PYPROCESSPOOL_H
+#define PYPROCESSPOOL_H
+
+#include <QList>
+#include <QObject>
+
+class PyProcess;
+class PyTools;
+
+class PyProcessPool : public QObject
+{
+    Q_OBJECT
+
+private:
+    PyTools *pyTools;
+    QList<PyProcess*> idleProcesses;
+    int poolSize = 1;
+
+public:
+    explicit PyProcessPool(PyTools *parent);
+    ~PyProcessPool() override;
+
+    PyProcess* acquire();
+    void release(PyProcess *process);
+    void setPoolSize(int size);
+    int getPoolSize();
+    int idleCount();
+    void refill();
+    void clear();
+
+};
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef PYRUNLOG_H
+#define PYRUNLOG_H
+
+#include <QFile>
+#include <QObject>
+#include <QTimer>
+
+/* Writes the log files of PyRunLog on a background thread.
+ *
+ * Records are formatted and collected in blocks before they are written.
+ * A log that grows beyond the maximum file size is continued in a new part,
+ * finished parts are gzip compressed if enabled, and old logs are removed
+ * once they exceed the maximum age or the total size of the log folder. */
+
+class PyRunLogWriter : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Record
+    {
+        qint64 time;
+        char channel;
+        QString text;
+    };
+
+    struct Config
+    {
+        QString directory;
+        bool compress = true;
+        qint64 maxFileSize = 0;
+        qint64 maxTotalSize = 0;
+        int maxAgeDays = 0;
+    };
+
+private:
+    QFile file;
+    QString basePath;
+    Config config;
+    QByteArray block;
+    QTimer *blockTimer;
+    qint64 fileSize = 0;
+    int part = 0;
+
+public:
+    explicit PyRunLogWriter(QObject *parent = Q_NULLPTR);
+    ~PyRunLogWriter() override;
+
+    void open(QString path, Config config);
+    void write(QList<PyRunLogWriter::Record> records);
+    void close();
+
+    static bool gzipFile(QString path);
+
+private:
+    void writeBlock();
+    void openPart();
+    void closePart();
+    void removeOldLogs();
+
+};
+
+/* Streams stdout, stderr and IPC events of every run of a PyProcess to a
+ * log file under the application data folder. Records are collected on
+ * the GUI thread and handed to the writer thread every 250 ms, so logging
+ * does not add file I/O to the GUI thread. */
+
+class PyRunLog : public QObject
+{
+    Q_OBJECT
+
+private:
+    PyRunLogWriter *writer;
+    QList<PyRunLogWriter::Record> pending;
+    QTimer *flushTimer;
+    bool active = false;
+
+public:
+    explicit PyRunLog(QObject *parent = Q_NULLPTR);
+    ~PyRunLog() override;
+
+    /* Closes the log and releases the writer, no runs are logged afterwards */
+    void finish();
+    void beginRun(QString script);
+    void endRun(QString status);
+    void logOutput(const QString &text);
+    void logError(const QString &text);
+    void logEvent(const QString &text);
+    bool isActive();
+
+private:
+    void append(char channel, const QString &text);
+    void flush();
+
+};
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef PYRUNSCHEDULER_H
+#define PYRUNSCHEDULER_H
+
+#include <QList>
+#include <QObject>
+
+class PyProcess;
+class PyProcessPool;
+
+/* Queue for module runs and actions.
+ *
+ * Jobs that print to the terminal run one after another on the process of
+ * the dock, silent jobs run on interpreters of the process pool. Waiting
+ * jobs start in order of priority and submission as long as fewer than
+ * the maximum number of parallel runs are active. Finished jobs are kept
+ * for a while so their status can be shown.
+ *
+ * Jobs can be grouped in batches, batchFinished is emitted once all jobs
+ * of a batch are done. Silent jobs can capture their output, so it can be
+ * shown after the run. */
+
+class PyRunScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Priority
+    {
+        PRIORITY_LOW = -1,
+        PRIORITY_NORMAL = 0,
+        PRIORITY_HIGH = 1
+    };
+
+    enum JobStatus
+    {
+        JOB_QUEUED,
+        JOB_RUNNING,
+        JOB_FINISHED,
+        JOB_FAILED,
+        JOB_CANCELLED
+    };
+
+    struct Job
+    {
+        int id = 0;
+        QString name;
+        QString script;
+        QString input;
+        int priority = PRIORITY_NORMAL;
+        bool terminal = true;
+        JobStatus status = JOB_QUEUED;
+        PyProcess *process = Q_NULLPTR;
+        QList<QMetaObject::Connection> connections;
+        int batch = 0;
+        bool capture = false;
+        QString output;
+        qint64 startTime = 0;
+        qint64 endTime = 0;
+    };
+
+private:
+    PyProcess *terminalProcess;
+    PyProcessPool *processPool;
+    QList<Job> jobs;
+    int nextId = 1;
+    int nextBatch = 1;
+    int maxParallel = 1;
+    int historySize = 20;
+    bool schedulePending = false;
+
+signals:
+    void jobAdded(int id);
+    void jobChanged(int id);
+    void jobRemoved(int id);
+    void jobFinished(int id);
+    void jobOutput(int id, QString text, bool error);
+    void batchFinished(int batch);
+    void queueEmpty();
+
+public:
+    explicit PyRunScheduler(PyProcess *terminal, PyProcessPool *pool, QObject *parent = Q_NULLPTR);
+    ~PyRunScheduler() override;
+
+    int submit(QString name, QString script, QString input, bool terminal = true, int priority = PRIORITY_NORMAL, int batch = 0, bool capture = false);
+    int createBatch();
+    QList<int> batchJobIds(int batch);
+    bool batchActive(int batch);
+    void cancel(int id);
+    void cancelQueued();
+    void clearHistory();
+    bool contains(int id);
+    Job job(int id);
+    QList<int> jobIds();
+    int runningCount();
+    int queuedCount();
+    void setMaxParallel(int count);
+    int getMaxParallel();
+    static QString statusText(JobStatus status);
+
+private:
+    int indexOf(int id);
+    bool terminalBusy();
+    void scheduleLater();
+    void schedule();
+    void startJob(Job &job);
+    void finishJob(int id, bool started);
+    void appendOutput(int id, QString text, bool error);
+    void pruneHistory();
+
+};
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef PYTERMINAL_H
+#define PYTERMINAL_H
+
+#include <QAbstractScrollArea>
+#include <QColor>
+#include <QSharedPointer>
+#include <QTextLayout>
+
+/* Read-only terminal view for the output of python processes.
+ *
+ * Output is stored as lines of styled spans in a ring buffer with a fixed
+ * number of lines, the oldest line is dropped when a new line does not fit.
+ * Only the lines on screen are laid out and painted, and the vertical
+ * scroll bar counts lines instead of pixels, so memory and repaint cost do
+ * not depend on the amount of output printed during a run. */
+
+class PyTerminal : public QAbstractScrollArea
+{
+    Q_OBJECT
+
+private:
+    enum SpanStyle : quint8
+    {
+        STYLE_BOLD = 0x1,
+        STYLE_CURSIVE = 0x2,
+        STYLE_MONOSPACE = 0x4
+    };
+
+    struct TerminalSpan
+    {
+        QString text;
+        QColor color;
+        quint8 style;
+    };
+
+    struct TerminalLine
+    {
+        QList<TerminalSpan> spans;
+        qreal indent = 0.0;
+        qsizetype length = 0;
+    };
+
+    struct VisibleLine
+    {
+        qint64 number;
+        QSharedPointer<QTextLayout> layout;
+        qreal top;
+        qreal height;
+    };
+
+    struct Position
+    {
+        qint64 line = -1;
+        int column = 0;
+    };
+
+    /* Ring buffer, line i is stored at (head + i) % lines.size() */
+    QList<TerminalLine> lines;
+    qsizetype head = 0;
+    qsizetype capacity = 10000;
+    qint64 firstLine = 0;
+    qsizetype droppedLines = 0;
+
+    quint8 style = 0;
+    qreal indent = 0.0;
+    bool wordWrap = true;
+    bool followOutput = true;
+    bool scrollUpdatePending = false;
+    qreal tabStop = 32.0;
+    QString regularFamily;
+    QString monospaceFamily;
+    QFont fonts[8];
+
+    QList<VisibleLine> visibleLines;
+    Position selectionAnchor;
+    Position selectionCursor;
+    bool selecting = false;
+
+public:
+    explicit PyTerminal(QWidget *parent = Q_NULLPTR);
+
+    void clear();
+    void append(QString text, QColor color);
+    void beginLine(bool bold, bool cursive, bool monospace, qreal indent);
+    void setScrollbackLimit(qsizetype limit);
+    qsizetype scrollbackLimit();
+    qsizetype lineCount();
+    void setWordWrap(bool enable);
+    bool wordWrapEnabled();
+    void setTabStopDistance(qreal distance);
+    qreal tabStopDistance();
+    void setFontFamilies(QString regular, QString monospace);
+    QString selectedText();
+    void copy();
+    void selectAll();
+    void scrollToBottom();
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void changeEvent(QEvent *event) override;
+    void keyPressEvent(QKeyEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mouseReleaseEvent(QMouseEvent *event) override;
+    void contextMenuEvent(QContextMenuEvent *event) override;
+
+private:
+    TerminalLine &line(qsizetype i);
+    QString lineText(qsizetype i);
+    void pushLine();
+    void updateFonts();
+    void scheduleScrollUpdate();
+    void updateScrollBars();
+    void layoutVisibleLines();
+    QSharedPointer<QTextLayout> createLayout(const TerminalLine &terminalLine, qreal width);
+    Position hitTest(QPoint point);
+    bool selectionRange(Position &start, Position &end);
+
+};
+
+#endif
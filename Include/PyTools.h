@@ -14,6 +14,8 @@
 #include <Settings.h>
 
 class PyDock;
+class PyProcessPool;
+class PyRunScheduler;
 
 class PyTools : public FramelessMainWindow
 {
@@ -50,6 +52,8 @@ private:
     FramelessFileDialog *fileDialog = Q_NULLPTR;
     XmlApplication *xmlApp;
     PyDock* pyDock;
+    PyProcessPool *processPool;
+    PyRunScheduler *scheduler;
     HdToolBar *statusWidget;
     HdProgressBar *progressBar;
     HdStatusBar *statusBar;
@@ -67,6 +71,7 @@ public slots:
     void installModuleTriggered();
     void installModule(QString archive);
     void startModule();
+    void runAllTabs();
     void stopModule();
     void pyModuleTriggered();
     void pyActionTriggered();
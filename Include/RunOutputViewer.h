@@ -0,0 +1,58 @@
+#ifndef RUNOUTPUTVIEWER_H
+#define RUNOUTPUTVIEWER_H
+
+#include <FramelessMainWindow.h>
+#include <PyRunScheduler.h>
+#include <PyTerminal.h>
+#include <Settings.h>
+
+
+class RunOutputViewer : public FramelessMainWindow
+{
+    Q_OBJECT
+
+private:
+    PyTerminal *terminal;
+
+public:
+
+    explicit RunOutputViewer(QWidget *parent = Q_NULLPTR) : FramelessMainWindow(parent, FramelessWindowTitleBar::WINDOW)
+    {
+        /* Create terminal for the captured output */
+        terminal = new PyTerminal(this);
+        terminal->setWordWrap(settings.wordWrapIsOn());
+        terminal->setScrollbackLimit(settings.getScrollbackLimit());
+        terminal->setFontFamilies(settings.getFontType("regular"), settings.getFontType("monospace"));
+        terminal->setContentsMargins(0,0,0,0);
+        setCentralWidget(terminal);
+
+        resize(720, 480);
+    }
+
+    void append(QString text, bool error = false)
+    {
+        terminal->append(text, error ? QColor(220,0,0) : QColor(255,255,255));
+    }
+
+    static RunOutputViewer* openRunOutput(PyRunScheduler *scheduler, int id)
+    {
+        PyRunScheduler::Job job = scheduler->job(id);
+
+        RunOutputViewer *viewer = new RunOutputViewer();
+        viewer->setAttribute(Qt::WA_DeleteOnClose, true);
+        connect(&settings, &Settings::aboutToQuit, viewer, &RunOutputViewer::close);
+
+        /* Follow the output while the job is running */
+        viewer->append(job.output);
+        connect(scheduler, &PyRunScheduler::jobOutput, viewer, [viewer, id](int job, QString text, bool error){ if (job == id) viewer->append(text, error); });
+
+        viewer->setWindowTitle(job.name);
+        viewer->show();
+        viewer->setDpiScale(settings.getGlobalDpiScale());
+        viewer->setFocus();
+        return viewer;
+    }
+
+};
+
+#endif
@@ -5,12 +5,14 @@
 #include <QDir>
 #include <QDirIterator>
 #include <QFile>
+#include <QHash>
 #include <QProcess>
 #include <QRegularExpression>
 #include <QSettings>
 #include <QStandardPaths>
 #include <QString>
 #include <QStringList>
+#include <QThread>
 #include <QLineEdit>
 #include <QLabel>
 #include <QTabBar>
@@ -29,6 +31,41 @@ private:
     QSettings *settings;
     QMap<QString, QVariant> configs;
 
+    /* Sizes are measured at scale 1.0 with the base stylesheet and scaled
+       by the widgets. The label is polished once, measured sizes are kept
+       until the stylesheet is loaded again. */
+    struct Metrics
+    {
+        QLabel *label = Q_NULLPTR;
+        QHash<QString, int> labelWidths;
+        int labelHeight = -1;
+        int lineEditHeight = -1;
+        int tabBarHeight = -1;
+    };
+    Metrics metrics;
+
+public:
+    /* Stylesheet split into literal text and the sizes between, so a
+       scaled stylesheet is written in one pass */
+    struct StyleSheetTemplate
+    {
+        enum Unit
+        {
+            UNIT_PX,
+            UNIT_HALF_PX,
+            UNIT_PT,
+            UNIT_INTEGER_PT
+        };
+
+        QStringList literals;
+        QList<Unit> units;
+        QList<double> sizes;
+    };
+
+private:
+    StyleSheetTemplate styleSheetTemplate;
+    QHash<int, QString> scaledStyleSheets;
+
 signals:
     void globalDpiScaleChanged(double);
     void applicationNameChanged(QString);
@@ -94,37 +131,45 @@ public:
         dialogPath = QStandardPaths::writableLocation(QStandardPaths::DesktopLocation);
         settings = new QSettings(appDataPath + "/settings.ini", QSettings::IniFormat, this);
 
-        /* Load stylesheet */
-        QFile file(applicationPath + "/styleSheet.css");
-        if (file.open(QFile::ReadOnly))
-            rawStyleSheet = file.readAll();
-        file.close();
-
-        /* Set icon directory */
-        rawStyleSheet.replace("%ICONDIR%", applicationPath + "/icons");
-
-        /* Set colors and fonts from configuration settings */
-        for (QMap<QString, QVariant>::iterator it = configs.begin(); it != configs.end(); ++it)
-            rawStyleSheet.replace(QString("%" + it.key() + "%"), it.value().toString());
-
-        /* Get default heigth of a line edit */
-        QLineEdit dummy("TeXtpad");
-        QString tmp = rawStyleSheet;
-        tmp.replace("%button-height%", "1px");
-        dummy.setStyleSheet(tmp);
-        int height = dummy.sizeHint().height();
-
-        /* Set default height in stylesheet */
-        rawStyleSheet.replace("%button-height%", QString::number(height-2) + "px");
-        baseStyleSheet = cssScale(rawStyleSheet, 1.0);
-
-        /* Debug stylesheet */
-        int i = 0;
-        for (QString &line: baseStyleSheet.split("\r\n"))
+        /* Stylesheet is only needed with widgets, not in headless runs */
+        if (qobject_cast<QApplication*>(QCoreApplication::instance()) != Q_NULLPTR)
         {
-            ++i;
-            if (line.contains("%"))
-                qDebug() << i << ": " << line;
+            clearMetrics();
+
+            /* Load stylesheet */
+            QFile file(applicationPath + "/styleSheet.css");
+            if (file.open(QFile::ReadOnly))
+                rawStyleSheet = file.readAll();
+            file.close();
+
+            /* Set icon directory */
+            rawStyleSheet.replace("%ICONDIR%", applicationPath + "/icons");
+
+            /* Set colors and fonts from configuration settings */
+            for (QMap<QString, QVariant>::iterator it = configs.begin(); it != configs.end(); ++it)
+                rawStyleSheet.replace(QString("%" + it.key() + "%"), it.value().toString());
+
+            /* Get default heigth of a line edit */
+            QLineEdit dummy("TeXtpad");
+            QString tmp = rawStyleSheet;
+            tmp.replace("%button-height%", "1px");
+            dummy.setStyleSheet(tmp);
+            int height = dummy.sizeHint().height();
+
+            /* Set default height in stylesheet */
+            rawStyleSheet.replace("%button-height%", QString::number(height-2) + "px");
+            styleSheetTemplate = compileStyleSheet(rawStyleSheet);
+            scaledStyleSheets.clear();
+            baseStyleSheet = getScaledStyleSheet(1.0);
+
+            /* Debug stylesheet */
+            int i = 0;
+            for (QString &line: baseStyleSheet.split("\r\n"))
+            {
+                ++i;
+                if (line.contains("%"))
+                    qDebug() << i << ": " << line;
+            }
         }
 
         initializePaths();
@@ -169,7 +214,7 @@ public:
     bool setPythonPath(QString path)
     {
         QFileInfo exefile(path);
-        if (exefile.exists() && exefile.fileName().toLower() == "python.exe")
+        if (exefile.exists() && exefile.isFile() && exefile.fileName().startsWith("python", Qt::CaseInsensitive))
         {
             if (exefile.absoluteFilePath().toLower() != pythonPath.toLower())
             {
@@ -214,7 +259,18 @@ public:
 
     QString getScaledStyleSheet(double scale)
     {
-        return cssScale(rawStyleSheet, scale);
+        /* Windows scale in steps of 0.05, the sheet of each step is written once */
+        int step = qRound(scale / 0.05);
+        if (std::abs(step * 0.05 - scale) > 1e-9)
+            return renderStyleSheet(styleSheetTemplate, scale);
+
+        QHash<int, QString>::const_iterator it = scaledStyleSheets.constFind(step);
+        if (it != scaledStyleSheets.constEnd())
+            return it.value();
+
+        QString sheet = renderStyleSheet(styleSheetTemplate, scale);
+        scaledStyleSheets.insert(step, sheet);
+        return sheet;
     }
 
     void setGlobalDpiScale(double dpi)
@@ -295,72 +351,70 @@ public:
 
     int getLabelHeight(QWidget *parent = Q_NULLPTR)
     {
-        QLabel dummy("TeXtpad", parent);
-        dummy.setIndent(0);
-        dummy.setSizePolicy(QSizePolicy::Minimum,QSizePolicy::Minimum);
-        dummy.setStyleSheet(baseStyleSheet);
-        dummy.ensurePolished();
-        return dummy.sizeHint().height();
+        Q_UNUSED(parent)
+        if (metrics.labelHeight < 0)
+            metrics.labelHeight = measureLabel("TeXtpad").height();
+        return metrics.labelHeight;
     }
 
     int getLineEditHeight(QWidget *parent = Q_NULLPTR)
     {
-        QLineEdit dummy("TeXtpad", parent);
-        dummy.setSizePolicy(QSizePolicy::Minimum,QSizePolicy::Minimum);
-        dummy.setStyleSheet(baseStyleSheet);
-        return dummy.sizeHint().height();
+        Q_UNUSED(parent)
+        if (metrics.lineEditHeight < 0)
+        {
+            QLineEdit dummy("TeXtpad");
+            dummy.setSizePolicy(QSizePolicy::Minimum,QSizePolicy::Minimum);
+            dummy.setStyleSheet(baseStyleSheet);
+            metrics.lineEditHeight = dummy.sizeHint().height();
+        }
+        return metrics.lineEditHeight;
     }
 
     int getLabelWidth(int length, QWidget *parent = Q_NULLPTR)
     {
-        QLabel dummy(QString("X").repeated(length), parent);
-        dummy.setIndent(0);
-        dummy.setSizePolicy(QSizePolicy::Minimum,QSizePolicy::Minimum);
-        dummy.setStyleSheet(baseStyleSheet);
-        dummy.ensurePolished();
-        return dummy.sizeHint().width();
+        return getLabelWidth(QString("X").repeated(length), parent);
     }
 
     int getLabelWidth(QString text, QWidget *parent = Q_NULLPTR)
     {
-        QLabel dummy(text, parent);
-        dummy.setIndent(0);
-        dummy.setSizePolicy(QSizePolicy::Minimum,QSizePolicy::Minimum);
-        dummy.setStyleSheet(baseStyleSheet);
-        dummy.ensurePolished();
-        return dummy.sizeHint().width();
+        Q_UNUSED(parent)
+        QHash<QString, int>::const_iterator it = metrics.labelWidths.constFind(text);
+        if (it != metrics.labelWidths.constEnd())
+            return it.value();
+
+        int width = measureLabel(text).width();
+        metrics.labelWidths.insert(text, width);
+        return width;
     }
 
     int getLabelWidth(QList<QString> texts, QWidget *parent = Q_NULLPTR)
     {
         int width = 0;
-
-        if (texts.isEmpty())
-            return width;
-
-        QLabel dummy(parent);
-        dummy.setIndent(0);
-        dummy.setSizePolicy(QSizePolicy::Minimum,QSizePolicy::Minimum);
-        dummy.setStyleSheet(baseStyleSheet);
-        dummy.ensurePolished();
-
         for (const QString &text: texts)
-        {
-            dummy.setText(text);
-            width = std::max(width, dummy.sizeHint().width());
-        }
+            width = std::max(width, getLabelWidth(text, parent));
 
         return width;
     }
 
     int getTabBarHeight(QWidget *parent = Q_NULLPTR)
     {
-        QTabBar dummy(parent);
-        dummy.setSizePolicy(QSizePolicy::Minimum,QSizePolicy::Minimum);
-        dummy.setStyleSheet(getScaledStyleSheet(1.0));
-        dummy.addTab("TeXtpad");
-        dummy.ensurePolished();
-        return dummy.sizeHint().height();
+        Q_UNUSED(parent)
+        if (metrics.tabBarHeight < 0)
+        {
+            QTabBar dummy;
+            dummy.setSizePolicy(QSizePolicy::Minimum,QSizePolicy::Minimum);
+            dummy.setStyleSheet(baseStyleSheet);
+            dummy.addTab("TeXtpad");
+            dummy.ensurePolished();
+            metrics.tabBarHeight = dummy.sizeHint().height();
+        }
+        return metrics.tabBarHeight;
+    }
+
+    void clearMetrics()
+    {
+        delete metrics.label;
+        metrics = Metrics();
     }
 
     QString getEditorFilePath()
@@ -378,8 +432,96 @@ public:
         return getValue("settings/word-wrap", "true").toBool();
     }
 
+    bool warmInterpretersEnabled()
+    {
+        return getValue("settings/warm-interpreters", "false").toBool();
+    }
+
+    int getInterpreterPoolSize()
+    {
+        return std::max(0, getValue("settings/interpreter-pool-size", 1).toInt());
+    }
+
+    int getInterpreterRecycleRuns()
+    {
+        return std::max(1, getValue("settings/interpreter-recycle-runs", 25).toInt());
+    }
+
+    QString getInterpreterPreload()
+    {
+        return getValue("settings/interpreter-preload", "").toString();
+    }
+
+    int getScrollbackLimit()
+    {
+        return std::max(100, getValue("settings/scrollback-lines", 10000).toInt());
+    }
+
+    bool runLogEnabled()
+    {
+        return getValue("settings/run-log", "true").toBool();
+    }
+
+    bool runLogCompressionEnabled()
+    {
+        return getValue("settings/run-log-compress", "true").toBool();
+    }
+
+    qint64 getRunLogMaxFileSize()
+    {
+        return qint64(std::max(1, getValue("settings/run-log-max-file-mb", 32).toInt())) * 1024 * 1024;
+    }
+
+    qint64 getRunLogMaxTotalSize()
+    {
+        return qint64(std::max(1, getValue("settings/run-log-max-total-mb", 256).toInt())) * 1024 * 1024;
+    }
+
+    int getRunLogMaxAge()
+    {
+        return std::max(1, getValue("settings/run-log-max-age-days", 14).toInt());
+    }
+
+    int getMaxParallelRuns()
+    {
+        return std::max(1, getValue("settings/max-parallel-runs", std::max(1, QThread::idealThreadCount() - 1)).toInt());
+    }
+
+    bool autosaveEnabled()
+    {
+        return getValue("settings/autosave", "true").toBool();
+    }
+
+    int getAutosaveInterval()
+    {
+        return std::max(1, getValue("settings/autosave-interval-seconds", 30).toInt());
+    }
+
+    int getTabEvictionTime()
+    {
+        return std::max(0, getValue("settings/tab-eviction-minutes", 0).toInt());
+    }
+
 private:
 
+    QSize measureLabel(const QString &text)
+    {
+        if (metrics.label == Q_NULLPTR)
+        {
+            metrics.label = new QLabel();
+            metrics.label->setIndent(0);
+            metrics.label->setSizePolicy(QSizePolicy::Minimum,QSizePolicy::Minimum);
+            metrics.label->setStyleSheet(baseStyleSheet);
+            metrics.label->ensurePolished();
+
+            /* Widgets must not outlive the application */
+            connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, this, &Settings::clearMetrics, Qt::UniqueConnection);
+        }
+
+        metrics.label->setText(text);
+        return metrics.label->sizeHint();
+    }
+
     void initializePaths()
     {
         /* Locate python executable */
@@ -420,79 +562,94 @@ private:
 
     static QString cssScale(QString text, double scale)
     {
-        bool hidpi = true;
-
-        /* Scale pixel sizes "8px" */
-        static QRegularExpression expression;
-        expression.setPattern("\\b([0-9]+[.,]?[0-9]*)px\\b");
-        QRegularExpressionMatch match;
-        while ((match = expression.match(text)).hasMatch())
-        {
-            int offset = int(match.capturedStart(0));
-            text.remove(offset, match.capturedLength(0));
+        return renderStyleSheet(compileStyleSheet(text), scale);
+    }
 
-            int size = qRound(match.captured(1).toDouble() * scale);
-            text.insert(offset, QString::number(size) + "#px");
-        }
-        text.replace("#px","px");
+    static StyleSheetTemplate compileStyleSheet(const QString &text)
+    {
+        /* Sizes "8px", halfsizes "16%px", fractional "8.0pt" and integer point sizes "8pt" */
+        static const QRegularExpression expression("\\b([0-9]+[.,]?[0-9]*)(%px|px|pt)\\b");
 
-        /* Scale pixel halfsizes "16%px" */
-        expression.setPattern("\\b([0-9]+[.,]?[0-9]*)%px\\b");
-        while ((match = expression.match(text)).hasMatch())
+        StyleSheetTemplate sheet;
+        qsizetype copied = 0;
+        QRegularExpressionMatchIterator it = expression.globalMatch(text);
+        while (it.hasNext())
         {
-            int offset = int(match.capturedStart(0));
-            text.remove(offset, match.capturedLength(0));
+            QRegularExpressionMatch match = it.next();
+            QStringView number = match.capturedView(1);
+            QStringView unit = match.capturedView(2);
+
+            if (unit == QLatin1String("%px"))
+                sheet.units.append(StyleSheetTemplate::UNIT_HALF_PX);
+            else if (unit == QLatin1String("px"))
+                sheet.units.append(StyleSheetTemplate::UNIT_PX);
+            else if (number.contains('.') || number.contains(','))
+                sheet.units.append(StyleSheetTemplate::UNIT_PT);
+            else
+                sheet.units.append(StyleSheetTemplate::UNIT_INTEGER_PT);
 
-            int size = 2*qRound(match.captured(1).toDouble() * scale);
-            text.insert(offset, QString::number(size) + "px");
+            sheet.sizes.append(number.toDouble());
+            sheet.literals.append(text.mid(copied, match.capturedStart(0) - copied));
+            copied = match.capturedEnd(0);
         }
+        sheet.literals.append(text.mid(copied));
 
-        /* Scale fractional point sizes "8.0pt" */
-        expression.setPattern("\\b([0-9]+[.,]{1}[0-9]*)pt\\b");
-        while ((match = expression.match(text)).hasMatch())
-        {
-            int offset = int(match.capturedStart(0));
-            text.remove(offset, match.capturedLength(0));
+        return sheet;
+    }
 
-            double pts = match.captured(1).toDouble();
-            pts = 0.5*qRound(2 * std::min(72.0, std::max(6.0, pts * scale)));
+    static QString renderStyleSheet(const StyleSheetTemplate &sheet, double scale)
+    {
+        static const QList<int> points = {8,9,10,11,12,14,16,18,20,22,24,26,28,36,48,72};
 
-            if (hidpi)
-                text.insert(offset, QString::number(qRound(pts*96.0/72.0)) + "px");
-            else
-                text.insert(offset, QString::number(pts) + "#pt");
-        }
+        qsizetype length = 0;
+        for (const QString &literal: sheet.literals)
+            length += literal.size() + 6;
 
-        /* Scale integer point sizes "8pt" */
-        expression.setPattern("\\b([0-9]+)pt\\b");
-        QList<int> points = {8,9,10,11,12,14,16,18,20,22,24,26,28,36,48,72};
-        while ((match = expression.match(text)).hasMatch())
+        QString text;
+        text.reserve(length);
+        for (qsizetype n = 0; n < sheet.units.size(); ++n)
         {
-            int offset = int(match.capturedStart(0));
-            text.remove(offset, match.capturedLength(0));
-
-            double pts = match.captured(1).toDouble();
-            int pt = qRound(std::min(72.0, std::max(8.0, pts * scale)));
+            text += sheet.literals[n];
 
-            for (int i = 0; i < points.size()-1; ++i)
+            double size = sheet.sizes[n];
+            switch (sheet.units[n])
             {
-                if (points[i] <= pt && points[i+1] > pt)
+            case StyleSheetTemplate::UNIT_PX:
+                text += QString::number(qRound(size * scale));
+                break;
+            case StyleSheetTemplate::UNIT_HALF_PX:
+                text += QString::number(2*qRound(size * scale));
+                break;
+            case StyleSheetTemplate::UNIT_PT:
+            {
+                double pts = 0.5*qRound(2 * std::min(72.0, std::max(6.0, size * scale)));
+                text += QString::number(qRound(pts*96.0/72.0));
+                break;
+            }
+            case StyleSheetTemplate::UNIT_INTEGER_PT:
+            {
+                int pt = qRound(std::min(72.0, std::max(8.0, size * scale)));
+                for (int i = 0; i < points.size()-1; ++i)
                 {
-                    if ((pt - points[i]) < (points[i+1] - pt))
-                        pt = points[i];
-                    else
-                        pt = points[i+1];
+                    if (points[i] <= pt && points[i+1] > pt)
+                    {
+                        if ((pt - points[i]) < (points[i+1] - pt))
+                            pt = points[i];
+                        else
+                            pt = points[i+1];
+                    }
                 }
+                text += QString::number(qRound(pt*96.0/72.0));
+                break;
+            }
             }
 
-            if (hidpi)
-                text.insert(offset, QString::number(qRound(pt*96.0/72.0)) + "px");
-            else
-                text.insert(offset, QString::number(pts) + "#pt");
+            /* Point sizes are converted to pixels */
+            text += QLatin1String("px");
         }
 
-        if (!hidpi)
-            text.replace("#pt","pt");
+        if (!sheet.literals.isEmpty())
+            text += sheet.literals.last();
         return text;
     }
 
@@ -2,9 +2,12 @@
 #define XMLABSTRACTOBJECT_H
 
 #include <pugixml.hpp>
+#include <functional>
 #include <string>
 #include <cstring>
+#include <QSet>
 #include <QString>
+#include <QStringList>
 #include <QVariant>
 
 
@@ -25,17 +28,52 @@ class XmlAbstractObject
 protected:
     pugi::xml_node xmlNode;
 
+    /* Unchanged values keep the revision, the serialized module stays valid */
+    void updateAttribute(QString attribute, QString value)
+    {
+        std::string str = attribute.toStdString();
+        const char *atrr = str.c_str();
+        std::string val = value.toStdString();
+
+        pugi::xml_attribute attr = xmlNode.attribute(atrr);
+        if (attr && val == attr.value())
+            return;
+
+        if (!attr)
+            attr = xmlNode.append_attribute(atrr);
+        attr.set_value(val.c_str());
+        setModified(atrr);
+    }
+
 public:
     XmlAbstractObject()
     { }
 
     XmlAbstractObject(pugi::xml_node node)
     {
+        /* Objects that normalize their node mark their changes themselves */
         xmlNode = node;
     }
 
     virtual ~XmlAbstractObject();
 
+    /* Every change to a module subtree raises its revision, serialized
+       modules are reused as long as their revision is unchanged. Changes
+       outside of the modules raise the revision of the document. */
+    static quint64 markModified(pugi::xml_node node, const char *attribute = nullptr);
+    static quint64 getRevision(pugi::xml_node node);
+    static pugi::xml_node revisionScope(pugi::xml_node node);
+
+    /* Observer of all changes, the attribute is null for changes of the
+       structure and the value is null for removed attributes */
+    typedef std::function<void(pugi::xml_node node, const char *attribute, const char *value)> ChangeObserver;
+    static void setChangeObserver(ChangeObserver observer);
+
+    void setModified(const char *attribute = nullptr)
+    {
+        markModified(xmlNode, attribute);
+    }
+
     virtual QString getElementType()
     {
         return QString(xmlNode.name());
@@ -53,7 +91,9 @@ public:
 
     virtual void deleteAttribute(QString attribute)
     {
-        xmlNode.remove_attribute(attribute.toStdString().c_str());
+        std::string str = attribute.toStdString();
+        if (xmlNode.remove_attribute(str.c_str()))
+            setModified(str.c_str());
         return;
     }
 
@@ -134,35 +174,18 @@ public:
 
     virtual void setAttributeValue(QString attribute, bool value)
     {
-        std::string str = attribute.toStdString();
-        const char *atrr = str.c_str();
-
-        if (xmlNode.attribute(atrr))
-            xmlNode.attribute(atrr).set_value(int(value));
-        else
-        {
-            xmlNode.append_attribute(atrr);
-            xmlNode.attribute(atrr).set_value(int(value));
-        }
+        updateAttribute(attribute, QString::number(int(value)));
         return;
     }
 
     virtual void setAttributeValue(QString attribute, int value)
     {
-        std::string str = attribute.toStdString();
-        const char *atrr = str.c_str();
-
-        if (xmlNode.attribute(atrr))
-            xmlNode.attribute(atrr).set_value(value);
-        else
-            xmlNode.append_attribute(atrr).set_value(value);
+        updateAttribute(attribute, QString::number(value));
         return;
     }
 
     virtual void setAttributeValue(QString attribute, double value, int precision = -1)
     {
-        std::string str = attribute.toStdString();
-        const char *atrr = str.c_str();
         QString val;
 
         if (precision >= 0)
@@ -170,34 +193,19 @@ public:
         else
             val = QVariant(value).toString();
 
-        if (xmlNode.attribute(atrr))
-            xmlNode.attribute(atrr).set_value(val.toStdString().c_str());
-        else
-            xmlNode.append_attribute(atrr).set_value(val.toStdString().c_str());
+        updateAttribute(attribute, val);
         return;
     }
 
     virtual void setAttributeValue(QString attribute, QString value)
     {
-        std::string str = attribute.toStdString();
-        const char *atrr = str.c_str();
-
-        if (xmlNode.attribute(atrr))
-            xmlNode.attribute(atrr).set_value(value.toStdString().c_str());
-        else
-            xmlNode.append_attribute(atrr).set_value(value.toStdString().c_str());
+        updateAttribute(attribute, value);
         return;
     }
 
     virtual void setAttributeValue(QString attribute, QVariant value)
     {
-        std::string str = attribute.toStdString();
-        const char *atrr = str.c_str();
-
-        if (xmlNode.attribute(atrr))
-            xmlNode.attribute(atrr).set_value(value.toString().toStdString().c_str());
-        else
-            xmlNode.append_attribute(atrr).set_value(value.toString().toStdString().c_str());
+        updateAttribute(attribute, value.toString());
         return;
     }
 
@@ -214,6 +222,38 @@ public:
         return QString(writer.result.c_str());
     }
 
+    /* Values of the items of a node in order, empty and repeated items are removed */
+    static QStringList readItems(pugi::xml_node node)
+    {
+        QStringList texts;
+        QSet<QString> known;
+        bool changed = false;
+        for (pugi::xml_node items_node: node.children("items"))
+        {
+            for (pugi::xml_node item_node = items_node.child("item"); item_node; )
+            {
+                pugi::xml_node next = item_node.next_sibling("item");
+
+                QString text = item_node.attribute("value").value();
+                if (!text.trimmed().isEmpty() && !known.contains(text))
+                {
+                    known.insert(text);
+                    texts.append(text);
+                    changed = item_node.remove_attribute("index") || changed;
+                }
+                else
+                    changed = items_node.remove_child(item_node) || changed;
+
+                item_node = next;
+            }
+        }
+
+        if (changed)
+            markModified(node);
+
+        return texts;
+    }
+
 };
 
 #endif
@@ -4,10 +4,12 @@
 #include <QFile>
 #include <QMap>
 #include <QMessageBox>
-#include <QStringDecoder>
+#include <QSaveFile>
 #include <HdWidgets.h>
 #include <Settings.h>
 #include <XmlModule.h>
+#include <XmlSessionAutosave.h>
+#include <XmlTableModel.h>
 #include <FramelessMessageBox.h>
 
 
@@ -18,6 +20,7 @@ class XmlApplication : public HdWidget
 private:
     pugi::xml_document document;
     XmlModule *module = Q_NULLPTR;
+    XmlSessionAutosave *autosave;
     QBoxLayout *layout;
 
 public:
@@ -26,11 +29,19 @@ public:
         layout = new QBoxLayout(QBoxLayout::TopToBottom, this);
         layout->setContentsMargins(0,0,0,0);
         layout->setSpacing(0);
+
+        /* Restores a session that was not closed, before the last session is loaded */
+        autosave = new XmlSessionAutosave(settings.getAppDataPath() + "/LastSession.xml", this);
+        autosave->setSource([this](QString path){ return isValid() ? currentModule()->toSessionString(path) : QString(); });
+
+        /* The recovered session has its own copies of the side-car files the checkpoint refers to */
+        XmlTableModel::removeStaleColumnarData();
     }
 
     ~XmlApplication() override
     {
-        saveCurrentModule(settings.getAppDataPath() + "/LastSession.xml");
+        if (saveCurrentModule(settings.getAppDataPath() + "/LastSession.xml"))
+            autosave->discard();
     }
 
     bool isValid()
@@ -40,134 +51,108 @@ public:
 
     bool loadXmlFile(QString filepath)
     {
-        QFile file(filepath);
-        QString data;
+        QString error, details;
+        if (parseXmlFile(filepath, document, error, details))
+            return true;
+
+        FramelessMessageBox msg(QMessageBox::Critical, settings.getApplicationName(), error, QMessageBox::Ok);
+        if (error == "XML parsed with errors.")
+            msg.setDetailedText(details);
+        else if (!details.isEmpty())
+            msg.setInformativeText(details);
+        msg.setDpiScale(getDpiScale());
+        msg.exec();
+        return false;
+    }
 
-        if (file.open(QIODevice::ReadOnly))
+    static bool parseXmlFile(QString filepath, pugi::xml_document &target, QString &error, QString &details)
+    {
+        /* Widget free, so sessions can also be loaded without a display */
+        QFile file(filepath);
+        if (!file.open(QIODevice::ReadOnly))
         {
-            data = file.readAll();
-            file.close();
-
-            /* Get %THISDIR% with correct case */
-            QFileInfo thisfile(filepath);
-            QString thisdir = thisfile.absolutePath();
-            if (data.contains("%THISDIR%", Qt::CaseInsensitive))
-            {
-                QDirIterator it(thisdir, QStringList() << thisfile.fileName(), QDir::Files);
-                while (it.hasNext())
-                {
-                    QString xmlfile = it.next();
-                    if (thisfile.absoluteFilePath().toLower() == xmlfile.toLower())
-                        thisdir = QFileInfo(xmlfile).absolutePath();
-                }
-            }
-
-            /* Replace %<PATH>% with absolute path */
-            data.replace("%APPROOT%", settings.getApplicationPath(), Qt::CaseInsensitive);
-            data.replace("%USERROOT%", settings.getAppDataPath(), Qt::CaseInsensitive);
-            data.replace("%THISDIR%", thisdir, Qt::CaseInsensitive);
-            data.replace("%DESKTOP%", QStandardPaths::writableLocation(QStandardPaths::DesktopLocation), Qt::CaseInsensitive);
-            data.replace("%DOCUMENTS%", QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation), Qt::CaseInsensitive);
-            data.replace("%HOME%", QStandardPaths::writableLocation(QStandardPaths::HomeLocation), Qt::CaseInsensitive);
-
-            QString applicationName = settings.getApplicationName();
-
-            /* Load document (must keep it alive for nodes to remain valid) */
-            pugi::xml_document test;
-            pugi::xml_parse_result result = test.load_string(data.toStdString().c_str());
+            error = "Cannot read XML file";
+            details = QFileInfo(filepath).absoluteFilePath();
+            return false;
+        }
 
-            /* Check parsing status */
-            if (!result)
-            {
-                QString txt = "Error description:  " + QString(result.description()) + "\n\n"
-                              "Error offset:  " + QString::number(result.offset) + "\n\n"
-                              "Error at:  ..." + QString(data.toStdString().c_str() + result.offset).trimmed();
-
-                FramelessMessageBox msg(QMessageBox::Critical, settings.getApplicationName(), "XML parsed with errors.", QMessageBox::Ok);
-                msg.setDpiScale(getDpiScale());
-                msg.setDetailedText(txt);
-                msg.exec();
-                return false;
-            }
+        /* Map the file, its bytes are copied once into the parse buffer */
+        QByteArray contents;
+        qsizetype size = file.size();
+        const char *data = reinterpret_cast<const char*>(size > 0 ? file.map(0, size) : Q_NULLPTR);
+        if (data == Q_NULLPTR)
+        {
+            contents = file.readAll();
+            data = contents.constData();
+            size = contents.size();
+        }
 
-            /* Check if application node exists */
-            pugi::xml_node application_node = test.child("application");
-            if (!application_node)
-            {
-                FramelessMessageBox msg(QMessageBox::Critical, settings.getApplicationName(), "No application node found in XML.", QMessageBox::Ok);
-                msg.setDpiScale(getDpiScale());
-                msg.exec();
-                return false;
-            }
+        /* Replace %<PATH>% with absolute path while copying */
+        size_t length = 0;
+        char *buffer = expandPlaceholders(data, size, filepath, length);
 
-            pugi::xpath_node_set module_nodes = application_node.select_nodes("./modules/*[self::module or self::expandable-module]");
-            if (module_nodes.size() < 1)
-            {
-                FramelessMessageBox msg(QMessageBox::Critical, settings.getApplicationName(), "No module nodes found in XML.", QMessageBox::Ok);
-                msg.setDpiScale(getDpiScale());
-                msg.exec();
-                return false;
-            }
+        if (buffer == Q_NULLPTR)
+        {
+            error = "Cannot read XML file";
+            details = QFileInfo(filepath).absoluteFilePath();
+            return false;
+        }
 
-            /* Load new xml document */
-            document.load_string(data.toStdString().c_str());
-            application_node = document.child("application");
+        /* Parse once, in place. The current document is only replaced by a valid session. */
+        pugi::xml_document parsed;
+        pugi::xml_parse_result result = parsed.load_buffer_inplace_own(buffer, length, pugi::parse_default, pugi::encoding_utf8);
 
-            /* Set application name */
-            if (!application_node.attribute("name"))
-                application_node.prepend_attribute("name").set_value(applicationName.toStdString().c_str());
-            else
-                application_node.attribute("name").set_value(applicationName.toStdString().c_str());
+        /* Check parsing status */
+        if (!result)
+        {
+            /* The document still owns the buffer, the text behind the error is unchanged */
+            size_t offset = std::min(size_t(result.offset), length);
+            error = "XML parsed with errors.";
+            details = "Error description:  " + QString(result.description()) + "\n\n"
+                      "Error offset:  " + QString::number(result.offset) + "\n\n"
+                      "Error at:  ..." + QString::fromUtf8(buffer + offset, qsizetype(std::min<size_t>(length - offset, 1024))).trimmed();
+            return false;
+        }
 
-            /* Fix compatibility */
-            pugi::xpath_node_set all_nodes = document.select_nodes(".//*");
-            for (size_t i = 0; i < all_nodes.size(); ++i)
-            {
-                pugi::xml_node node = all_nodes[i].node();
-                QString node_type = node.name();
+        /* Check if application node exists */
+        pugi::xml_node application_node = parsed.child("application");
+        if (!application_node)
+        {
+            error = "No application node found in XML.";
+            return false;
+        }
 
-                if (!node_type.isLower())
-                {
-                    node_type = node_type.toLower();
-                    node.set_name(node_type.toStdString().c_str());
-                }
+        pugi::xpath_node_set module_nodes = application_node.select_nodes("./modules/*[self::module or self::expandable-module]");
+        if (module_nodes.size() < 1)
+        {
+            error = "No module nodes found in XML.";
+            return false;
+        }
 
-                if (node_type == "checkable-group-box")
-                {
-                    node.set_name("group-box");
-                    pugi::xml_attribute attr = node.attribute("enabled");
+        /* Set application name */
+        QByteArray applicationName = settings.getApplicationName().toUtf8();
+        if (!application_node.attribute("name"))
+            application_node.prepend_attribute("name").set_value(applicationName.constData());
+        else
+            application_node.attribute("name").set_value(applicationName.constData());
 
-                    if (attr)
-                        node.insert_attribute_before("check-state", attr).set_value(attr.value());
-                    else
-                        node.append_attribute("check-state").set_value(1);
+        /* Fix compatibility */
+        CompatibilityWalker walker;
+        parsed.traverse(walker);
 
-                    node.remove_attribute("enabled");
-                }
-                else if (node_type == "checkable-expandable-box")
-                {
-                    node.set_name("expandable-box");
-                    pugi::xml_attribute attr = node.attribute("enabled");
+        target = std::move(parsed);
+        return true;
+    }
 
-                    if (attr)
-                        node.insert_attribute_before("check-state", attr).set_value(attr.value());
-                    else
-                        node.append_attribute("check-state").set_value(1);
+    bool saveCurrentModule(QString path)
+    {
+        /* Side-car files of tables are saved next to the session */
+        XmlTableModel::relocateColumnarData(currentModule()->node(), path);
 
-                    node.remove_attribute("enabled");
-                }
-                else if (node_type == "horizontal")
-                    node.set_name("horizontal-layout");
-                else if (node_type == "vertical")
-                    node.set_name("vertical-layout");
-                else if (node_type == "table-box")
-                    node.set_name("table");
-            }
-        }
-        else
+        if (!writeXmlFile(currentModule()->toSessionString(path), path))
         {
-            FramelessMessageBox msg(QMessageBox::Critical, settings.getApplicationName(), "Cannot read XML file", QMessageBox::Ok);
-            msg.setInformativeText(QFileInfo(filepath).absoluteFilePath());
+            FramelessMessageBox msg(QMessageBox::Critical, settings.getApplicationName(), "Cannot write XML file", QMessageBox::Ok);
+            msg.setInformativeText(QFileInfo(path).absoluteFilePath());
             msg.setDpiScale(getDpiScale());
             msg.exec();
             return false;
@@ -175,39 +160,66 @@ public:
         return true;
     }
 
-    void saveCurrentModule(QString path)
+    static bool saveModuleFile(QString data, QString path)
+    {
+        return writeXmlFile(collapsePlaceholders(data, path), path);
+    }
+
+    static QString collapsePlaceholders(const QString &data, QString path)
     {
-        QString data = currentModule()->toString();
-
-        /* Replace absolute path with %<PATH>% */
-        data.replace(settings.getApplicationPath(), "%APPROOT%", Qt::CaseInsensitive);
-        data.replace(settings.getAppDataPath(), "%USERROOT%", Qt::CaseInsensitive);
-        data.replace(QFileInfo(path).absolutePath(), "%THISDIR%", Qt::CaseInsensitive);
-        data.replace(QStandardPaths::writableLocation(QStandardPaths::DesktopLocation), "%DESKTOP%", Qt::CaseInsensitive);
-        data.replace(QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation), "%DOCUMENTS%", Qt::CaseInsensitive);
-        data.replace(QStandardPaths::writableLocation(QStandardPaths::HomeLocation), "%HOME%", Qt::CaseInsensitive);      
-
-        QFile file(path);
-        if (file.open(QIODevice::ReadWrite))
+        /* Replace absolute path with %<PATH>% in a single pass, the first path in the list wins */
+        QList<QPair<QString, QString>> paths = {{settings.getApplicationPath(), "%APPROOT%"},
+                                                {settings.getAppDataPath(), "%USERROOT%"},
+                                                {QFileInfo(path).absolutePath(), "%THISDIR%"},
+                                                {QStandardPaths::writableLocation(QStandardPaths::DesktopLocation), "%DESKTOP%"},
+                                                {QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation), "%DOCUMENTS%"},
+                                                {QStandardPaths::writableLocation(QStandardPaths::HomeLocation), "%HOME%"}};
+
+        QString firsts;
+        for (qsizetype n = paths.size() - 1; n >= 0; --n)
         {
-            QTextStream stream(&file);
-#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
-            stream.setCodec("UTF-8");
-#else
-            stream.setEncoding(QStringDecoder::Utf8);
-#endif
-            stream << data;
-            file.resize(file.pos());
-            file.close();
+            if (paths[n].first.isEmpty())
+                paths.removeAt(n);
+            else
+                firsts += paths[n].first.front().toLower();
         }
-        else
+
+        QString result;
+        qsizetype copied = 0;
+        for (qsizetype i = 0; i < data.size(); ++i)
         {
-            FramelessMessageBox msg(QMessageBox::Critical, settings.getApplicationName(), "Cannot write XML file", QMessageBox::Ok);
-            msg.setInformativeText(QFileInfo(path).absoluteFilePath());
-            msg.setDpiScale(getDpiScale());
-            msg.exec();
+            if (!firsts.contains(data[i].toLower()))
+                continue;
+
+            for (const QPair<QString, QString> &p : std::as_const(paths))
+            {
+                if (QStringView(data).mid(i).startsWith(p.first, Qt::CaseInsensitive))
+                {
+                    result += QStringView(data).mid(copied, i - copied);
+                    result += p.second;
+                    i += p.first.size() - 1;
+                    copied = i + 1;
+                    break;
+                }
+            }
         }
 
+        if (copied == 0)
+            return data;
+
+        result += QStringView(data).mid(copied);
+        return result;
+    }
+
+    static bool writeXmlFile(const QString &data, QString path)
+    {
+        /* The previous file is only replaced by a complete one */
+        QSaveFile file(path);
+        if (!file.open(QIODevice::WriteOnly))
+            return false;
+
+        file.write(data.toUtf8());
+        return file.commit();
     }
 
     QString getLanguageCode()
@@ -237,9 +249,14 @@ public:
     }
 
     QMap<QString, pugi::xml_node> getModuleNodes()
+    {
+        return getModuleNodes(document);
+    }
+
+    static QMap<QString, pugi::xml_node> getModuleNodes(const pugi::xml_document &source)
     {
         QMap<QString, pugi::xml_node> modules;
-        pugi::xpath_node_set module_nodes = document.select_nodes("./application/modules/*[self::module or self::expandable-module]");
+        pugi::xpath_node_set module_nodes = source.select_nodes("./application/modules/*[self::module or self::expandable-module]");
         for (size_t i = 0; i < module_nodes.size(); ++i)
             modules.insert(module_nodes[i].node().attribute("name").value(), module_nodes[i].node());
 
@@ -303,13 +320,18 @@ public:
 
     QString getPythonPath()
     {
-        pugi::xml_node application_node = document.child("application");
-        QList<pugi::xml_node> python_nodes = {currentModule()->node().child("python"), application_node.child("python")};
+        return getPythonPath(currentModule()->node());
+    }
+
+    static QString getPythonPath(pugi::xml_node module_node)
+    {
+        pugi::xml_node application_node = module_node.root().child("application");
+        QList<pugi::xml_node> python_nodes = {module_node.child("python"), application_node.child("python")};
         for (pugi::xml_node python_node: python_nodes)
         {
             if (python_node.attribute("file-path"))
             {
-                QFileInfo pyinfo(application_node.child("python").attribute("file-path").value());
+                QFileInfo pyinfo(python_node.attribute("file-path").value());
 
                 if (pyinfo.exists() && pyinfo.isFile() && pyinfo.isExecutable())
                     return pyinfo.absoluteFilePath();
@@ -317,6 +339,129 @@ public:
         }
         return settings.getEmbeddedPythonPath();
     }
+
+private:
+    static char* expandPlaceholders(const char *data, qsizetype size, QString filepath, size_t &length)
+    {
+        struct Placeholder
+        {
+            const char *name;
+            QByteArray value;
+        };
+
+        QList<Placeholder> placeholders = {{"%APPROOT%", settings.getApplicationPath().toUtf8()},
+                                           {"%USERROOT%", settings.getAppDataPath().toUtf8()},
+                                           {"%THISDIR%", QByteArray()},
+                                           {"%DESKTOP%", QStandardPaths::writableLocation(QStandardPaths::DesktopLocation).toUtf8()},
+                                           {"%DOCUMENTS%", QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation).toUtf8()},
+                                           {"%HOME%", QStandardPaths::writableLocation(QStandardPaths::HomeLocation).toUtf8()}};
+
+        /* First pass finds the placeholders and the size of the result */
+        QList<QPair<qsizetype, int>> matches;
+        length = size_t(size);
+        for (const char *c = static_cast<const char*>(std::memchr(data, '%', size)); c != Q_NULLPTR; )
+        {
+            qsizetype pos = c - data;
+            int match = -1;
+            for (int i = 0; i < placeholders.size() && match < 0; ++i)
+            {
+                qsizetype n = qsizetype(std::strlen(placeholders[i].name));
+                if (pos + n <= size && qstrnicmp(c, placeholders[i].name, n) == 0)
+                    match = i;
+            }
+
+            qsizetype next = pos + 1;
+            if (match >= 0)
+            {
+                /* Get %THISDIR% with correct case */
+                if (match == 2 && placeholders[2].value.isEmpty())
+                {
+                    QFileInfo thisfile(filepath);
+                    QString thisdir = thisfile.absolutePath();
+                    QDirIterator it(thisdir, QStringList() << thisfile.fileName(), QDir::Files);
+                    while (it.hasNext())
+                    {
+                        QString xmlfile = it.next();
+                        if (thisfile.absoluteFilePath().toLower() == xmlfile.toLower())
+                            thisdir = QFileInfo(xmlfile).absolutePath();
+                    }
+                    placeholders[2].value = thisdir.toUtf8();
+                }
+
+                qsizetype n = qsizetype(std::strlen(placeholders[match].name));
+                matches.append({pos, match});
+                length = length - size_t(n) + size_t(placeholders[match].value.size());
+                next = pos + n;
+            }
+
+            c = next < size ? static_cast<const char*>(std::memchr(data + next, '%', size - next)) : Q_NULLPTR;
+        }
+
+        /* Second pass copies into a buffer owned by the document */
+        char *buffer = static_cast<char*>(pugi::get_memory_allocation_function()(length > 0 ? length : 1));
+        if (buffer == Q_NULLPTR)
+            return Q_NULLPTR;
+
+        char *out = buffer;
+        qsizetype pos = 0;
+        for (const QPair<qsizetype, int> &match : std::as_const(matches))
+        {
+            std::memcpy(out, data + pos, size_t(match.first - pos));
+            out += match.first - pos;
+
+            const Placeholder &placeholder = placeholders[match.second];
+            std::memcpy(out, placeholder.value.constData(), size_t(placeholder.value.size()));
+            out += placeholder.value.size();
+            pos = match.first + qsizetype(std::strlen(placeholder.name));
+        }
+        std::memcpy(out, data + pos, size_t(size - pos));
+
+        return buffer;
+    }
+
+    /* Rewrites legacy elements in a single pass over the tree */
+    struct CompatibilityWalker : pugi::xml_tree_walker
+    {
+        bool for_each(pugi::xml_node &node) override
+        {
+            if (node.type() != pugi::node_element)
+                return true;
+
+            QByteArray node_type(node.name());
+            QByteArray lower = node_type.toLower();
+            if (lower != node_type)
+            {
+                node_type = lower;
+                node.set_name(node_type.constData());
+            }
+
+            if (node_type == "checkable-group-box")
+                makeCheckable(node, "group-box");
+            else if (node_type == "checkable-expandable-box")
+                makeCheckable(node, "expandable-box");
+            else if (node_type == "horizontal")
+                node.set_name("horizontal-layout");
+            else if (node_type == "vertical")
+                node.set_name("vertical-layout");
+            else if (node_type == "table-box")
+                node.set_name("table");
+
+            return true;
+        }
+
+        static void makeCheckable(pugi::xml_node &node, const char *name)
+        {
+            node.set_name(name);
+            pugi::xml_attribute attr = node.attribute("enabled");
+
+            if (attr)
+                node.insert_attribute_before("check-state", attr).set_value(attr.value());
+            else
+                node.append_attribute("check-state").set_value(1);
+
+            node.remove_attribute("enabled");
+        }
+    };
 };
 
 #endif
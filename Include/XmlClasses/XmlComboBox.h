@@ -25,23 +25,13 @@ public:
 
         /* Ensure items node exists */
         if (!xmlNode.child("items"))
+        {
             xmlNode.prepend_child("items");
+            setModified();
+        }
 
         /* Read items */
-        QStringList texts;
-        pugi::xpath_node_set item_nodes = xmlNode.select_nodes("./items/item");
-        for (size_t i = 0; i < item_nodes.size(); ++i)
-        {
-            pugi::xml_node item_node = item_nodes[i].node();
-
-            QString text = item_node.attribute("value").value();
-            if (!text.trimmed().isEmpty() && !texts.contains(text))
-                texts.append(text);
-            else
-                item_node.parent().remove_child(item_node);
-
-            item_node.remove_attribute("index");
-        }
+        QStringList texts = readItems(xmlNode);
 
         /* Create layout */
         if (getAttributeValue("alignment", QString()) == "vertical")
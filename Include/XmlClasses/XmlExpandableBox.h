@@ -1,6 +1,10 @@
 #ifndef XMLEXPANDABLEBOX_H
 #define XMLEXPANDABLEBOX_H
 
+#include <QAbstractScrollArea>
+#include <QPointer>
+#include <QScrollBar>
+#include <QSet>
 #include <QTimer>
 #include <HdShadowEffect.h>
 #include <HdWidgets.h>
@@ -19,7 +23,27 @@ private:
     int rowheight;
     int labelwidth;
     HdSpinBox *spinBox;
-    QList<HdWidget*> rowWidgets;
+
+    /* Row nodes by their index, rows below rowCount exist in the xml */
+    QMap<int, pugi::xml_node> rowNodes;
+    int rowCount = 0;
+
+    /* Only rows near the viewport of the scroll area have widgets, the
+       rows above and below are replaced by spacers of their last measured
+       or the average height. Widgets of rows that leave the viewport are
+       cleared and kept in a pool for the next rows */
+    QMap<int, HdWidget*> liveRows;
+    QList<HdWidget*> rowPool;
+    QHash<int, int> rowHeights;
+    QSet<int> builtRows;
+    QWidget *topSpacer;
+    QWidget *bottomSpacer;
+    QPointer<QAbstractScrollArea> scrollArea;
+
+    /* Visible rows are updated once per burst of scroll and resize events,
+       at most rowBatchSize widgets are created at a time */
+    QTimer *rowTimer;
+    int rowBatchSize = 32;
 
 public:
     explicit XmlExpandableBox(XmlModule *parent, pugi::xml_node node, int label_width = 0) : HdGroupBox(parent), XmlAbstractObject(node)
@@ -56,11 +80,25 @@ public:
 
         /* Ensure items element exists*/
         if (!xmlNode.child("items"))
+        {
             xmlNode.prepend_child("items");
+            setModified();
+        }
 
         /* Ensure rows element exists*/
         if (!xmlNode.child("rows"))
+        {
             xmlNode.append_child("rows");
+            setModified();
+        }
+
+        readItems();
+        readRows();
+
+        rowTimer = new QTimer(this);
+        rowTimer->setSingleShot(true);
+        rowTimer->setInterval(0);
+        connect(rowTimer, &QTimer::timeout, this, &XmlExpandableBox::updateVisibleRows);
 
         /* Create base layout */
         QBoxLayout *baselayout = new QBoxLayout(QBoxLayout::TopToBottom, this);
@@ -89,6 +127,13 @@ public:
         gridlayout->addLayout(boxlayout,0,0,-1,1);
         connect(this, &XmlExpandableBox::dpiScaleChanged, boxlayout, &HdBoxLayout::updateDpiScale);
 
+        /* Rows without widgets, the row widgets are inserted between them */
+        topSpacer = newRowSpacer();
+        bottomSpacer = newRowSpacer();
+
+        /* Heights change with the scale, rows are measured again */
+        connect(this, &XmlExpandableBox::dpiScaleChanged, this, [this](){ rowHeights.clear(); rowTimer->start(); });
+
         /* Add spacer that stretches if the group box is in a horizontal layout */
         QWidget *spacer = new QWidget(this);
         spacer->setContentsMargins(0,0,0,0);
@@ -175,38 +220,44 @@ public:
     {      
         setAttributeValue("value", value);
 
-        int count = rowWidgets.length();
-
         /* Delete rows */
-        if (count > value)
+        while (value < rowCount)
         {
-            while (value < rowWidgets.length())
+            --rowCount;
+
+            if (liveRows.contains(rowCount))
+                recycleRowWidget(liveRows.take(rowCount));
+
+            rowHeights.remove(rowCount);
+            builtRows.remove(rowCount);
+
+            pugi::xml_node row_node = getRowNode(rowCount);
+            if (isEmptyRow(row_node))
             {
-                HdWidget *last = rowWidgets.takeLast();
-                boxlayout->removeWidget(last);
-                last->layout()->disconnect();
-                last->deleteLater();
-
-                pugi::xml_node row_node = getRowNode(rowWidgets.length());
-                if (isEmptyRow(row_node))
-                    row_node.parent().remove_child(row_node);
+                rowNodes.remove(rowCount);
+                row_node.parent().remove_child(row_node);
             }
         }
-        /* Add rows */
-        else
+
+        /* Add rows, the xml is complete before the widgets are */
+        for (; rowCount < value; ++rowCount)
+            getRowNode(rowCount);
+
+        updateVisibleRows();
+    }
+
+    void completeRows()
+    {
+        /* Widgets complete the nodes of their row, rows that never had
+           widgets are created once and cleared again */
+        for (int i = 0; i < rowCount; ++i)
         {
-            for (int i = count; i < value; ++i)
-            {
-                hide();
-                pugi::xml_node row_node = getRowNode(i);
-                HdWidget *row_widget = newRowWidget();
-                HdBoxLayout *rowlayout = static_cast<HdBoxLayout*>(row_widget->layout());
-
-                for (pugi::xml_node child_node: row_node.children())
-                    if (XmlModule::generateXmlObject(module, Q_NULLPTR, child_node, rowheight, labelwidth, true))
-                        XmlModule::generateXmlObject(module, rowlayout, child_node, rowheight, labelwidth, false);
-                show();
-            }
+            if (builtRows.contains(i))
+                continue;
+
+            HdWidget *row_widget = takeRowWidget();
+            createRowContent(row_widget, i);
+            recycleRowWidget(row_widget);
         }
     }
 
@@ -230,41 +281,269 @@ public:
         Q_UNUSED(row_height);
         XmlExpandableBox *expandableBox = new XmlExpandableBox(parent, node, label_width);
         connect(parent, &XmlModule::dpiScaleChanged, expandableBox, &XmlExpandableBox::updateDpiScale);
+        connect(parent, &XmlModule::normalizing, expandableBox, &XmlExpandableBox::completeRows);
+
+        if (parent->getDpiScale() != 1.0)
+            expandableBox->updateDpiScale(parent->getDpiScale());
+
         return expandableBox;
     }
 
+protected:
+    void showEvent(QShowEvent *event) override
+    {
+        HdGroupBox::showEvent(event);
+
+        /* Nearest scroll area, the tab of the module */
+        for (QWidget *widget = parentWidget(); widget && !scrollArea; widget = widget->parentWidget())
+        {
+            scrollArea = qobject_cast<QAbstractScrollArea*>(widget);
+            if (!scrollArea)
+                continue;
+
+            connect(scrollArea->verticalScrollBar(), &QScrollBar::valueChanged, rowTimer, qOverload<>(&QTimer::start));
+            scrollArea->viewport()->installEventFilter(this);
+        }
+
+        /* Rows are created before the box is painted, and placed again once it has a geometry */
+        updateVisibleRows();
+        rowTimer->start();
+    }
+
+    void moveEvent(QMoveEvent *event) override
+    {
+        HdGroupBox::moveEvent(event);
+        rowTimer->start();
+    }
+
+    void resizeEvent(QResizeEvent *event) override
+    {
+        HdGroupBox::resizeEvent(event);
+        rowTimer->start();
+    }
+
+    bool eventFilter(QObject *watched, QEvent *event) override
+    {
+        if (scrollArea && watched == scrollArea->viewport() && event->type() == QEvent::Resize)
+            rowTimer->start();
+
+        return HdGroupBox::eventFilter(watched, event);
+    }
+
 private:
 
+    void readItems()
+    {
+        /* Rows are copies of the items, unknown elements are only reported once */
+        for (pugi::xml_node child_node = xmlNode.child("items").first_child(); child_node; )
+        {
+            pugi::xml_node next = child_node.next_sibling();
+            XmlModule::generateXmlObject(module, Q_NULLPTR, child_node, rowheight, labelwidth, true);
+            child_node = next;
+        }
+    }
+
+    void readRows()
+    {
+        /* The first row of an index is used, like the xpath ./rows/row[@i='N'] */
+        for (pugi::xml_node row_node: xmlNode.child("rows").children("row"))
+        {
+            bool ok = false;
+            QString attribute = row_node.attribute("i").value();
+            int i = attribute.toInt(&ok);
+
+            if (!ok || i < 0 || rowNodes.contains(i) || QString::number(i) != attribute)
+                continue;
+            rowNodes.insert(i, row_node);
+
+            /* Loaded rows are checked once like the items, not every time their widgets are created */
+            for (pugi::xml_node child_node = row_node.first_child(); child_node; )
+            {
+                pugi::xml_node next = child_node.next_sibling();
+                XmlModule::generateXmlObject(module, Q_NULLPTR, child_node, rowheight, labelwidth, true);
+                child_node = next;
+            }
+        }
+    }
+
     pugi::xml_node getRowNode(int index)
     {
-        QString xpath = "./rows/row[@i='" + QString::number(index) + "']";
-        pugi::xml_node row_node = xmlNode.select_node(xpath.toStdString().c_str()).node();
+        pugi::xml_node row_node = rowNodes.value(index);
 
         if (!row_node)
         {
-            pugi::xpath_node_set row_nodes = xmlNode.select_nodes("./rows/row");
-            for (int n = 0; n < int(row_nodes.size()); ++n)
-            {
-                pugi::xml_node child_node = row_nodes[n].node();
+            setModified();
+
+            /* Insert new row node before the next row */
+            QMap<int, pugi::xml_node>::iterator next = rowNodes.upperBound(index);
+            if (next != rowNodes.end())
+                row_node = next.value().parent().insert_child_before("row", next.value());
+            else
+                row_node = xmlNode.child("rows").append_child("row");
+
+            row_node.append_attribute("i").set_value(index);
+            rowNodes.insert(index, row_node);
+
+            for (pugi::xml_node child_node: xmlNode.child("items").children())
+                row_node.append_copy(child_node);
+        }
+        return row_node;
+    }
+
+    void updateVisibleRows()
+    {
+        if (!isVisible())
+            return;
+
+        /* Rows with widgets are measured, the others use their last or the average height */
+        for (QMap<int, HdWidget*>::const_iterator it = liveRows.constBegin(); it != liveRows.constEnd(); ++it)
+            rowHeights.insert(it.key(), it.value()->sizeHint().height());
+
+        int estimate = rowheight;
+        if (!rowHeights.isEmpty())
+        {
+            qint64 total = 0;
+            for (int height: std::as_const(rowHeights))
+                total += height;
+            estimate = int(total / rowHeights.size());
+        }
+
+        int spacing = boxlayout->spacing();
+        int first = 0;
+        int last = rowCount;
 
-                if (QString(child_node.attribute("i").value()).toInt() > index)
+        /* Rows within half a viewport of the visible area, all rows outside of a scroll area */
+        if (scrollArea)
+        {
+            QWidget *viewport = scrollArea->viewport();
+            int top = mapFromGlobal(viewport->mapToGlobal(QPoint(0, 0))).y() - viewport->height() / 2;
+            int bottom = top + 2 * viewport->height();
+            int y = boxlayout->geometry().top();
+
+            first = rowCount;
+            for (int i = 0; i < rowCount; ++i)
+            {
+                if (y > bottom)
                 {
-                    row_node = xmlNode.child("rows").insert_child_before("row", child_node);
-                    row_node.append_attribute("i").set_value(index);
+                    last = i;
                     break;
                 }
+
+                y += rowHeights.value(i, estimate);
+                if (y >= top && first == rowCount)
+                    first = i;
+                y += spacing;
             }
+            first = std::min(first, last);
+        }
 
-            if (!row_node)
+        for (QMap<int, HdWidget*>::iterator it = liveRows.begin(); it != liveRows.end(); )
+        {
+            if (it.key() >= first && it.key() < last)
+                ++it;
+            else
             {
-                row_node = xmlNode.child("rows").append_child("row");
-                row_node.append_attribute("i").set_value(index);
+                recycleRowWidget(it.value());
+                it = liveRows.erase(it);
             }
+        }
 
-            for (pugi::xml_node child_node: xmlNode.child("items").children())
-                row_node.append_copy(child_node);
+        /* Rows next to the ones with widgets are created first, so they stay contiguous */
+        int upper = liveRows.isEmpty() ? first : liveRows.firstKey();
+        int lower = liveRows.isEmpty() ? first : liveRows.lastKey() + 1;
+        int budget = rowBatchSize;
+
+        if (lower < last || upper > first)
+        {
+            /* Layout and painting are done once per batch */
+            setUpdatesEnabled(false);
+
+            for (; lower < last && budget > 0; ++lower, --budget)
+                createRowWidget(lower);
+            for (; upper > first && budget > 0; --budget)
+                createRowWidget(--upper);
+
+            setUpdatesEnabled(true);
+        }
+
+        if (lower < last || upper > first)
+            rowTimer->start();
+
+        setSpacerHeight(topSpacer, 0, upper, estimate, spacing);
+        setSpacerHeight(bottomSpacer, lower, rowCount, estimate, spacing);
+    }
+
+    void setSpacerHeight(QWidget *spacer, int first, int last, int estimate, int spacing)
+    {
+        if (last <= first)
+        {
+            spacer->hide();
+            return;
+        }
+
+        /* The layout adds the spacing after the spacer */
+        int height = (last - first - 1) * spacing;
+        for (int i = first; i < last; ++i)
+            height += rowHeights.value(i, estimate);
+
+        spacer->setFixedHeight(std::max(0, height));
+        spacer->show();
+    }
+
+    void createRowWidget(int index)
+    {
+        HdWidget *row_widget = takeRowWidget();
+        createRowContent(row_widget, index);
+
+        /* Row widgets are kept in order between the spacers */
+        int position = 1 + int(std::distance(liveRows.begin(), liveRows.lowerBound(index)));
+        boxlayout->insertWidget(position, row_widget);
+        row_widget->show();
+        liveRows.insert(index, row_widget);
+    }
+
+    void createRowContent(HdWidget *row_widget, int index)
+    {
+        HdBoxLayout *rowlayout = static_cast<HdBoxLayout*>(row_widget->layout());
+        /* Children were checked in readItems and readRows, unknown elements get no widget */
+        for (pugi::xml_node child_node: getRowNode(index).children())
+            XmlModule::generateXmlObject(module, rowlayout, child_node, rowheight, labelwidth, false);
+
+        builtRows.insert(index);
+    }
+
+    HdWidget* takeRowWidget()
+    {
+        if (!rowPool.isEmpty())
+            return rowPool.takeLast();
+
+        return newRowWidget();
+    }
+
+    void recycleRowWidget(HdWidget *row_widget)
+    {
+        boxlayout->removeWidget(row_widget);
+        row_widget->hide();
+
+        /* The nodes keep all values of the widgets */
+        QLayout *rowlayout = row_widget->layout();
+        while (QLayoutItem *item = rowlayout->takeAt(0))
+        {
+            if (item->widget())
+            {
+                item->widget()->hide();
+                item->widget()->deleteLater();
+            }
+            delete item;
+        }
+
+        if (rowPool.length() < rowBatchSize)
+            rowPool.append(row_widget);
+        else
+        {
+            rowlayout->disconnect();
+            row_widget->deleteLater();
         }
-        return row_node;
     }
 
     bool isEmptyRow(pugi::xml_node row_node)
@@ -295,18 +574,34 @@ private:
     HdWidget* newRowWidget()
     {
         HdWidget *rowWidget = new HdWidget(this);
+        rowWidget->hide();
         rowWidget->setObjectName("Transparent");
         rowWidget->setStyleSheet("QWidget#Transparent {background-color: transparent;}");
         connect(this, &XmlExpandableBox::dpiScaleChanged, rowWidget, &HdWidget::updateDpiScale);
 
         HdBoxLayout *rowlayout = new HdBoxLayout(QBoxLayout::TopToBottom, rowWidget);
         rowlayout->setDynamicSpacing(8);
-        boxlayout->addWidget(rowWidget);
         connect(this, &XmlExpandableBox::dpiScaleChanged, rowlayout, &HdBoxLayout::updateDpiScale);
-        rowWidgets.append(rowWidget);
+
+        /* Rows created after a scale change start with the current scale */
+        if (getDpiScale() != 1.0)
+        {
+            rowWidget->updateDpiScale(getDpiScale());
+            rowlayout->updateDpiScale(getDpiScale());
+        }
         return rowWidget;
     }
 
+    QWidget* newRowSpacer()
+    {
+        QWidget *spacer = new QWidget(this);
+        spacer->hide();
+        spacer->setContentsMargins(0,0,0,0);
+        spacer->setSizePolicy(QSizePolicy::Preferred, QSizePolicy::Fixed);
+        boxlayout->addWidget(spacer);
+        return spacer;
+    }
+
 };
 
 #endif
@@ -2,6 +2,8 @@
 #define XMLMODULE_H
 
 #include <QDebug>
+#include <QHash>
+#include <QTimer>
 #include <HdLayouts.h>
 #include <HdWidgets.h>
 
@@ -14,16 +16,79 @@ class XmlModule : public HdWidget, public XmlAbstractObject
 {
     Q_OBJECT
 
+public:
+    enum ElementType
+    {
+        ELEMENT_UNKNOWN,
+        ELEMENT_GROUP_BOX,
+        ELEMENT_TABLE,
+        ELEMENT_CHECK_BOX,
+        ELEMENT_COMBO_BOX,
+        ELEMENT_DOUBLE_SPIN_BOX,
+        ELEMENT_EXPANDABLE_BOX,
+        ELEMENT_FILE_SELECTION,
+        ELEMENT_FOLDER_SELECTION,
+        ELEMENT_GRID_LAYOUT,
+        ELEMENT_HORIZONTAL_LAYOUT,
+        ELEMENT_VERTICAL_LAYOUT,
+        ELEMENT_LINE_EDIT,
+        ELEMENT_MULTI_FILE_SELECTION,
+        ELEMENT_SELECTION_BOX,
+        ELEMENT_SPACER,
+        ELEMENT_SPIN_BOX,
+        ELEMENT_TEXT_BOX
+    };
+
 private:
     FramelessTabBar *tabBar;
     HdStackedWidget *stackedWidget;
     int rowheight;
     bool moduleExpandable;
 
+    /* Page of a tab in the stacked widget, the widgets of the tab are
+       created when it is shown and can be dropped again, the node keeps
+       all values */
+    struct TabPage
+    {
+        pugi::xml_node node;
+        QWidget *content = Q_NULLPTR;
+        qint64 lastShown = 0;
+        bool created = false;
+    };
+    QHash<QWidget*, TabPage> tabPages;
+    QTimer *evictionTimer;
+    bool initializing = false;
+    bool promptUnknown = true;
+
+    /* Serialized document split around the module, each part is only
+       rebuilt when the revision it depends on has changed */
+    struct SerializedModule
+    {
+        bool valid = false;
+        quint64 documentRevision = 0;
+        quint64 moduleRevision = 0;
+        int depth = 0;
+        QString path;
+        QString prefix;
+        QString body;
+        QString suffix;
+    };
+    SerializedModule serialized;
+    SerializedModule serializedSession;
+
+signals:
+    /* Emitted before the nodes are serialized, widgets that only create
+       some of their children complete the nodes of the others */
+    void normalizing();
+
 public:
     explicit XmlModule(pugi::xml_node node, QWidget *parent = Q_NULLPTR);
     void initialize();
     QString toString();
+    static QString toString(pugi::xml_node module_node);
+    QString toSessionString(QString path);
+    QList<QPair<QString, QString>> toTabStrings();
+    bool isExpandable();
     QString getName();
     QString getFilePath();
     bool hasDocumentation();
@@ -31,9 +96,14 @@ public:
     int getObjectLabelWidth(pugi::xml_node node);
     int getRowHeight();
     void reset();
+    static ElementType elementType(const char *name);
     static bool generateXmlObject(XmlModule *module, HdBoxLayout *boxlayout, pugi::xml_node node, int rowheight, int labelwidth, bool test);
 
 private:
+    static void collectLabels(pugi::xml_node node, bool local, QList<QString> &labels);
+    void updateSerialized(SerializedModule &cache, QString path);
+    static int serializeShell(pugi::xml_node module_node, QString &prefix, QString &suffix);
+    static QString serializeBody(pugi::xml_node module_node, int depth);
     void moveTab(int from, int to);
     void renameTab(int index, QString name);
     void toggleTab(int index, bool enable);
@@ -42,6 +112,11 @@ private:
     void closeTab(int index);
     void changeCurrentTab(int index);
     void generateTab(int index, pugi::xml_node tab_node);
+    void showTabPage(int index);
+    void createTabContent(QWidget *page);
+    void normalizeTabs();
+    void dropTabContent(QWidget *page);
+    void evictTabs();
 
 };
 
@@ -27,7 +27,10 @@ public:
         setMouseTracking(true);
 
         if (!xmlNode.child("items"))
+        {
             xmlNode.append_child("items");
+            setModified();
+        }
 
         /* Create layout */
         if (getAttributeValue("alignment", QString()) == "vertical")
@@ -46,20 +49,7 @@ public:
         layout->addWidget(label);
 
         /* Read items */
-        QStringList files;
-        pugi::xpath_node_set item_nodes = xmlNode.select_nodes("./items/item");
-        for (size_t i = 0; i < item_nodes.size(); ++i)
-        {
-            pugi::xml_node item_node = item_nodes[i].node();
-
-            QString text = item_node.attribute("value").value();
-            if (!text.trimmed().isEmpty() && !files.contains(text))
-                files.append(text);
-            else
-                item_node.parent().remove_child(item_node);
-
-            item_node.remove_attribute("index");
-        }
+        QStringList files = readItems(xmlNode);
 
         /* Combo box */
         comboBox = new HdComboBox(this);
@@ -185,6 +175,7 @@ public slots:
             item_node.remove_attribute("index");
         }
 
+        setModified();
         fileDialog->setDirectory(directory);
 
         if (files.length() > 0)
@@ -212,6 +203,8 @@ public slots:
                 foreach (QString file, files)
                     xmlNode.child("items").append_child("item").append_attribute("value").set_value(file.toStdString().c_str());
             }
+
+            setModified();
         }
 
         fileDialog->deleteLater();
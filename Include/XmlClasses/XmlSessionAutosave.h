@@ -0,0 +1,88 @@
+#ifndef XMLSESSIONAUTOSAVE_H
+#define XMLSESSIONAUTOSAVE_H
+
+#include <QFile>
+#include <QObject>
+#include <QTimer>
+#include <functional>
+#include <pugixml.hpp>
+
+class QLockFile;
+class QThread;
+
+/* Writes checkpoints and the journal of XmlSessionAutosave on a background
+ * thread. A checkpoint replaces the previous one atomically and starts a
+ * new, empty journal. */
+
+class XmlSessionAutosaveWriter : public QObject
+{
+    Q_OBJECT
+
+private:
+    QFile journal;
+    QString checkpointPath;
+
+public:
+    explicit XmlSessionAutosaveWriter(QObject *parent = Q_NULLPTR);
+
+    void open(QString checkpoint, QString journalpath);
+    void append(QByteArray records);
+    void writeCheckpoint(QString data, quint64 generation);
+    void discard();
+
+};
+
+/* Keeps a crash-safe copy of the current session.
+ *
+ * Attribute edits are appended to a journal, they are collected on the GUI
+ * thread and handed to the writer thread every 250 ms. The whole session is
+ * written as a checkpoint one second after the first edit of the session,
+ * some seconds after later edits, and one second after changes that cannot
+ * be journaled, like new rows or tabs. Journal
+ * records are only replayed up to the first of those changes.
+ *
+ * A session that was not closed cleanly is restored as the last session
+ * when the application starts again. Only the first running instance of
+ * the application keeps an autosave. */
+
+class XmlSessionAutosave : public QObject
+{
+    Q_OBJECT
+
+private:
+    QString checkpointPath;
+    QString journalPath;
+    QLockFile *lock = Q_NULLPTR;
+    QThread *thread = Q_NULLPTR;
+    XmlSessionAutosaveWriter *writer = Q_NULLPTR;
+    std::function<QString(QString)> source;
+    QByteArray pending;
+    QTimer *flushTimer = Q_NULLPTR;
+    QTimer *checkpointTimer = Q_NULLPTR;
+    quint64 generation = 0;
+
+public:
+    explicit XmlSessionAutosave(QString sessionpath, QObject *parent = Q_NULLPTR);
+    ~XmlSessionAutosave() override;
+
+    bool isEnabled();
+    void setSource(std::function<QString(QString)> function);
+    void discard();
+
+    static bool recover(QString checkpoint, QString journalpath, QString sessionpath);
+
+private:
+    void recordChange(pugi::xml_node node, const char *attribute, const char *value);
+    void flush();
+    void checkpoint();
+    void stop();
+
+    static QByteArray nodePath(pugi::xml_node node, pugi::xml_node scope);
+    static pugi::xml_node findNode(pugi::xml_node scope, const QByteArray &path);
+    static QByteArray escape(const char *text);
+    static QByteArray unescape(const QByteArray &text);
+    static quint64 readGeneration(QString checkpoint);
+
+};
+
+#endif
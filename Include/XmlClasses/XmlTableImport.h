@@ -0,0 +1,37 @@
+#ifndef XMLTABLEIMPORT_H
+#define XMLTABLEIMPORT_H
+
+#include <QObject>
+#include <QString>
+#include <functional>
+
+#include <XmlTableModel.h>
+
+
+/* Reads blocks of cells from clipboard text and CSV/TSV files.
+ *
+ * Text is split and its numbers are formatted on a worker thread, the
+ * finished block is handed back on the GUI thread and written to the
+ * model at once. The callback is dropped if its context object was
+ * deleted in the meantime. Short texts are parsed right away. */
+
+class XmlTableImport
+{
+
+public:
+    typedef std::function<void(XmlTableModel::CellBlock)> Callback;
+
+    /* Cells are repeated until the block has at least the given size */
+    static void parseText(QString text, QChar separator, XmlNumericFormat format, int minrows, int mincolumns, QObject *context, Callback done);
+    static void parseFile(QString path, XmlNumericFormat format, QObject *context, Callback done);
+
+    static XmlTableModel::CellBlock parse(QString text, QChar separator, const XmlNumericFormat &format, int minrows = 0, int mincolumns = 0);
+    static QChar detectSeparator(QString text, QString path = QString());
+
+private:
+    static void start(std::function<XmlTableModel::CellBlock()> task, QObject *context, Callback done);
+    static QList<QStringList> split(const QString &text, QChar separator);
+
+};
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef XMLTABLEMODEL_H
+#define XMLTABLEMODEL_H
+
+#include <QAbstractTableModel>
+#include <QHash>
+#include <QLocale>
+#include <QMap>
+
+#include <XmlAbstractObject.h>
+
+
+/* Formats the numbers in cell texts with the locale of a table. Numbers
+ * are read with the separators of the table, the cpp or the european
+ * locale, whichever reads them, and written with 6 significant digits.
+ * The text is only copied if a number changes, so a format can be used
+ * on another thread. */
+
+class XmlNumericFormat
+{
+
+private:
+    QLocale loc;
+    QChar decimal, group;
+    bool plainDigits = false;
+
+public:
+    explicit XmlNumericFormat(QLocale locale = QLocale());
+
+    QLocale getLocale() const;
+    QString format(QString text, bool useCppLocale=false) const;
+
+private:
+    void appendNumber(QString &formatted, double value, bool useCppLocale) const;
+
+};
+
+/* Model of a table element, the cells are read from the rows/row/item
+ * nodes once and kept in an index from (i,j) to the item node, so edits
+ * and lookups do not search the document. Row nodes are indexed in order
+ * of their row, new rows and items are inserted at their sorted position.
+ *
+ * Tables with storage="columnar" keep their cells in the side-car file of
+ * their data-file attribute instead, see XmlTableStorage. Only read-only
+ * items and row headers remain in the xml. Edits go to a private copy of
+ * the file in the application data, which is written before the module
+ * is serialized and copied next to a session when it is saved. */
+
+class XmlTableModel : public QAbstractTableModel, public XmlAbstractObject
+{
+    Q_OBJECT
+
+private:
+    struct Cell
+    {
+        pugi::xml_node node;
+        QString text;
+        QString value;
+        bool readOnly = false;
+    };
+
+    int rows = 0;
+    int columns = 0;
+    int maxRow = -1;
+    int maxColumn = -1;
+
+    QMap<int, pugi::xml_node> rowNodes;
+    QHash<quint64, Cell> cells;
+    QHash<int, QString> columnHeaders;
+
+    bool columnar = false;
+    bool dirty = false;
+    QString dataFile;
+    pugi::xml_node scopeNode;
+
+    XmlNumericFormat numeric;
+
+public:
+    /* Texts of a block of cells in the table locale and their values in the
+       cpp locale, rows may have different lengths */
+    struct CellBlock
+    {
+        QList<QStringList> texts;
+        QList<QStringList> values;
+    };
+
+    explicit XmlTableModel(pugi::xml_node node, QObject *parent = Q_NULLPTR);
+    ~XmlTableModel() override;
+
+    void initialize();
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    void setRowCount(int count);
+    void setColumnCount(int count);
+
+    /* Largest row and column read by initialize, -1 if there are none */
+    int getMaxRow() const;
+    int getMaxColumn() const;
+
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    bool setData(const QModelIndex &index, const QVariant &value, int role = Qt::EditRole) override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    Qt::ItemFlags flags(const QModelIndex &index) const override;
+
+    bool insertRows(int row, int count, const QModelIndex &parent = QModelIndex()) override;
+    bool removeRows(int row, int count, const QModelIndex &parent = QModelIndex()) override;
+    bool insertColumns(int column, int count, const QModelIndex &parent = QModelIndex()) override;
+    bool removeColumns(int column, int count, const QModelIndex &parent = QModelIndex()) override;
+
+    /* Writes a block at once, cells outside of the table or read-only
+       cells are skipped */
+    void setCellBlock(int top, int left, const CellBlock &block);
+
+    void setLocale(QLocale locale);
+    QLocale getLocale() const;
+    XmlNumericFormat getNumericFormat() const;
+
+    QString formatNumeric(QString text, bool useCppLocale=false) const;
+
+    bool isColumnar() const;
+
+    /* Writes the changed side-car files of the tables in a module */
+    static void writeColumnarData(pugi::xml_node scope);
+    /* Copies the side-car files of a module next to a session file */
+    static void relocateColumnarData(pugi::xml_node scope, QString sessionpath);
+    static void removeStaleColumnarData();
+
+private:
+    /* Return whether the node was fixed */
+    bool readColumns();
+    bool readRows();
+    pugi::xml_node createRowNode(int i);
+    pugi::xml_node createItemNode(pugi::xml_node row_node, int i, int j);
+    void removeItemNode(int i, int j);
+    void shiftRows(int first, int delta);
+    void shiftColumns(int first, int delta);
+
+    void readColumnar();
+    void markDirty();
+    bool writeColumnar(QString path);
+    static QString columnarDirectory();
+
+    static quint64 cellKey(int i, int j)
+    {
+        return (quint64(quint32(i)) << 32) | quint32(j);
+    }
+
+    static int cellRow(quint64 key)
+    {
+        return int(quint32(key >> 32));
+    }
+
+    static int cellColumn(quint64 key)
+    {
+        return int(quint32(key));
+    }
+
+};
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef XMLTABLESTORAGE_H
+#define XMLTABLESTORAGE_H
+
+#include <QString>
+#include <functional>
+
+
+/* Columnar side-car file of a table with storage="columnar".
+ *
+ * The table node references the file in its data-file attribute, the
+ * cells in the file are not stored as item nodes. All numbers are little
+ * endian, every block starts at a multiple of 8 bytes, so columns can be
+ * used in place from a memory map (numpy.frombuffer):
+ *
+ *     magic "PTCOL\0", uint16 version, uint32 rows, uint32 columns
+ *     for every column:
+ *         uint8 type, 7 bytes padding, uint64 size of the payload
+ *         validity bitmap of ceil(rows/8) bytes, padded to 8 bytes,
+ *         bit i & 7 of byte i / 8 is set if row i holds a value
+ *         type 1: float64[rows]
+ *         type 2: int64[rows]
+ *         type 3: uint64[rows+1] offsets into the following UTF-8 bytes,
+ *                 padded to 8 bytes
+ *         type 0: empty column, no values and no bitmap
+ *
+ * Values are the texts of the xml in the cpp locale. A column is only
+ * stored as numbers if every value is restored to the same text. */
+
+class XmlTableStorage
+{
+
+public:
+    enum ColumnType
+    {
+        COLUMN_EMPTY = 0,
+        COLUMN_FLOAT64 = 1,
+        COLUMN_INT64 = 2,
+        COLUMN_STRING = 3
+    };
+
+    typedef std::function<QString(int i, int j)> ValueReader;
+    typedef std::function<void(int i, int j, const QString &value)> ValueWriter;
+
+    static bool write(QString path, int rows, int columns, ValueReader value);
+    static bool read(QString path, ValueWriter cell);
+
+    static QString formatFloat(double value);
+
+};
+
+#endif
@@ -1,44 +1,43 @@
 #ifndef XMLTABLEWIDGET_H
 #define XMLTABLEWIDGET_H
 
+#include <QDragEnterEvent>
+#include <QDragMoveEvent>
+#include <QDropEvent>
+#include <QFileInfo>
+#include <QMimeData>
+
 #include <HdWidgets.h>
 #include <XmlComboBoxDelegate.h>
 
 #include <XmlAbstractObject.h>
 #include <XmlModule.h>
+#include <XmlTableImport.h>
+#include <XmlTableModel.h>
 
 #include <Settings.h>
 
 
-class XmlTableWidget : public HdTableWidget, public XmlAbstractObject
+class XmlTableWidget : public HdTableView, public XmlAbstractObject
 {
     Q_OBJECT
 
 private:
-    QLocale loc, eur, cpp;
-    QRegularExpression regexp;
+    XmlTableModel *tableModel;
 
 public:
 
-    explicit XmlTableWidget(QWidget *parent, pugi::xml_node node) : HdTableWidget(parent), XmlAbstractObject(node)
+    explicit XmlTableWidget(QWidget *parent, pugi::xml_node node) : HdTableView(parent), XmlAbstractObject(node)
     {
         setTitle(getAttributeValue("name", QString()));
 
-        regexp.setPattern("\\b([0-9]+[.,]{1}[0-9,.]+[Ee\\+\\-0-9]*)\\b");
-
-        setLocale(loc);
-        eur = QLocale(QLocale::Dutch, QLocale::Netherlands);
-        eur.setNumberOptions(QLocale::OmitGroupSeparator);
-        cpp = QLocale(QLocale::C);
-        cpp.setNumberOptions(QLocale::OmitGroupSeparator);
+        /* Cells are read from the xml node by the model */
+        tableModel = new XmlTableModel(node, this);
+        setModel(tableModel);
 
-        connect(this, &XmlTableWidget::rowInserted, this, &XmlTableWidget::updateInsertedRow);
-        connect(this, &XmlTableWidget::columnInserted, this, &XmlTableWidget::updateInsertedColumn);
-        connect(this, &XmlTableWidget::rowRemoved, this, &XmlTableWidget::updateRemovedRow);
-        connect(this, &XmlTableWidget::columnRemoved, this, &XmlTableWidget::updateRemovedColumn);
-        connect(this, &XmlTableWidget::cellChanged, this, &XmlTableWidget::updateChangedCell);
+        /* Text and CSV/TSV files are dropped on a cell */
+        setDragDropMode(QAbstractItemView::DropOnly);
 
-        /* Read data from xml node */
         initialize();
     }
 
@@ -54,25 +53,23 @@ public:
 
     void setRowCount(int rows)
     {
-        HdTableWidget::setRowCount(rows);
-        setAttributeValue("row-count", rowCount());
+        tableModel->setRowCount(rows);
     }
 
     void setColumnCount(int columns)
     {
-        HdTableWidget::setColumnCount(columns);
-        setAttributeValue("column-count", columnCount());
+        tableModel->setColumnCount(columns);
     }
 
     void setRowsResizable(bool resizable)
     {
-        HdTableWidget::setRowsResizable(resizable);
+        HdTableView::setRowsResizable(resizable);
         setAttributeValue("rows-resizable", isRowsResizable());
     }
 
     void setColumnsResizable(bool resizable)
     {
-        HdTableWidget::setColumnsResizable(resizable);
+        HdTableView::setColumnsResizable(resizable);
         setAttributeValue("columns-resizable", isColumnsResizable());
     }
 
@@ -118,6 +115,7 @@ public:
         for (const QString &item: items)
             if (!item.trimmed().isEmpty())
                 dnode.child("items").append_child("item").append_attribute("value").set_value(item.toStdString().c_str());
+        setModified();
 
         setXmlComboBoxDelegateForRow(dnode);
     }
@@ -161,6 +159,7 @@ public:
         for (const QString &item: items)
             if (!item.trimmed().isEmpty())
                 dnode.child("items").append_child("item").append_attribute("value").set_value(item.toStdString().c_str());
+        setModified();
 
         setXmlComboBoxDelegateForColumn(dnode);
     }
@@ -176,36 +175,49 @@ public:
 
     void setLocale(QLocale locale)
     {
-        loc = locale;
-        loc.setNumberOptions(QLocale::OmitGroupSeparator);
+        tableModel->setLocale(locale);
     }
 
     QLocale getLocale()
     {
-        return loc;
+        return tableModel->getLocale();
     }
 
-    void initialize()
+    void importFile(QString path, int top = 0, int left = 0)
     {
-        /* Temporarily disable all signals */
-        bool blocked = signalsBlocked();
-        blockSignals(true);
+        XmlTableImport::parseFile(path, tableModel->getNumericFormat(), this, [this, top, left](XmlTableModel::CellBlock block){ setCellBlock(top, left, block); });
+    }
+
+    void setCellBlock(int top, int left, const XmlTableModel::CellBlock &block)
+    {
+        int bottom = top + int(block.values.size());
+        int right = left;
+        for (const QStringList &values: block.values)
+            right = std::max(right, left + int(values.size()));
+
+        /* Grow once for the whole block */
+        if (rowsResizable && bottom > rowCount())
+            setRowCount(bottom);
+        if (columnsResizable && right > columnCount())
+            setColumnCount(right);
+
+        tableModel->setCellBlock(top, left, block);
+        updateViewportSizeHint();
+    }
 
+    void initialize()
+    {
         /* Reset */
-        clear();
         setRowCount(getAttributeValue("row-count", 5));
         setColumnCount(getAttributeValue("column-count", 3));
         setRowsResizable(getAttributeValue("rows-resizable", true));
         setColumnsResizable(getAttributeValue("columns-resizable", true));
 
         /* Read delegates */
-        pugi::xpath_node_set delegate_nodes = xmlNode.select_nodes("./delegates/combo-box-delegate");
         bool has_row_delegates = false;
         bool has_column_delegates = false;
-        for (size_t n = 0; n < delegate_nodes.size(); ++n)
+        for (pugi::xml_node delegate_node: xmlNode.child("delegates").children("combo-box-delegate"))
         {
-            pugi::xml_node delegate_node = delegate_nodes[n].node();
-
             if (delegate_node.attribute("column"))
             {
                 has_column_delegates = true;
@@ -224,190 +236,21 @@ public:
         if (has_column_delegates)
             setColumnsResizable(false);
 
-        /* Read column data*/
-        if (!xmlNode.child("columns") && xmlNode.child("delegates"))
-            xmlNode.insert_child_after("columns", xmlNode.child("delegates"));
-        else if (!xmlNode.child("columns"))
-            xmlNode.prepend_child("columns");
-
-        QList<int> columns;
-        bool sort_columns = false;
-        int max_j = 0;
-        pugi::xpath_node_set column_nodes = xmlNode.select_nodes("./columns/column");
-        for (size_t n = 0; n < column_nodes.size(); ++n)
-        {
-            pugi::xml_node column_node = column_nodes[n].node();
-
-            /* Check consistency of column index */
-            bool ok = false;
-            int j = QString(column_node.attribute("j").value()).toInt(&ok);
-
-            if (j < 0 || !ok || columns.contains(j) || !column_node.attribute("j"))
-            {
-                column_node.parent().remove_child(column_node);
-                continue;
-            }
-            columns.append(j);
-
-            if (j < columns.last())
-                sort_columns = true;
-
-            QString header = QString(column_node.attribute("header").value());
-
-            if ((horizontalHeaderItem(j) != Q_NULLPTR) && !header.trimmed().isEmpty())
-                horizontalHeaderItem(j)->setText(header);
-            else if (!header.trimmed().isEmpty())
-                setHorizontalHeaderItem(j, new QTableWidgetItem(header));
-        }
-
-        /* Reorder columns */
-        if (sort_columns && columns.length() > 1)
-        {
-            std::sort(columns.begin(), columns.end());
-            for (int j: columns)
-            {
-                QString xpath = "./columns/column[@j='" + QString::number(j) + "']";
-                pugi::xml_node column_node = xmlNode.select_node(xpath.toStdString().c_str()).node();
-                column_node.parent().append_move(column_node);
-            }
-        }
-
-        /* Read row data*/
-        if (!xmlNode.child("rows"))
-            xmlNode.insert_child_after("rows", xmlNode.child("columns"));
-
-        QList<int> rows;
-        bool sort_rows = false;
-        int max_i = 0;
-        pugi::xpath_node_set row_nodes = xmlNode.select_nodes("./rows/row");
-        for (size_t n = 0; n < row_nodes.size(); ++n)
-        {
-            pugi::xml_node row_node = row_nodes[n].node();
-
-            bool ok = false;
-            int i = QString(row_node.attribute("i").value()).toInt(&ok);
-            max_i = std::max(max_i, i);
-
-            /* Check consistency of row index */
-            if (i < 0 || !ok || rows.contains(i) || !row_node.attribute("i"))
-            {
-                row_node.parent().remove_child(row_node);
-                continue;
-            }
-            rows.append(i);
-
-            if (i < rows.last())
-                sort_rows = true;
-
-            /* Header attribute */
-            if (!row_node.attribute("header"))
-                row_node.insert_attribute_after("header", row_node.attribute("i"));
-
-            QString header = QString(row_node.attribute("header").value());
-
-            if ((verticalHeaderItem(i) != Q_NULLPTR) && !header.trimmed().isEmpty())
-                verticalHeaderItem(i)->setText(header);
-            else if (!header.trimmed().isEmpty())
-                setVerticalHeaderItem(i, new QTableWidgetItem(header));
-
-            /* Items */
-            QList<int> items;
-            bool sort_items = false;
-            pugi::xpath_node_set item_nodes = row_node.select_nodes("./item");
-            for (size_t n = 0; n < item_nodes.size(); ++n)
-            {
-                pugi::xml_node item_node = item_nodes[n].node();
-
-                /* Check consistency of item row index */
-                if (!item_node.attribute("i"))
-                    item_node.prepend_attribute("i").set_value(i);
-                else
-                {
-                    int row = QString(item_node.attribute("i").value()).toInt(&ok);
-                    if (!ok || row != i)
-                    {
-                        item_node.parent().remove_child(item_node);
-                        continue;
-                    }
-                }
-
-                /* Check consistency of item column index */
-                int j = QString(item_node.attribute("j").value()).toInt(&ok);
-                if (!ok || items.contains(j) || !item_node.attribute("j"))
-                {
-                    item_node.parent().remove_child(item_node);
-                    continue;
-                }
-                items.append(j);
-
-                if (j < items.last())
-                    sort_items = true;              
-
-                /* Check value */
-                if (item_node.attribute("value").empty())
-                {
-                    item_node.parent().remove_child(item_node);
-                    continue;
-                }
-
-                setItemText(i,j,formatNumeric(item_node.attribute("value").value()));
-
-                /* Fix compatibility */
-                if (item_node.attribute("is-editable"))
-                {
-                    if (!item_node.attribute("read-only") && !QString(item_node.attribute("is-editable").value()).toLower().replace("true","1").replace("false","0").toInt())
-                        item_node.insert_attribute_after("read-only", item_node.attribute("is-editable")).set_value("1");
-                    item_node.remove_attribute("is-editable");
-                }
-
-                /* Set read-only property */
-                if (item_node.attribute("read-only"))
-                {
-                    if (QString(item_node.attribute("read-only").value()).toLower().replace("true","1").replace("false","0").toInt())
-                        item(i,j)->setFlags(item(i,j)->flags() & (~Qt::ItemIsEditable));
-                    else
-                        item_node.remove_attribute("read-only");
-                }
-            }
-
-            /* Reorder items */
-            if (sort_items && items.length() > 1)
-            {
-                std::sort(items.begin(), items.end());
-                for (int j: items)
-                {
-                    QString xpath = "./item[@j='" + QString::number(j) + "']";
-                    pugi::xml_node item_node = row_node.select_node(xpath.toStdString().c_str()).node();
-                    item_node.parent().append_move(item_node);
-                }
-            }
-        }
-
-        /* Reorder rows */
-        if (sort_rows && rows.length() > 1)
-        {
-            std::sort(rows.begin(), rows.end());
-            for (int i: rows)
-            {
-                QString xpath = "./rows/row[@i='" + QString::number(i) + "']";
-                pugi::xml_node row_node = xmlNode.select_node(xpath.toStdString().c_str()).node();
-                row_node.parent().append_move(row_node);
-            }
-        }
+        /* Read columns, rows and items */
+        tableModel->initialize();
 
         /* Set column count */
-        if (columnsResizable && max_j >= columnCount())
-            setColumnCount(max_j+1);
+        if (columnsResizable && tableModel->getMaxColumn() >= columnCount())
+            setColumnCount(tableModel->getMaxColumn()+1);
 
         /* Set row count */
-        if (rowsResizable && max_i >= rowCount())
-            setRowCount(max_i+1);
+        if (rowsResizable && tableModel->getMaxRow() >= rowCount())
+            setRowCount(tableModel->getMaxRow()+1);
 
          /* Tool tip */
         if (getAttribute("tool-tip"))
             setToolTip(getAttributeValue("tool-tip", QString()).trimmed());
 
-        blockSignals(blocked);
         updateViewport();
     }
 
@@ -426,255 +269,76 @@ public:
         return tableWidget;
     }
 
-private:
+protected:
 
-    void updateChangedCell(int i, int j)
+    void paste() override
     {
-        if (i >= rowCount() || j >= columnCount())
+        if (!selectionModel()->hasSelection())
             return;
 
-        /* Set text format to locale */
-        if (item(i,j) != Q_NULLPTR)
-        {
-            bool blocked = signalsBlocked();
-            blockSignals(true);
-            item(i,j)->setText(formatNumeric(item(i,j)->text()));
-            blockSignals(blocked);
-        }
-
-        /* Update xml */
-        pugi::xml_node rows_node = xmlNode.child("rows");
-        QString rpath = "./rows/row[@i='" + QString::number(i) + "']";
-        pugi::xml_node row_node = xmlNode.select_node(rpath.toStdString().c_str()).node();
-        QString ipath = rpath + "/item[@j='" + QString::number(j) + "']";
-        pugi::xml_node item_node = xmlNode.select_node(ipath.toStdString().c_str()).node();
-        QString value;
+        QItemSelectionRange start = selectionModel()->selection().constFirst();
+        QItemSelectionRange stop = selectionModel()->selection().constLast();
+        int top = start.top();
+        int left = start.left();
 
-        /* Set xml text format to cpp locale */
-        if (item(i,j) != Q_NULLPTR)
-            value = formatNumeric(item(i,j)->text(), true);
-
-        if (value.isEmpty())
-        {
-            /* Delete item node if value is empty */
-            if (item_node)
-                item_node.parent().remove_child(item_node);
-
-            /* Delete row node entire row is empty */
-            if (row_node)
-                if (int(row_node.select_nodes("item").size()) == 0 && QString(row_node.attribute("header").value()).trimmed() == "")
-                    row_node.parent().remove_child(row_node);
-        }
-        else
-        {
-            /* Insert new row node at correct location */
-            if (!row_node)
-            {
-                pugi::xpath_node_set row_nodes = xmlNode.select_nodes("./rows/row");
-                for (size_t n = 0; n < row_nodes.size(); ++n)
-                {
-                    pugi::xml_node child_node = row_nodes[n].node();
-
-                    if (QString(child_node.attribute("i").value()).toInt() > i)
-                    {
-                        row_node = rows_node.insert_child_before("row", child_node);
-                        row_node.append_attribute("i").set_value(i);
-                        row_node.append_attribute("header");
-                        break;
-                    }
-                }
-
-                if (!row_node)
-                {
-                    row_node = rows_node.append_child("row");
-                    row_node.append_attribute("i").set_value(i);
-                    row_node.append_attribute("header");
-                }
-
-                if (item_node)
-                {
-                    qDebug() << "invalid item node!";
-                    item_node.parent().remove_child(item_node);
-                }
-
-                item_node = row_node.append_child("item");
-                item_node.append_attribute("i").set_value(i);
-                item_node.append_attribute("j").set_value(j);
-                item_node.append_attribute("value").set_value(value.toStdString().c_str());
-            }
-
-            /* Insert new item node at correct location */
-            else if (!item_node)
-            {
-                pugi::xpath_node_set item_nodes = row_node.select_nodes("./item");
-                for (size_t n = 0; n < item_nodes.size(); ++n)
-                {
-                    pugi::xml_node child_node = item_nodes[n].node();
-                    if (QString(child_node.attribute("j").value()).toInt() > j)
-                    {
-                        item_node = row_node.insert_child_before("item", child_node);
-                        break;
-                    }
-                }
-
-                if (!item_node)
-                    item_node = row_node.append_child("item");
-
-                item_node.append_attribute("i").set_value(i);
-                item_node.append_attribute("j").set_value(j);
-                item_node.append_attribute("value").set_value(value.toStdString().c_str());
-            }
-
-            /* If item already exists */
-            else
-                item_node.attribute("value").set_value(value.toStdString().c_str());
-        }
+        XmlTableImport::parseText(QApplication::clipboard()->text(), '\t', tableModel->getNumericFormat(), stop.bottom() - top + 1, stop.right() - left + 1,
+                                  this, [this, top, left](XmlTableModel::CellBlock block){ setCellBlock(top, left, block); });
     }
 
-    void updateInsertedRow(int row)
+    /* Only text files are imported, other dropped files are ignored */
+    static QString importableFile(const QMimeData *data)
     {
-        pugi::xpath_node_set row_nodes = xmlNode.select_nodes("./rows/row");
-        for (size_t n = 0; n < row_nodes.size(); ++n)
-        {
-            pugi::xml_node row_node = row_nodes[n].node();
-            int i = QString(row_node.attribute("i").value()).toInt();
+        static const QStringList suffixes = {"csv", "tsv", "tab", "txt"};
 
-            if (i < row)
-                continue;
-
-            row_node.attribute("i").set_value(i+1);
-            pugi::xpath_node_set item_nodes = row_node.select_nodes("./item");
-            for (size_t n = 0; n < item_nodes.size(); ++n)
-                item_nodes[n].node().attribute("i").set_value(i+1);
-        }
-
-        setAttributeValue("row-count", rowCount());
+        for (const QUrl &url: data->urls())
+            if (url.isLocalFile() && suffixes.contains(QFileInfo(url.toLocalFile()).suffix().toLower()))
+                return url.toLocalFile();
+        return QString();
     }
 
-    void updateInsertedColumn(int column)
+    static bool acceptsDrop(const QMimeData *data)
     {
-        pugi::xpath_node_set column_nodes = xmlNode.select_nodes("./columns/column");
-        for (size_t n = 0; n < column_nodes.size(); ++n)
-        {
-            pugi::xml_node column_node = column_nodes[n].node();
-            int j = QString(column_node.attribute("j").value()).toInt();
-
-            if (j < column)
-                continue;
-
-            column_node.attribute("j").set_value(j+1);
-        }
-
-        pugi::xpath_node_set item_nodes = xmlNode.select_nodes("./rows/row/item");
-        for (size_t n = 0; n < item_nodes.size(); ++n)
-        {
-            pugi::xml_node item_node = item_nodes[n].node();
-            int j = QString(item_node.attribute("j").value()).toInt();
-
-            if (j >= column)
-                item_node.attribute("j").set_value(j+1);
-        }
-
-        setAttributeValue("column-count", columnCount());
+        return data->hasUrls() ? !importableFile(data).isEmpty() : data->hasText();
     }
 
-    void updateRemovedRow(int row)
+    void dragEnterEvent(QDragEnterEvent *event) override
     {
-        pugi::xpath_node_set row_nodes = xmlNode.select_nodes("./rows/row");
-        for (size_t n = 0; n < row_nodes.size(); ++n)
-        {
-            pugi::xml_node row_node = row_nodes[n].node();
-            int i = QString(row_node.attribute("i").value()).toInt();
-
-            if (i == row)
-                row_node.parent().remove_child(row_node);
-            else if (i > row)
-            {
-                row_node.attribute("i").set_value(i-1);
-                pugi::xpath_node_set item_nodes = row_node.select_nodes("./item");
-                for (size_t j = 0; j < item_nodes.size(); ++j)
-                    item_nodes[j].node().attribute("i").set_value(i-1);
-            }
-        }
-
-        setAttributeValue("row-count", rowCount());
+        if (acceptsDrop(event->mimeData()))
+            event->acceptProposedAction();
+        else
+            HdTableView::dragEnterEvent(event);
     }
 
-    void updateRemovedColumn(int column)
+    void dragMoveEvent(QDragMoveEvent *event) override
     {
-        pugi::xpath_node_set column_nodes = xmlNode.select_nodes("./columns/column");
-        for (size_t n = 0; n < column_nodes.size(); ++n)
-        {
-            pugi::xml_node column_node = column_nodes[n].node();
-            int j = QString(column_node.attribute("j").value()).toInt();
-
-            if (j == column)
-                column_node.parent().remove_child(column_node);
-            else if (j > column)
-                column_node.attribute("j").set_value(j-1);
-        }
-
-        pugi::xpath_node_set item_nodes = xmlNode.select_nodes("./rows/row/item");
-        for (size_t n = 0; n < item_nodes.size(); ++n)
-        {
-            pugi::xml_node item_node = item_nodes[n].node();
-            int j = QString(item_node.attribute("j").value()).toInt();
-
-            if (j == column)
-                item_node.parent().remove_child(item_node);
-            else if (j > column)
-                item_node.attribute("j").set_value(j-1);
-        }
-
-        setAttributeValue("column-count", columnCount());
+        if (acceptsDrop(event->mimeData()))
+            event->acceptProposedAction();
+        else
+            HdTableView::dragMoveEvent(event);
     }
 
-    QString formatNumeric(QString text, bool useCppLocale=false)
+    void dropEvent(QDropEvent *event) override
     {
-        if (text.trimmed().isEmpty())
-            return text;
-
-        QString formatted = QString(text);
-
-        /* Set locale formatting on double/float */
-        QRegularExpressionMatch match;
-        while ((match = regexp.match(text)).hasMatch())
+        if (!acceptsDrop(event->mimeData()))
         {
-            text.remove(match.captured(0));
-
-            /* Convert to double using locale format */
-            bool ok;
-            double d = loc.toDouble(match.captured(0), &ok);
-
-            /* Try again using default format */
-            if(!ok)
-                d = cpp.toDouble(match.captured(0), &ok);
+            event->ignore();
+            return;
+        }
 
-            /* Try again using european format */
-            if(!ok)
-                d = eur.toDouble(match.captured(0), &ok);
+        QModelIndex index = indexAt(event->position().toPoint());
+        int top = index.isValid() ? index.row() : 0;
+        int left = index.isValid() ? index.column() : 0;
 
-            /* Convert back to string */
-            if (ok)
-            {
-                QString s;
-                if (useCppLocale)
-                {
-                    s = cpp.toString(d);
-                    if (!s.contains(cpp.decimalPoint()) && !s.contains("e", Qt::CaseInsensitive))
-                        s += QString(cpp.decimalPoint()) + "0";
-                }
-                else
-                {
-                    s = loc.toString(d);
-                    if (!s.contains(loc.decimalPoint()) && !s.contains("e", Qt::CaseInsensitive))
-                        s += QString(loc.decimalPoint()) + "0";
-                }
-
-                formatted.replace(match.captured(0), s);
-            }
+        if (event->mimeData()->hasUrls())
+            importFile(importableFile(event->mimeData()), top, left);
+        else if (event->mimeData()->hasText())
+        {
+            QString text = event->mimeData()->text();
+            XmlTableImport::parseText(text, XmlTableImport::detectSeparator(text), tableModel->getNumericFormat(), 0, 0,
+                                      this, [this, top, left](XmlTableModel::CellBlock block){ setCellBlock(top, left, block); });
         }
-        return formatted;
+
+        event->acceptProposedAction();
     }
 };
 
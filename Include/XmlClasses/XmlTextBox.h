@@ -56,7 +56,12 @@ public:
 
     void updateText()
     {
-        xmlNode.text().set(toPlainText().trimmed().toStdString().c_str());
+        std::string text = toPlainText().trimmed().toStdString();
+        if (text == xmlNode.text().get())
+            return;
+
+        xmlNode.text().set(text.c_str());
+        setModified();
     }
 
     static XmlTextBox* createFromXmlNode(XmlModule *parent, pugi::xml_node node)
@@ -0,0 +1,181 @@
+#include <PyBatchRunner.h>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFileInfo>
+#include <QTimer>
+#include <cstdio>
+#include <cstring>
+
+#include <PyProcess.h>
+#include <Settings.h>
+#include <XmlApplication.h>
+#include <XmlModule.h>
+#include <XmlTableModel.h>
+
+PyBatchRunner::PyBatchRunner(QObject *parent) : QObject(parent)
+{
+    standardOutput.open(stdout, QIODevice::WriteOnly | QIODevice::Unbuffered);
+    standardError.open(stderr, QIODevice::WriteOnly | QIODevice::Unbuffered);
+
+    /* Same process as the dock, but every request is answered without widgets */
+    process = new PyProcess();
+    process->setParent(this);
+    process->setHeadless(true);
+
+    connect(process, &PyProcess::readyReadPyProcessOutput, this, &PyBatchRunner::writeOutput);
+    connect(process, &PyProcess::readyReadPyProcessError, this, &PyBatchRunner::writeError);
+    connect(process, &PyProcess::pyProcessMessageSent, this, [this](QMessageBox::Icon, QString text){ writeError(text.trimmed() + "\n"); });
+    connect(process, &PyProcess::pyProcessStatusChanged, this, [this](QString text, int){ if (!text.trimmed().isEmpty()) writeError("[" + text.trimmed() + "]\n"); });
+    connect(process, &PyProcess::readXml, this, &PyBatchRunner::readXml);
+    connect(process, &PyProcess::writeXml, this, &PyBatchRunner::writeXml);
+
+    /* Leave the slots of the process before the interpreter is shut down */
+    connect(process, &PyProcess::pyProcessCancelled, this, [this](){ finish(EXIT_INVALID); }, Qt::QueuedConnection);
+    connect(process, &PyProcess::pyProcessFinished, this, [this]()
+    {
+        switch (process->getLastRunResult())
+        {
+        case PyProcess::RUN_SUCCEEDED:
+            finish(EXIT_SUCCEEDED);
+            break;
+        case PyProcess::RUN_TERMINATED:
+            finish(EXIT_TERMINATED);
+            break;
+        default:
+            finish(EXIT_FAILED);
+        }
+    }, Qt::QueuedConnection);
+}
+
+PyBatchRunner::~PyBatchRunner()
+{
+    process->killPyProcess();
+    process->shutdownInterpreter();
+}
+
+bool PyBatchRunner::load(QString sessionfile, QString modulename)
+{
+    QString error, details;
+    if (!XmlApplication::parseXmlFile(sessionfile, document, error, details))
+    {
+        writeError(error + "\n");
+        if (!details.isEmpty())
+            writeError(details + "\n");
+        return false;
+    }
+
+    /* Without a name the first module is run, like the main window does */
+    QMap<QString, pugi::xml_node> modules = XmlApplication::getModuleNodes(document);
+    if (modulename.isEmpty())
+        modulename = modules.firstKey();
+
+    if (!modules.contains(modulename))
+    {
+        writeError(QString("Module [%1] not found in XML.\n").arg(modulename));
+        writeError("Available modules: " + QStringList(modules.keys()).join(", ") + "\n");
+        return false;
+    }
+
+    moduleName = modulename;
+    return true;
+}
+
+bool PyBatchRunner::start(QString python)
+{
+    pugi::xml_node module = moduleNode();
+    if (!module)
+        return false;
+
+    if (python.isEmpty())
+        python = XmlApplication::getPythonPath(module);
+
+    if (!settings.setPythonPath(python))
+    {
+        writeError(QString("Python executable not found [%1]\n").arg(python));
+        return false;
+    }
+
+    process->startPyProcess(QFileInfo(module.attribute("file-path").value()).absoluteFilePath(), XmlModule::toString(module));
+    return true;
+}
+
+bool PyBatchRunner::isRequested(int argc, char *argv[])
+{
+    /* Checked before the application is created, a display may not exist */
+    for (int i = 1; i < argc; ++i)
+        if (std::strcmp(argv[i], "--run") == 0)
+            return true;
+    return false;
+}
+
+int PyBatchRunner::exec(QStringList arguments)
+{
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Runs a module of a session without a display.");
+    parser.addHelpOption();
+    parser.addOption({"run", "Session XML file to load.", "session"});
+    parser.addOption({"module", "Name of the module to run, the first module if omitted.", "name"});
+    parser.addOption({"python", "Python executable, overrides the interpreter of the session.", "executable"});
+
+    if (!parser.parse(arguments))
+    {
+        std::fprintf(stderr, "%s\n", qPrintable(parser.errorText()));
+        return EXIT_INVALID;
+    }
+
+    if (parser.isSet("help"))
+    {
+        std::fprintf(stdout, "%s", qPrintable(parser.helpText()));
+        return EXIT_SUCCEEDED;
+    }
+
+    PyBatchRunner runner;
+    if (!runner.load(parser.value("run"), parser.value("module")))
+        return EXIT_INVALID;
+
+    if (!runner.start(parser.value("python")))
+        return EXIT_INVALID;
+
+    return QCoreApplication::exec();
+}
+
+pugi::xml_node PyBatchRunner::moduleNode()
+{
+    return XmlApplication::getModuleNodes(document).value(moduleName);
+}
+
+void PyBatchRunner::writeOutput(QString text)
+{
+    standardOutput.write(text.remove('\r').toUtf8());
+}
+
+void PyBatchRunner::writeError(QString text)
+{
+    standardError.write(text.remove('\r').toUtf8());
+}
+
+void PyBatchRunner::readXml(QString fpath)
+{
+    /* Module keeps running with the values of the new session */
+    QString name = moduleName;
+    if (!load(fpath, name))
+        load(fpath, QString());
+}
+
+void PyBatchRunner::writeXml(QString fpath)
+{
+    pugi::xml_node module = moduleNode();
+    if (module)
+        XmlTableModel::relocateColumnarData(module, fpath);
+
+    if (!module || !XmlApplication::saveModuleFile(XmlModule::toString(module), fpath))
+        writeError(QString("Cannot write XML file [%1]\n").arg(QFileInfo(fpath).absoluteFilePath()));
+}
+
+void PyBatchRunner::finish(int exitcode)
+{
+    standardOutput.flush();
+    standardError.flush();
+    QCoreApplication::exit(exitcode);
+}
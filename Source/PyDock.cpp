@@ -1,13 +1,16 @@
 ﻿#include <PyDock.h>
 
 #include <QBoxLayout>
+#include <QDateTime>
 #include <QFileInfo>
-#include <QTextCursor>
-#include <QTextFrame>
+#include <QMenu>
 
 #include <HdShadowEffect.h>
+#include <PyInterpreterCache.h>
 #include <PyProcess.h>
+#include <PyRunScheduler.h>
 #include <PyTools.h>
+#include <RunOutputViewer.h>
 
 
 PyDock::PyDock(PyTools *parent) : FramelessDockWidget(parent)
@@ -45,17 +48,31 @@ PyDock::PyDock(PyTools *parent) : FramelessDockWidget(parent)
     toolBar->addWidget(spacer);
     toolBar->addWidget(dockingButton);
 
-    /* Create QTextEdit for printing messages from process */
-    terminal = new QTextEdit(this);
-    terminal->setReadOnly(true);
-    terminal->setVerticalScrollBarPolicy(Qt::ScrollBarAsNeeded);
-    if (settings.wordWrapIsOn())
-        terminal->setWordWrapMode(QTextOption::WrapAtWordBoundaryOrAnywhere);
-    else
-        terminal->setWordWrapMode(QTextOption::NoWrap);
+    /* Create terminal for printing messages from process */
+    terminal = new PyTerminal(this);
+    terminal->setWordWrap(settings.wordWrapIsOn());
+    terminal->setScrollbackLimit(settings.getScrollbackLimit());
+    terminal->setFontFamilies(settings.getFontType("regular"), settings.getFontType("monospace"));
     terminal->setContentsMargins(0,0,0,0);
     terminal->setMinimumHeight(1);
-    setWidget(terminal);
+
+    /* Create list of queued and recent runs below the terminal */
+    jobList = new HdListWidget(this);
+    jobList->setSelectionMode(QAbstractItemView::ExtendedSelection);
+    jobList->setContextMenuPolicy(Qt::CustomContextMenu);
+    jobList->setMinimumHeight(1);
+    jobList->hide();
+    connect(jobList, &HdListWidget::customContextMenuRequested, this, &PyDock::showJobListMenu);
+    connect(jobList, &HdListWidget::itemDoubleClicked, this, &PyDock::openJobOutput);
+    connect(this, &PyDock::dpiScaleChanged, jobList, &HdListWidget::updateDpiScale);
+
+    QWidget *container = new QWidget(this);
+    QBoxLayout *containerLayout = new QBoxLayout(QBoxLayout::TopToBottom, container);
+    containerLayout->setContentsMargins(0,0,0,0);
+    containerLayout->setSpacing(0);
+    containerLayout->addWidget(terminal, 1);
+    containerLayout->addWidget(jobList);
+    setWidget(container);
     connect(this, &PyDock::dpiScaleChanged, this, &PyDock::updateDpiScaleTerminal);
 
     /* Set tab width */
@@ -81,6 +98,16 @@ PyDock::PyDock(PyTools *parent) : FramelessDockWidget(parent)
              settings.getValue("settings/dock-hratio", 0.2).toDouble());
     resizeToRatio();
 
+    /* Output is flushed to the terminal at most once per frame */
+    flushTimer = new QTimer(this);
+    flushTimer->setSingleShot(true);
+    flushTimer->setInterval(16);
+    connect(flushTimer, &QTimer::timeout, this, &PyDock::flushOutput);
+
+    throughputTimer = new QTimer(this);
+    throughputTimer->setInterval(1000);
+    connect(throughputTimer, &QTimer::timeout, this, &PyDock::updateThroughput);
+
     /* Set-up python process */
     pyProcess = new PyProcess(pyTools);
     connect(pyProcess, &PyProcess::pyProcessStarted, this, &PyDock::refreshRunButton);
@@ -98,11 +125,21 @@ PyDock::PyDock(PyTools *parent) : FramelessDockWidget(parent)
     connect(pyProcess, &PyProcess::increaseIndent, this, &PyDock::increaseIndent);
     connect(pyProcess, &PyProcess::decreaseIndent, this, &PyDock::decreaseIndent);
     connect(pyProcess, &PyProcess::resetIndent, this, &PyDock::resetIndent);
+    connect(pyProcess, &PyProcess::pyProcessStarted, this, [this](){ linesReceived = 0; throughputTimer->start(); });
+    connect(pyProcess, &PyProcess::pyProcessFinished, this, &PyDock::flushOutput);
+    connect(pyProcess, &PyProcess::pyProcessFinished, this, [this]()
+    {
+        throughputTimer->stop();
+        if (throughputLabel != Q_NULLPTR)
+            throughputLabel->hide();
+    });
 
     /* Finalise */
     setDynamicTitleBarHeight(settings.getTabBarHeight(parent));
     setTextColor(QColor(255,255,255));
     connect(&settings, &Settings::pythonPathChanged, this, [this](){ if (!pyProcess->isRunning()) clearTerminal();} );
+    connect(&settings, &Settings::pythonPathChanged, pyProcess, &PyProcess::recycleInterpreter);
+    connect(&interpreterCache, &PyInterpreterCache::interpreterProbed, this, &PyDock::onInterpreterProbed);
     connect(&settings, &Settings::pythonPathChanged, this, [this](){ setFloating(false); resizeToRatio();} );
     connect(&settings, &Settings::aboutToQuit, this, &PyDock::deleteLater);
     connect(this, &PyDock::topLevelChanged, this, &PyDock::onScreenChanged);
@@ -110,18 +147,22 @@ PyDock::PyDock(PyTools *parent) : FramelessDockWidget(parent)
     emit dockingButton->toggled(dockingButton->isChecked());
 
     clearTerminal();
+
+    /* Keep an idle interpreter ready for the next run */
+    pyProcess->setKeepWarm(true);
 }
 
 PyDock::~PyDock()
 {
     pyProcess->killPyProcess();
+    pyProcess->shutdownInterpreter();
     while (pyProcess->waitForFinished());
     pyProcess->deleteLater();
 
     settings.setValue("settings/dock-location", getParentMainWindow()->dockWidgetArea(this));
     settings.setValue("settings/dock-wratio", QString::number(getRatio().first, 'f', 6));
     settings.setValue("settings/dock-hratio", QString::number(getRatio().second, 'f', 6));
-    settings.setValue("settings/word-wrap", (terminal->wordWrapMode() == QTextOption::WrapAtWordBoundaryOrAnywhere));
+    settings.setValue("settings/word-wrap", terminal->wordWrapEnabled());
 }
 
 PyProcess* PyDock::process()
@@ -158,6 +199,12 @@ void PyDock::setStatusBar(HdStatusBar *statusbar)
 {
     connect(pyProcess, &PyProcess::pyProcessStatusChanged, statusbar, &HdStatusBar::showMessage);
     connect(this, &PyDock::terminalCleared, statusbar, &HdStatusBar::clearMessage);
+
+    /* Show terminal throughput while a script is running */
+    throughputLabel = new HdLabel(statusbar);
+    throughputLabel->hide();
+    statusbar->addPermanentWidget(throughputLabel);
+    connect(statusbar, &HdStatusBar::dpiScaleChanged, throughputLabel, &HdLabel::updateDpiScale);
 }
 
 void PyDock::setProgressBar(HdProgressBar *progressbar)
@@ -166,6 +213,15 @@ void PyDock::setProgressBar(HdProgressBar *progressbar)
     connect(pyProcess, &PyProcess::pyProcessFinished, progressbar, [progressbar](){progressbar->setRange(0,1);});
 }
 
+void PyDock::setScheduler(PyRunScheduler *runscheduler)
+{
+    scheduler = runscheduler;
+    connect(scheduler, &PyRunScheduler::jobAdded, this, &PyDock::updateJob);
+    connect(scheduler, &PyRunScheduler::jobChanged, this, &PyDock::updateJob);
+    connect(scheduler, &PyRunScheduler::jobRemoved, this, &PyDock::removeJob);
+    connect(scheduler, &PyRunScheduler::batchFinished, this, &PyDock::printBatchSummary);
+}
+
 void PyDock::setTextColor(QColor color)
 {
     textColor = color;
@@ -174,6 +230,9 @@ void PyDock::setTextColor(QColor color)
 void PyDock::clearTerminal()
 {
     setWindowTitle(pyProcess->getPythonVersion(true));
+    pendingOutput.clear();
+    pendingSize = 0;
+    skippedLines = 0;
     terminal->clear();
     setTextColor(QColor(190,190,190));
     terminalPrint(pyProcess->getPythonVersion(false) + "\r\n\r\n");
@@ -184,44 +243,28 @@ void PyDock::clearTerminal()
     cursive = false;
     monospace = false;
     setBlockFormat();
+    terminalPristine = true;
 
     emit terminalCleared();
 }
 
-void PyDock::setBlockFormat()
+void PyDock::onInterpreterProbed(QString executable)
 {
-    /* Move cursor and anchor to end */
-    QTextCursor textCursor = terminal->textCursor();
-    textCursor.movePosition(QTextCursor::End, QTextCursor::MoveAnchor);
-    textCursor.deletePreviousChar();
+    if (QFileInfo(executable).absoluteFilePath().toLower() != QFileInfo(settings.getPythonPath()).absoluteFilePath().toLower())
+        return;
 
-    QTextBlockFormat blockFormat = QTextBlockFormat(textCursor.block().blockFormat());
-    blockFormat.setTopMargin(0.0);
-    blockFormat.setBottomMargin(0.0);
-    blockFormat.setPageBreakPolicy(QTextFormat::PageBreak_AlwaysBefore);
-    blockFormat.setLeftMargin(indent);
-
-    QTextCharFormat charformat = textCursor.block().charFormat();
-    if (bold)
-        charformat.setFontWeight(QFont::Bold);
-    else
-        charformat.setFontWeight(QFont::Normal);
-
-    QFont font = charformat.font();
-    if (monospace)
-        font.setFamily(settings.getFontType("monospace"));
+    /* Replace the version header if nothing has been printed since */
+    if (terminalPristine && !pyProcess->isRunning())
+        clearTerminal();
     else
-        font.setFamily(settings.getFontType("regular"));
-    charformat.setFont(font);
-    charformat.setFontPointSize(0); // for DPI-scaling
-    charformat.setFontItalic(cursive);
+        setWindowTitle(pyProcess->getPythonVersion(true));
+}
 
-    textCursor.setCharFormat(charformat);
-    textCursor.insertBlock(blockFormat);
-    textCursor.movePosition(QTextCursor::StartOfBlock, QTextCursor::MoveAnchor);
-    textCursor.movePosition(QTextCursor::EndOfBlock, QTextCursor::KeepAnchor);
-    textCursor.insertText("");
-    QCoreApplication::processEvents(QEventLoop::ExcludeUserInputEvents);
+void PyDock::setBlockFormat()
+{
+    /* Format applies to everything printed after this point */
+    flushOutput();
+    terminal->beginLine(bold, cursive, monospace, indent);
 }
 
 
@@ -289,45 +332,37 @@ void PyDock::resetIndent()
 
 void PyDock::terminalPrint(QString text)
 {
-    /* Move cursor and anchor to end */
-    QTextCursor textCursor = terminal->textCursor();
-    textCursor.movePosition(QTextCursor::End, QTextCursor::MoveAnchor);
-
-    terminal->setTextCursor(textCursor);
-
-    terminal->setTextColor(textColor);
-    terminal->insertPlainText(text);
-    terminal->ensureCursorVisible();
+    terminalPristine = false;
+    linesReceived += text.count('\n');
+    queueOutput(text, textColor);
 }
 
 void PyDock::terminalErrorPrint(QString text)
 {
-    resetIndent();
+    terminalPristine = false;
+    linesReceived += text.count('\n');
 
-    /* Move cursor and anchor to end */
-    QTextCursor textCursor = terminal->textCursor();
-    textCursor = terminal->textCursor();
-    textCursor.movePosition(QTextCursor::End, QTextCursor::MoveAnchor);
-    terminal->setTextCursor(textCursor);
+    resetIndent();
 
     /* Set text color based on message type */
+    QColor color = textColor;
     if (text.contains("Exception:", Qt::CaseInsensitive))
     {
         int i = int(text.length() - text.indexOf("Exception:", 0, Qt::CaseInsensitive));
         QString line = "\nException:\n" + text.right(i).remove("Exception:", Qt::CaseInsensitive).trimmed();
-        terminal->setTextColor(QColor(180,0,180));
-        terminal->insertPlainText(line + "\n");
+        color = QColor(180,0,180);
+        queueOutput(line + "\n", color);
     }
     else if (text.contains("Error:", Qt::CaseInsensitive))
     {
         int i = int(text.length() - text.indexOf("Error:", 0, Qt::CaseInsensitive));
         QString line = "\nError:\n" + text.right(i).remove("Error:", Qt::CaseInsensitive).trimmed();
-        terminal->setTextColor(QColor(220,0,0));
-        terminal->insertPlainText(line + "\n");
+        color = QColor(220,0,0);
+        queueOutput(line + "\n", color);
     }
     else if (text.contains("Warning:", Qt::CaseInsensitive))
     {
-        terminal->setTextColor(QColor(220,140,0));
+        color = QColor(220,140,0);
         QString line;
         while (text.contains("Warning:", Qt::CaseInsensitive))
         {
@@ -335,11 +370,11 @@ void PyDock::terminalErrorPrint(QString text)
             line.prepend("\nWarning:\n" + text.right(text.length() - i).remove("Warning:", Qt::CaseInsensitive).trimmed() + "\n");
             text = text.left(i).trimmed();
         }
-        terminal->insertPlainText(line);
+        queueOutput(line, color);
     }
     else if (text.contains("Information:", Qt::CaseInsensitive))
     {
-        terminal->setTextColor(QColor(0,0,220));
+        color = QColor(0,0,220);
         QString line;
         while (text.contains("Information:", Qt::CaseInsensitive))
         {
@@ -347,14 +382,192 @@ void PyDock::terminalErrorPrint(QString text)
             line.prepend("\nInformation:\n" + text.right(text.length() - i).remove("Information:", Qt::CaseInsensitive).trimmed() + "\n");
             text = text.left(i).trimmed();
         }
-        terminal->insertPlainText(line);
+        queueOutput(line, color);
     }
 
     /* Print full error message */
     if (!text.trimmed().isEmpty())
-        terminal->insertPlainText("\n" + text.trimmed() + "\n");
+        queueOutput("\n" + text.trimmed() + "\n", color);
+}
+
+void PyDock::queueOutput(QString text, QColor color)
+{
+    if (text.isEmpty())
+        return;
+
+    /* Merge with the previous chunk if the color did not change */
+    if (!pendingOutput.isEmpty() && pendingOutput.last().color == color)
+        pendingOutput.last().text += text;
+    else
+        pendingOutput.append({text, color});
+    pendingSize += text.size();
+
+    /* Backpressure: drop the oldest output if the terminal cannot keep up */
+    const qsizetype maxPendingSize = 4*1024*1024;
+    while (pendingSize > maxPendingSize && pendingOutput.size() > 1)
+    {
+        TerminalChunk chunk = pendingOutput.takeFirst();
+        pendingSize -= chunk.text.size();
+        skippedLines += chunk.text.count('\n');
+    }
+    if (pendingSize > maxPendingSize)
+    {
+        QString &last = pendingOutput.last().text;
+        qsizetype cut = last.indexOf('\n', last.size() - maxPendingSize);
+        cut = cut < 0 ? last.size() - maxPendingSize : cut + 1;
+        skippedLines += QStringView(last).left(cut).count('\n');
+        last.remove(0, cut);
+        pendingSize = last.size();
+    }
+
+    if (!flushTimer->isActive())
+        flushTimer->start();
+}
+
+void PyDock::flushOutput()
+{
+    flushTimer->stop();
+
+    if (pendingOutput.isEmpty() && skippedLines == 0)
+        return;
+
+    if (skippedLines > 0)
+    {
+        terminal->append(QString("[... %1 lines skipped ...]\n").arg(skippedLines), QColor(190,190,190));
+        skippedLines = 0;
+    }
+
+    /* The terminal coalesces all appends into one repaint */
+    for (const TerminalChunk &chunk : std::as_const(pendingOutput))
+        terminal->append(chunk.text, chunk.color);
+    pendingOutput.clear();
+    pendingSize = 0;
+}
+
+void PyDock::updateThroughput()
+{
+    if (throughputLabel == Q_NULLPTR)
+        return;
+
+    throughputLabel->setText(QString("%1 lines/s").arg(linesReceived));
+    throughputLabel->show();
+    linesReceived = 0;
+}
+
+void PyDock::updateJob(int id)
+{
+    PyRunScheduler::Job job = scheduler->job(id);
+
+    QListWidgetItem *item = Q_NULLPTR;
+    for (int i = 0; i < jobList->count() && item == Q_NULLPTR; ++i)
+        if (jobList->item(i)->data(Qt::UserRole).toInt() == id)
+            item = jobList->item(i);
+
+    if (item == Q_NULLPTR)
+    {
+        item = new QListWidgetItem(jobList);
+        item->setData(Qt::UserRole, id);
+    }
+
+    QString lane = job.terminal ? "" : PyDock::tr(" (silent)");
+    item->setText(QString("#%1  %2%3  -  %4").arg(id).arg(job.name, lane, PyRunScheduler::statusText(job.status)));
+
+    if (job.status == PyRunScheduler::JOB_FAILED)
+        item->setForeground(QColor(220,0,0));
+    else if (job.status == PyRunScheduler::JOB_RUNNING)
+        item->setForeground(QColor(0,160,0));
+    else
+        item->setForeground(QBrush());
+
+    updateJobListVisibility();
+}
+
+void PyDock::removeJob(int id)
+{
+    for (int i = 0; i < jobList->count(); ++i)
+    {
+        if (jobList->item(i)->data(Qt::UserRole).toInt() == id)
+        {
+            delete jobList->takeItem(i);
+            break;
+        }
+    }
+
+    updateJobListVisibility();
+}
+
+void PyDock::updateJobListVisibility()
+{
+    /* A single run in the terminal needs no queue */
+    bool visible = scheduler->queuedCount() > 0 || scheduler->runningCount() > 1;
+    for (int i = 0; i < jobList->count() && !visible; ++i)
+        visible = !scheduler->job(jobList->item(i)->data(Qt::UserRole).toInt()).terminal;
+
+    if (visible && jobList->isHidden())
+    {
+        jobList->setMaximumHeight(5*settings.getLabelHeight(jobList) + 2*jobList->frameWidth());
+        jobList->show();
+    }
+    else if (!visible)
+        jobList->hide();
+}
+
+void PyDock::showJobListMenu(const QPoint &pos)
+{
+    QMenu menu(this);
+
+    QList<int> selected;
+    for (QListWidgetItem *item : jobList->selectedItems())
+        selected.append(item->data(Qt::UserRole).toInt());
+
+    QAction *cancel = menu.addAction(PyDock::tr("Cancel"), this, [this, selected](){ for (int id : selected) scheduler->cancel(id); });
+    cancel->setEnabled(!selected.isEmpty());
+    menu.addAction(PyDock::tr("Cancel queued runs"), scheduler, &PyRunScheduler::cancelQueued);
+    menu.addAction(PyDock::tr("Clear finished runs"), scheduler, &PyRunScheduler::clearHistory);
+
+    menu.exec(jobList->viewport()->mapToGlobal(pos));
+}
+
+void PyDock::openJobOutput(QListWidgetItem *item)
+{
+    int id = item->data(Qt::UserRole).toInt();
+    if (scheduler->job(id).capture)
+        RunOutputViewer::openRunOutput(scheduler, id);
+}
+
+void PyDock::printBatchSummary(int batch)
+{
+    QList<int> ids = scheduler->batchJobIds(batch);
+    if (ids.isEmpty())
+        return;
+
+    /* Table with status and duration of each run */
+    int succeeded = 0;
+    int width = 0;
+    for (int id : std::as_const(ids))
+        width = std::max(width, int(scheduler->job(id).name.length()));
+
+    QString summary;
+    for (int id : std::as_const(ids))
+    {
+        PyRunScheduler::Job job = scheduler->job(id);
+        if (job.status == PyRunScheduler::JOB_FINISHED)
+            ++succeeded;
+
+        QString duration;
+        if (job.startTime > 0 && job.endTime >= job.startTime)
+            duration = QDateTime::fromMSecsSinceEpoch(job.endTime - job.startTime).toUTC().toString("hh:mm:ss");
+
+        summary += QString("%1  %2  %3\n").arg(job.name.leftJustified(width), PyRunScheduler::statusText(job.status).leftJustified(10), duration);
+    }
 
-    terminal->ensureCursorVisible();
+    printMonospace();
+    printBold();
+    terminalPrint(PyDock::tr("Batch finished: %1 of %2 runs succeeded").arg(succeeded).arg(ids.length()) + "\n");
+    printRegular();
+    terminalPrint(summary);
+    printProportional();
+    flushOutput();
 }
 
 void PyDock::onScreenChanged()
@@ -372,6 +585,9 @@ void PyDock::keyPressEvent(QKeyEvent *event)
 {
     if (event->key() == Qt::Key_Backspace)
         clearTerminal();
+    else if (event->key() == Qt::Key_Delete && scheduler != Q_NULLPTR && jobList->hasFocus())
+        for (QListWidgetItem *item : jobList->selectedItems())
+            scheduler->cancel(item->data(Qt::UserRole).toInt());
 
     FramelessDockWidget::keyPressEvent(event);
 }
@@ -0,0 +1,179 @@
+#include <PyInterpreterCache.h>
+
+#include <QDateTime>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QProcess>
+#include <QSaveFile>
+
+#include <Settings.h>
+
+
+PyInterpreterCache::PyInterpreterCache(QObject *parent) : QObject(parent)
+{ }
+
+void PyInterpreterCache::load()
+{
+    interpreters.clear();
+    cacheFilePath = settings.getAppDataPath() + "/interpreters.json";
+
+    /* Read cached interpreter metadata */
+    QFile file(cacheFilePath);
+    if (file.open(QIODevice::ReadOnly))
+    {
+        QJsonObject root = QJsonDocument::fromJson(file.readAll()).object();
+        file.close();
+
+        for (auto it = root.constBegin(); it != root.constEnd(); ++it)
+        {
+            QJsonObject entry = it.value().toObject();
+
+            PyInterpreterInfo info;
+            info.executable = entry.value("executable").toString();
+            info.size = qint64(entry.value("size").toDouble(-1));
+            info.modified = qint64(entry.value("modified").toDouble(-1));
+            info.version = entry.value("version").toString();
+            info.architecture = entry.value("architecture").toString();
+
+            for (const QJsonValue &value: entry.value("sys-path").toArray())
+                info.sysPath.append(value.toString());
+
+            for (const QJsonValue &value: entry.value("site-packages").toArray())
+                info.sitePackages.append(value.toString());
+
+            if (info.isValid())
+                interpreters.insert(it.key(), info);
+        }
+    }
+
+    /* Probe interpreters in the background when the cache is stale */
+    connect(&settings, &Settings::pythonPathChanged, this, &PyInterpreterCache::refresh, Qt::UniqueConnection);
+    refresh(settings.getEmbeddedPythonPath());
+    refresh(settings.getPythonPath());
+}
+
+void PyInterpreterCache::save()
+{
+    if (cacheFilePath.isEmpty())
+        return;
+
+    QJsonObject root;
+    for (auto it = interpreters.constBegin(); it != interpreters.constEnd(); ++it)
+    {
+        const PyInterpreterInfo &info = it.value();
+
+        QJsonObject entry;
+        entry.insert("executable", info.executable);
+        entry.insert("size", double(info.size));
+        entry.insert("modified", double(info.modified));
+        entry.insert("version", info.version);
+        entry.insert("architecture", info.architecture);
+        entry.insert("sys-path", QJsonArray::fromStringList(info.sysPath));
+        entry.insert("site-packages", QJsonArray::fromStringList(info.sitePackages));
+        root.insert(it.key(), entry);
+    }
+
+    QSaveFile file(cacheFilePath);
+    if (file.open(QIODevice::WriteOnly))
+    {
+        file.write(QJsonDocument(root).toJson(QJsonDocument::Indented));
+        file.commit();
+    }
+}
+
+PyInterpreterInfo PyInterpreterCache::getInfo(QString executable)
+{
+    QString key = cacheKey(executable);
+
+    if (interpreters.contains(key) && isCurrent(interpreters[key]))
+        return interpreters[key];
+
+    /* Unknown or modified executable */
+    refresh(executable);
+    return PyInterpreterInfo();
+}
+
+bool PyInterpreterCache::isProbing(QString executable)
+{
+    return probing.contains(cacheKey(executable));
+}
+
+void PyInterpreterCache::refresh(QString executable)
+{
+    QString key = cacheKey(executable);
+
+    if (key.isEmpty() || !QFileInfo::exists(executable) || probing.contains(key))
+        return;
+
+    if (interpreters.contains(key) && isCurrent(interpreters[key]))
+        return;
+
+    probe(executable);
+}
+
+QString PyInterpreterCache::cacheKey(QString executable)
+{
+    if (executable.trimmed().isEmpty())
+        return QString();
+    return QFileInfo(executable).absoluteFilePath().toLower();
+}
+
+bool PyInterpreterCache::isCurrent(const PyInterpreterInfo &info)
+{
+    QFileInfo exefile(info.executable);
+    return exefile.exists() && exefile.size() == info.size && exefile.lastModified().toMSecsSinceEpoch() == info.modified;
+}
+
+void PyInterpreterCache::probe(QString executable)
+{
+    QString key = cacheKey(executable);
+    probing.insert(key);
+
+    QString script = "import json, platform, site, sys\n"
+                     "packages = site.getsitepackages() if hasattr(site, 'getsitepackages') else []\n"
+                     "print(json.dumps({'version': sys.version, 'architecture': platform.architecture()[0], "
+                     "'sys-path': sys.path, 'site-packages': packages}))";
+
+    /* Probe asynchronously so the GUI thread never waits for the interpreter */
+    QProcess *process = new QProcess(this);
+    connect(process, qOverload<int, QProcess::ExitStatus>(&QProcess::finished), this, [this, process, executable, key](){
+        parseProbeOutput(executable, process->readAllStandardOutput());
+        probing.remove(key);
+        process->deleteLater();
+        emit interpreterProbed(executable);
+    });
+    connect(process, &QProcess::errorOccurred, this, [this, process, key](QProcess::ProcessError error){
+        if (error != QProcess::FailedToStart)
+            return;
+        probing.remove(key);
+        process->deleteLater();
+    });
+    process->start(executable, {"-B",  "-E", "-c", script});
+}
+
+void PyInterpreterCache::parseProbeOutput(QString executable, QByteArray output)
+{
+    QJsonObject object = QJsonDocument::fromJson(output.trimmed()).object();
+
+    QFileInfo exefile(executable);
+    PyInterpreterInfo info;
+    info.executable = exefile.absoluteFilePath();
+    info.size = exefile.size();
+    info.modified = exefile.lastModified().toMSecsSinceEpoch();
+    info.version = object.value("version").toString().trimmed();
+    info.architecture = object.value("architecture").toString();
+
+    for (const QJsonValue &value: object.value("sys-path").toArray())
+        info.sysPath.append(value.toString());
+
+    for (const QJsonValue &value: object.value("site-packages").toArray())
+        info.sitePackages.append(value.toString());
+
+    if (!info.isValid())
+        return;
+
+    interpreters.insert(cacheKey(executable), info);
+    save();
+}
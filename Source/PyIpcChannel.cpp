@@ -0,0 +1,179 @@
+#include <PyIpcChannel.h>
+
+#include <QPointer>
+#include <QtEndian>
+
+
+PyIpcChannel::PyIpcChannel(QLocalSocket *client, QObject *parent) : QObject(parent)
+{
+    socket = client;
+    socket->setParent(this);
+
+    /* The socket is owned by the channel from now on */
+    socket->disconnect();
+    connect(socket, &QLocalSocket::readyRead, this, &PyIpcChannel::readFrames);
+    connect(socket, &QLocalSocket::disconnected, this, &PyIpcChannel::channelClosed);
+}
+
+PyIpcChannel::~PyIpcChannel()
+{
+    close();
+}
+
+QByteArray PyIpcChannel::handshake()
+{
+    return QByteArray("PTF1");
+}
+
+bool PyIpcChannel::isFramedHandshake(QByteArray bytes)
+{
+    return bytes.startsWith(handshake());
+}
+
+QString PyIpcChannel::requestType(quint8 opcode)
+{
+    static const QMap<quint8, QString> types =
+    {
+        {OP_PING, "pingrequest"},
+        {OP_SPAM, "spamrequest"},
+        {OP_SIMPLE_QUESTION, "simplequestionrequest"},
+        {OP_USER_INPUT, "userinputrequest"},
+        {OP_GET_OPEN_FILE, "getopenfilerequest"},
+        {OP_GET_SAVE_FILE, "getsavefilerequest"},
+        {OP_STATUS_UPDATE, "statusupdaterequest"},
+        {OP_TASK_KILL, "taskkillrequest"},
+        {OP_DELETE_TASK_KILL, "deletetaskkillrequest"},
+        {OP_XML_READ, "xmlreadrequest"},
+        {OP_XML_WRITE, "xmlwriterequest"},
+        {OP_ENABLE_PRINTS, "enableprintsrequest"},
+        {OP_DISABLE_PRINTS, "disableprintsrequest"},
+        {OP_PRINT_REGULAR, "printregularrequest"},
+        {OP_PRINT_BOLD, "printboldrequest"},
+        {OP_PRINT_CURSIVE, "printcursiverequest"},
+        {OP_PRINT_BOLD_CURSIVE, "printboldcursiverequest"},
+        {OP_PRINT_PROPORTIONAL_FONT, "printproportionalfontrequest"},
+        {OP_PRINT_MONOSPACE_FONT, "printmonospacefontrequest"},
+        {OP_INCREASE_INDENT, "increaseindentrequest"},
+        {OP_DECREASE_INDENT, "decreaseindentrequest"},
+        {OP_RESET_INDENT, "resetindentrequest"},
+        {OP_RESTART_MODULE, "restartmodulerequest"}
+    };
+
+    return types.value(opcode);
+}
+
+void PyIpcChannel::start(QByteArray received)
+{
+    /* Bytes already read off the socket by the server */
+    buffer.prepend(received);
+    socket->write(handshake());
+    readFrames();
+}
+
+void PyIpcChannel::sendReply(quint32 id, QByteArray reply, quint8 status)
+{
+    if (!isOpen())
+        return;
+
+    QByteArray frame(9, Qt::Uninitialized);
+    qToLittleEndian<quint32>(quint32(5 + reply.size()), frame.data());
+    qToLittleEndian<quint32>(id, frame.data() + 4);
+    frame[8] = char(status);
+    frame.append(reply);
+    socket->write(frame);
+}
+
+void PyIpcChannel::close()
+{
+    if (socket == Q_NULLPTR)
+        return;
+
+    socket->disconnect(this);
+    if (socket->state() != QLocalSocket::UnconnectedState)
+        socket->disconnectFromServer();
+}
+
+bool PyIpcChannel::isOpen()
+{
+    return socket != Q_NULLPTR && socket->state() == QLocalSocket::ConnectedState;
+}
+
+void PyIpcChannel::readFrames()
+{
+    buffer.append(socket->readAll());
+
+    /* Frames arriving while a request is handled are parsed by the outer call */
+    if (reading)
+        return;
+
+    /* Strip handshake */
+    if (!handshakeDone)
+    {
+        if (buffer.size() < handshake().size())
+            return;
+
+        buffer.remove(0, handshake().size());
+        handshakeDone = true;
+    }
+
+    /* Parse all complete frames in the buffer */
+    QPointer<PyIpcChannel> guard(this);
+    reading = true;
+    qsizetype offset = 0;
+    while (buffer.size() - offset >= 4)
+    {
+        const char *data = buffer.constData() + offset;
+        quint32 length = qFromLittleEndian<quint32>(data);
+
+        if (length < 5)
+        {
+            /* Malformed frame, drop the connection */
+            buffer.clear();
+            reading = false;
+            close();
+            emit channelClosed();
+            return;
+        }
+
+        if (buffer.size() - offset - 4 < qsizetype(length))
+            break;
+
+        quint32 id = qFromLittleEndian<quint32>(data + 4);
+        quint8 opcode = quint8(data[8]);
+
+        /* Read key/value pairs */
+        QMap<QString, QString> args;
+        qsizetype pos = 9;
+        qsizetype end = 4 + qsizetype(length);
+        while (pos + 2 <= end)
+        {
+            quint16 keysize = qFromLittleEndian<quint16>(data + pos);
+            pos += 2;
+            if (pos + keysize + 4 > end)
+                break;
+
+            QString key = QString::fromUtf8(data + pos, keysize);
+            pos += keysize;
+
+            quint32 valuesize = qFromLittleEndian<quint32>(data + pos);
+            pos += 4;
+            if (pos + qsizetype(valuesize) > end)
+                break;
+
+            args.insert(key, QString::fromUtf8(data + pos, qsizetype(valuesize)));
+            pos += valuesize;
+        }
+
+        offset += end;
+        emit requestReceived(id, requestType(opcode), args);
+
+        /* Channel may have been closed or deleted while handling the request */
+        if (guard.isNull())
+            return;
+        else if (!isOpen())
+            break;
+    }
+
+    reading = false;
+    buffer.remove(0, offset);
+}
@@ -1,17 +1,95 @@
 ﻿#include <PyProcess.h>
 
+#include <QDir>
 #include <QFileInfo>
+#include <QPointer>
 #include <QTextCursor>
+#include <QTimer>
 #include <QUuid>
 
 #include <pugixml.hpp>
 #include <Settings.h>
+#include <PyInterpreterCache.h>
+#include <PyIpcChannel.h>
+#include <PyRunLog.h>
 #include <FramelessInputDialog.h>
 #include <FramelessFileDialog.h>
 #include <FramelessMessageBox.h>
 
 #include <PyTools.h>
 
+/* Marker written by the bootstrap loop to stdout and stderr when a run has finished */
+static const QString runFinishedMarker = QString("\x02pt-run-finished:");
+
+/* Bootstrap loop of a warm interpreter: it waits for a job header on stdin
+ * ("script<TAB>working directory<TAB>server name<TAB>input size[<TAB>input file]"),
+ * opens the input XML file, or reads the input from stdin if no file is given,
+ * and runs the script as __main__. Modules are never unloaded, extension
+ * modules cannot be imported twice in a process. Libraries imported by a
+ * run stay loaded for the next runs, the marker reports whether the run
+ * imported modules from the script folder, they may change before the next run */
+static const char *bootstrapScript =
+        "import gc, io, os, runpy, sys, traceback\n"
+        "marker = '\\x02pt-run-finished:'\n"
+        "for name in os.environ.get('PT_PRELOAD', '').split(';'):\n"
+        "    if name.strip():\n"
+        "        try:\n"
+        "            __import__(name.strip())\n"
+        "        except Exception:\n"
+        "            pass\n"
+        "base_modules = set(sys.modules)\n"
+        "base_path = list(sys.path)\n"
+        "base_environ = dict(os.environ)\n"
+        "channel = sys.stdin.buffer\n"
+        "while True:\n"
+        "    header = channel.readline()\n"
+        "    if not header:\n"
+        "        break\n"
+        "    fields = header.decode('utf-8').rstrip('\\r\\n').split('\\t')\n"
+        "    script, workdir, server, size = fields[:4]\n"
+        "    inputfile = fields[4] if len(fields) > 4 else ''\n"
+        "    payload = b'' if inputfile else channel.read(int(size))\n"
+        "    os.environ.clear()\n"
+        "    os.environ.update(base_environ)\n"
+        "    os.environ['PT_SERVER_NAME'] = server\n"
+        "    os.environ['PT_INPUT_FILE'] = inputfile\n"
+        "    os.environ['PT_INPUT_SIZE'] = size\n"
+        "    os.chdir(workdir)\n"
+        "    sys.path[:] = [os.path.dirname(script)] + base_path\n"
+        "    sys.argv = [script]\n"
+        "    if inputfile:\n"
+        "        sys.stdin = open(inputfile, 'r', encoding='utf-8')\n"
+        "    else:\n"
+        "        sys.stdin = io.TextIOWrapper(io.BytesIO(payload), encoding='utf-8')\n"
+        "    code = 0\n"
+        "    try:\n"
+        "        runpy.run_path(script, run_name='__main__')\n"
+        "    except SystemExit as e:\n"
+        "        if e.code is None or isinstance(e.code, int):\n"
+        "            code = e.code or 0\n"
+        "        else:\n"
+        "            print(e.code, file=sys.stderr)\n"
+        "            code = 1\n"
+        "    except BaseException:\n"
+        "        traceback.print_exc()\n"
+        "        code = 1\n"
+        "    folder = os.path.normcase(os.path.dirname(os.path.abspath(script))) + os.sep\n"
+        "    loaded = 0\n"
+        "    for name, module in list(sys.modules.items()):\n"
+        "        path = getattr(module, '__file__', None)\n"
+        "        if name not in base_modules and path and os.path.normcase(os.path.abspath(path)).startswith(folder):\n"
+        "            loaded = 1\n"
+        "    base_modules.update(sys.modules)\n"
+        "    try:\n"
+        "        sys.stdin.close()\n"
+        "    except Exception:\n"
+        "        pass\n"
+        "    gc.collect()\n"
+        "    sys.stdout, sys.stderr = sys.__stdout__, sys.__stderr__\n"
+        "    for stream in (sys.stdout, sys.stderr):\n"
+        "        stream.write(marker + str(code) + ':' + str(loaded) + '\\n')\n"
+        "        stream.flush()\n";
+
 PyProcess::PyProcess(PyTools *parent) : QProcess(parent)
 {
     pyTools = parent;
@@ -22,6 +100,9 @@ PyProcess::PyProcess(PyTools *parent) : QProcess(parent)
     localServer = new QLocalServer(this);
     localServer->setSocketOptions(QLocalServer::WorldAccessOption);
 
+    /* Log of stdout, stderr and requests of each run */
+    runLog = new PyRunLog(this);
+
     /* Setup process environment */
     processEnvironment = QProcessEnvironment::systemEnvironment();
 
@@ -30,47 +111,47 @@ PyProcess::PyProcess(PyTools *parent) : QProcess(parent)
         if (key.contains("Py", Qt::CaseInsensitive))
             processEnvironment.remove(key);
 
+    /* Other platforms keep the inherited PATH, headless runs spawn their tools from it */
+#ifdef Q_OS_WIN
     processEnvironment.insert("PATH","%SystemRoot%;%SystemRoot%/system32");
-    processEnvironment.insert("PT_PYTHONPATH", QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/packages;");
+#endif
+    processEnvironment.insert("PT_PYTHONPATH", QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/packages" + QDir::listSeparator());
     processEnvironment.insert("PT_SERVER_NAME", "");
+    processEnvironment.insert("PT_SERVER_PROTOCOL", PyIpcChannel::handshake());
     processEnvironment.insert("PYTHONUNBUFFERED", "1");
     processEnvironment.insert("PYTHONDONTWRITEBYTECODE", "1");
     processEnvironment.insert("PYTHONIOENCODING", "UTF-8");
     processEnvironment.insert("PYTHONUTF8", "1");
     processEnvironment.insert("PYTHONNOUSERSITE", "1");
+    processEnvironment.insert("PT_PRELOAD", settings.getInterpreterPreload());
     setProcessEnvironment(processEnvironment);
 
     connect(this, &QProcess::readyReadStandardOutput, this, &PyProcess::readStandardOutput, Qt::UniqueConnection);
     connect(this, &QProcess::readyReadStandardError, this, &PyProcess::readStandardError, Qt::UniqueConnection);
-    connect(this, qOverload<int, QProcess::ExitStatus>(&QProcess::finished), this, &PyProcess::finalizePyProcess, Qt::UniqueConnection);
+    connect(this, qOverload<int, QProcess::ExitStatus>(&QProcess::finished), this, &PyProcess::onInterpreterFinished, Qt::UniqueConnection);
 }
 
 QString PyProcess::getPythonVersion(bool shortstring)
 {
-    if (!QFileInfo::exists(settings.getPythonPath()))
-        return QString("Python executable not found!");
-
-    QProcess version;
-    version.start(settings.getPythonPath(), {"-B",  "-E", "-c", "import sys\nprint('Python', sys.version)"});
-    version.waitForFinished(5000);
-    QString output = version.readAllStandardOutput().trimmed();
-    version.close();
-
-    if (shortstring && output.contains(" (tags"))
-        output = output.split(" (tags").first();
-    return output;
+    return getInterpreterVersion(settings.getPythonPath(), shortstring);
 }
 
 QString PyProcess::getEmbeddedPythonVersion(bool shortstring)
 {
-    if (!QFileInfo::exists(settings.getEmbeddedPythonPath()))
+    return getInterpreterVersion(settings.getEmbeddedPythonPath(), shortstring);
+}
+
+QString PyProcess::getInterpreterVersion(QString executable, bool shortstring)
+{
+    if (!QFileInfo::exists(executable))
         return QString("Python executable not found!");
 
-    QProcess version;
-    version.start(settings.getEmbeddedPythonPath(), {"-B",  "-E", "-c", "import sys\nprint('Python', sys.version)"});
-    version.waitForFinished(5000);
-    QString output = version.readAllStandardOutput().trimmed();
-    version.close();
+    /* Metadata is probed asynchronously and cached across sessions */
+    PyInterpreterInfo info = interpreterCache.getInfo(executable);
+    if (!info.isValid())
+        return QString("Python");
+
+    QString output = "Python " + info.version;
 
     if (shortstring && output.contains(" (tags"))
         output = output.split(" (tags").first();
@@ -84,8 +165,15 @@ void PyProcess::addKillLaterTask(QString imageName, int pid)
 
 void PyProcess::startPyProcess(QString script, QString stdinput)
 {
+    /* Callers wait for a finished or cancelled run */
     if (!QFileInfo::exists(settings.getPythonPath()))
+    {
+        QString message = PyProcess::tr("Python executable not found") + QString(" [%1]").arg(QFileInfo(settings.getPythonPath()).absoluteFilePath());
+        emit readyReadPyProcessError(message + "\r\n");
+        emit pyProcessStatusChanged(PyProcess::tr("Python executable not found"), 30000);
+        emit pyProcessCancelled();
         return;
+    }
 
     if (pyTools != Q_NULLPTR)
         disconnect(this, &PyProcess::pyProcessFinished, pyTools, &PyTools::startModule);
@@ -95,6 +183,13 @@ void PyProcess::startPyProcess(QString script, QString stdinput)
     /* Check if process is available */
     if (isRunning())
     {
+        if (headless)
+        {
+            emit pyProcessMessageSent(QMessageBox::Information, PyProcess::tr("Python is already running"));
+            emit pyProcessCancelled();
+            return;
+        }
+
         FramelessMessageBox *msg = new FramelessMessageBox(QMessageBox::Information, settings.getApplicationName(), PyProcess::tr("Python is already running"), QMessageBox::Ok);
         msg->setAutoDeleteOnClose();
         msg->show();
@@ -106,6 +201,13 @@ void PyProcess::startPyProcess(QString script, QString stdinput)
     QFileInfo pyfile(script);
     if (!pyfile.exists())
     {
+        if (headless)
+        {
+            emit pyProcessMessageSent(QMessageBox::Critical, PyProcess::tr("Python file not found") + QString(" [%1]").arg(pyfile.absoluteFilePath()));
+            emit pyProcessCancelled();
+            return;
+        }
+
         FramelessMessageBox *msg = new FramelessMessageBox(QMessageBox::Critical, settings.getApplicationName(), PyProcess::tr("Python file not found"), QMessageBox::Ok);
         msg->setInformativeText(QString("[%1]").arg(pyfile.absoluteFilePath()));
         msg->setAutoDeleteOnClose();
@@ -117,19 +219,57 @@ void PyProcess::startPyProcess(QString script, QString stdinput)
     timer.restart();
     printsEnabled = true;
     terminatedByUser = false;
+    outputFinished = false;
+    errorFinished = false;
+    runExitCode = 0;
+    runLoadedModules = false;
     taskKillList.clear();
 
+    /* Discard idle interpreter if it cannot be used for this run */
+    bool changed = QFileInfo(program()).absoluteFilePath().toLower() != QFileInfo(settings.getPythonPath()).absoluteFilePath().toLower();
+    if (state() != QProcess::NotRunning && (changed || !warmInterpreter || !settings.warmInterpretersEnabled()))
+    {
+        kill();
+        waitForFinished(1000);
+    }
+
     /* Set-up local server */
     localServer->listen("pt-" + QUuid::createUuid().toString(QUuid::WithoutBraces));
     connect(localServer, &QLocalServer::newConnection, this, &PyProcess::onNewConnection, Qt::UniqueConnection);
-    processEnvironment.insert("PT_SERVER_NAME", localServer->fullServerName());
-    setProcessEnvironment(processEnvironment);
 
-    /* Set working directory to script folder */
-    setWorkingDirectory(QFileInfo(script).absolutePath());
+    runActive = true;
+
+    /* Input is handed over in a file, the GUI thread does not wait until Python has read it */
+    QByteArray input = stdinput.toUtf8();
+    writeInputFile(input);
+
+    if (settings.runLogEnabled())
+        runLog->beginRun(pyfile.absoluteFilePath());
+
+    if (settings.warmInterpretersEnabled())
+    {
+        /* Start interpreter if no warm one is available */
+        if (state() == QProcess::NotRunning)
+            warmUp();
+    }
+    else
+    {
+        warmInterpreter = false;
+        processEnvironment.insert("PT_SERVER_NAME", localServer->fullServerName());
+        processEnvironment.insert("PT_INPUT_FILE", inputFile != Q_NULLPTR ? inputFile->fileName() : QString());
+        processEnvironment.insert("PT_INPUT_SIZE", QString::number(input.size()));
+        setProcessEnvironment(processEnvironment);
+
+        /* The file is the stdin of the script */
+        setStandardInputFile(inputFile != Q_NULLPTR ? inputFile->fileName() : QString());
+
+        /* Set working directory to script folder */
+        setWorkingDirectory(QFileInfo(script).absolutePath());
+
+        /* Start process */
+        QProcess::start(settings.getPythonPath(), QStringList() << pyfile.absoluteFilePath());
+    }
 
-    /* Start process */
-    QProcess::start(settings.getPythonPath(), QStringList() << pyfile.absoluteFilePath());
     emit pyProcessStarted();
     emit pyProcessStatusChanged(PyProcess::tr("Starting Python..."), 2500);
 
@@ -137,24 +277,181 @@ void PyProcess::startPyProcess(QString script, QString stdinput)
     while (state() == QProcess::Starting)
         QCoreApplication::processEvents(QEventLoop::ExcludeUserInputEvents, 100);
 
-    /* Write to standard input channel */
-    write(stdinput.toUtf8().data());
-    waitForBytesWritten();
-    closeWriteChannel();
+    /* Process failed to start */
+    if (state() == QProcess::NotRunning)
+    {
+        runActive = false;
+        localServer->disconnect();
+        localServer->close();
+        lastRunResult = RUN_FAILED;
+        removeInputFile();
+        runLog->endRun(PyProcess::tr("Python failed to start"));
+        emit pyProcessStatusChanged(PyProcess::tr("Python failed to start"), 30000);
+        emit pyProcessFinished();
+        return;
+    }
+
+    if (warmInterpreter)
+    {
+        /* Hand job to warm interpreter, only the header goes through stdin if the input is in a file */
+        QString header = pyfile.absoluteFilePath() + "\t" + pyfile.absolutePath() + "\t" + localServer->fullServerName() + "\t" + QString::number(input.size());
+        if (inputFile != Q_NULLPTR)
+            write((header + "\t" + inputFile->fileName() + "\n").toUtf8());
+        else
+        {
+            write((header + "\n").toUtf8());
+            write(input);
+        }
+        waitForBytesWritten();
+        ++runCount;
+    }
+    else if (inputFile == Q_NULLPTR)
+    {
+        /* Write to standard input channel */
+        write(input);
+        waitForBytesWritten();
+        closeWriteChannel();
+    }
     return;
 }
 
-void PyProcess::finalizePyProcess(int exitcode, QProcess::ExitStatus exitstatus)
+void PyProcess::warmUp()
+{
+    if (state() != QProcess::NotRunning || !settings.warmInterpretersEnabled() || !QFileInfo::exists(settings.getPythonPath()))
+        return;
+
+    warmInterpreter = true;
+    runCount = 0;
+
+    processEnvironment.insert("PT_SERVER_NAME", "");
+    processEnvironment.insert("PT_PRELOAD", settings.getInterpreterPreload());
+    setProcessEnvironment(processEnvironment);
+    setWorkingDirectory(settings.getApplicationPath());
+
+    /* Start idle interpreter running the bootstrap loop, jobs arrive on stdin */
+    setStandardInputFile(QString());
+    QProcess::start(settings.getPythonPath(), {"-c", QString(bootstrapScript)});
+}
+
+void PyProcess::recycleInterpreter()
+{
+    if (isRunning())
+        return;
+
+    /* A killed idle interpreter is restarted in onInterpreterFinished, it is
+       not warm anymore so the next run does not hand its job to it */
+    if (state() != QProcess::NotRunning)
+    {
+        warmInterpreter = false;
+        kill();
+        waitForFinished(1000);
+    }
+    else if (keepWarm)
+        warmUp();
+}
+
+void PyProcess::shutdownInterpreter()
+{
+    keepWarm = false;
+
+    if (state() != QProcess::NotRunning)
+    {
+        kill();
+        waitForFinished(1000);
+    }
+}
+
+void PyProcess::setKeepWarm(bool enable)
+{
+    keepWarm = enable;
+
+    if (keepWarm)
+        warmUp();
+}
+
+bool PyProcess::isWarm()
+{
+    return warmInterpreter && !runActive && state() == QProcess::Running;
+}
+
+int PyProcess::getRunCount()
+{
+    return runCount;
+}
+
+bool PyProcess::hasLoadedModules()
+{
+    return runLoadedModules;
+}
+
+PyProcess::RunResult PyProcess::getLastRunResult()
 {
-    Q_UNUSED(exitcode)
+    return lastRunResult;
+}
 
+void PyProcess::onInterpreterFinished(int exitcode, QProcess::ExitStatus exitstatus)
+{
     /* Close channels */
     close();
+    warmInterpreter = false;
+
+    if (runActive)
+        finalizePyProcess(exitcode, exitstatus);
+
+    /* Replace crashed, killed or recycled interpreter */
+    if (keepWarm)
+        QTimer::singleShot(1000, this, &PyProcess::warmUp);
+}
+
+QString PyProcess::takeRunFinishedMarker(QString text, bool error)
+{
+    qsizetype i = text.indexOf(runFinishedMarker);
+    if (i < 0)
+        return text;
+
+    if (error)
+        errorFinished = true;
+    else
+    {
+        outputFinished = true;
+        QString result = text.mid(i + runFinishedMarker.length()).trimmed();
+        runExitCode = result.section(':', 0, 0).toInt();
+        runLoadedModules = result.section(':', 1, 1) == "1";
+    }
+    return text.left(i);
+}
+
+void PyProcess::checkRunFinished()
+{
+    /* Wait for the marker on both channels so no trailing error output is lost */
+    if (!runActive || !outputFinished || !errorFinished)
+        return;
+
+    finalizePyProcess(runExitCode, QProcess::NormalExit);
+
+    /* Recycle interpreter after a configurable number of runs or if it imported other modules */
+    if (!runActive && (runCount >= settings.getInterpreterRecycleRuns() || runLoadedModules))
+        recycleInterpreter();
+}
+
+void PyProcess::finalizePyProcess(int exitcode, QProcess::ExitStatus exitstatus)
+{
+    runActive = false;
+    removeInputFile();
 
     /* Reset local server */
     localServer->disconnect();
     localServer->close();
 
+    /* Close persistent channels of this run */
+    while (!channels.isEmpty())
+    {
+        PyIpcChannel *channel = channels.takeFirst();
+        channel->disconnect(this);
+        channel->close();
+        channel->deleteLater();
+    }
+
     /* Force close all processes in taskkill list */
     for (int i = 0; i < taskKillList.length(); ++i)
     {
@@ -174,12 +471,25 @@ void PyProcess::finalizePyProcess(int exitcode, QProcess::ExitStatus exitstatus)
     emit resetIndent();
     emit readyReadPyProcessOutput("\r\n*** " + QDateTime::fromMSecsSinceEpoch(timer.elapsed()).toUTC().toString("hh:mm:ss") + " ***\r\n");
 
+    QString status;
     if (terminatedByUser)
-        emit pyProcessStatusChanged(PyProcess::tr("Python terminated by user"), 30000);
+    {
+        lastRunResult = RUN_TERMINATED;
+        status = PyProcess::tr("Python terminated by user");
+    }
     else if (exitstatus == QProcess::CrashExit || errorTermination)
-        emit pyProcessStatusChanged(PyProcess::tr("Python terminated with error"), 30000);
+    {
+        lastRunResult = RUN_FAILED;
+        status = PyProcess::tr("Python terminated with error");
+    }
     else
-        emit pyProcessStatusChanged(PyProcess::tr("Python finished successfully"), 30000);
+    {
+        lastRunResult = RUN_SUCCEEDED;
+        status = PyProcess::tr("Python finished successfully");
+    }
+
+    runLog->endRun(QString("%1 (exit code %2)").arg(status).arg(exitcode));
+    emit pyProcessStatusChanged(status, 30000);
     emit pyProcessFinished();
     return;
 }
@@ -194,11 +504,45 @@ void PyProcess::killPyProcess()
     }
 }
 
+bool PyProcess::writeInputFile(const QByteArray &input)
+{
+    removeInputFile();
+
+    inputFile = new QTemporaryFile(QDir::tempPath() + "/pt-input-XXXXXX.xml", this);
+    if (!inputFile->open() || inputFile->write(input) != input.size())
+    {
+        /* Fall back to the stdin pipe */
+        removeInputFile();
+        return false;
+    }
+
+    /* Keep the file until the run is finalized, but release the handle */
+    inputFile->close();
+    return true;
+}
+
+void PyProcess::removeInputFile()
+{
+    if (inputFile == Q_NULLPTR)
+        return;
+
+    delete inputFile;
+    inputFile = Q_NULLPTR;
+}
+
+void PyProcess::setHeadless(bool enable)
+{
+    headless = enable;
+}
+
+bool PyProcess::isHeadless()
+{
+    return headless;
+}
+
 bool PyProcess::isRunning()
 {
-    if (state() != QProcess::NotRunning)
-        return true;
-    return false;
+    return runActive;
 }
 
 bool PyProcess::processIsRunning(QString name, int pid, int timeout)
@@ -281,18 +625,71 @@ void PyProcess::closeExcelBooks(int pid)
 
 void PyProcess::onNewConnection()
 {
-    QLocalSocket *pipe = localServer->nextPendingConnection();
-    connect(pipe, &QLocalSocket::disconnected, pipe, &QLocalSocket::deleteLater);
+    while (localServer->hasPendingConnections())
+    {
+        QLocalSocket *pipe = localServer->nextPendingConnection();
+        pendingClients.insert(pipe, QByteArray());
 
-    /* Wait for connection and ready read */
-    if (!pipe->waitForConnected(2500))
-        qDebug() << pipe->error() << pipe->errorString();
-    else if (!pipe->waitForReadyRead(2500))
-        qDebug() << "connection timed out";
-    else
-        processClientRequest(pipe);
+        connect(pipe, &QLocalSocket::disconnected, pipe, &QLocalSocket::deleteLater);
+        connect(pipe, &QLocalSocket::destroyed, this, [this, pipe](){ pendingClients.remove(pipe); });
+        connect(pipe, &QLocalSocket::readyRead, this, [this, pipe](){ readClientRequest(pipe); });
+
+        /* Drop clients that do not send a complete request in time */
+        QTimer::singleShot(2500, pipe, [this, pipe]()
+        {
+            if (!pendingClients.contains(pipe))
+                return;
+
+            qDebug() << "connection timed out";
+            pendingClients.remove(pipe);
+            pipe->disconnectFromServer();
+        });
+
+        if (pipe->bytesAvailable() > 0)
+            readClientRequest(pipe);
+    }
+}
+
+void PyProcess::readClientRequest(QLocalSocket *client)
+{
+    if (!pendingClients.contains(client))
+        return;
+
+    QByteArray &bytes = pendingClients[client];
+    bytes.append(client->readAll());
+
+    /* Wait until the handshake can be told apart from an xml request */
+    if (bytes.size() < PyIpcChannel::handshake().size() && PyIpcChannel::handshake().startsWith(bytes))
+        return;
+
+    if (PyIpcChannel::isFramedHandshake(bytes))
+    {
+        /* Keep framed connections open for the rest of the run */
+        QByteArray received = pendingClients.take(client);
+        PyIpcChannel *channel = new PyIpcChannel(client, this);
+        connect(channel, &PyIpcChannel::requestReceived, this, &PyProcess::processChannelRequest);
+        connect(channel, &PyIpcChannel::channelClosed, this, [this, channel](){ channels.removeOne(channel); channel->deleteLater(); });
+        channels.append(channel);
+        channel->start(received);
+        return;
+    }
+
+    /* Legacy clients send a single xml request, wait until it is complete */
+    pugi::xml_document xmlRequest;
+    if (!xmlRequest.load_buffer(bytes.constData(), bytes.size(), pugi::parse_default, pugi::encoding_utf8))
+        return;
+
+    pendingClients.remove(client);
+    disconnect(client, &QLocalSocket::readyRead, this, Q_NULLPTR);
+
+    pugi::xml_node request = xmlRequest.document_element();
+    QString requestType = QString(request.name()).toLower();
+
+    QMap<QString, QString> args;
+    for (pugi::xml_attribute attribute: request.attributes())
+        args.insert(attribute.name(), attribute.value());
 
-    pipe->deleteLater();
+    processClientRequest(client, requestType, args);
 }
 
 void PyProcess::removeMsgBoxHandle(QPair<QMessageBox*,QString> handle)
@@ -300,21 +697,75 @@ void PyProcess::removeMsgBoxHandle(QPair<QMessageBox*,QString> handle)
     handles.removeOne(handle);
 }
 
-void PyProcess::processClientRequest(QLocalSocket *client)
+void PyProcess::processClientRequest(QLocalSocket *client, QString requestType, QMap<QString, QString> args)
 {
-    QByteArray bytes;
-    while(client->bytesAvailable() > 0)
-        bytes.append(client->readAll());
+    /* The reply may arrive long after this call, the client can be gone by then */
+    QPointer<QLocalSocket> pipe(client);
+    bool answered = dispatchRequest(requestType, args, [pipe](const QByteArray &reply)
+    {
+        if (pipe.isNull())
+            return;
 
-    pugi::xml_document xmlRequest;
-    xmlRequest.load_string(QString(bytes).toStdString().c_str());
-    pugi::xml_node request = xmlRequest.document_element();
-    QString requestType = QString(request.name()).toLower();
+        if (pipe->state() == QLocalSocket::ConnectedState)
+            pipe->write(reply);
+
+        /* Pending data is flushed before the connection is closed */
+        pipe->disconnectFromServer();
+    });
+
+    if (!answered && client->state() != QLocalSocket::UnconnectedState)
+        client->disconnectFromServer();
+}
+
+void PyProcess::processChannelRequest(quint32 id, QString requestType, QMap<QString, QString> args)
+{
+    QPointer<PyIpcChannel> channel(static_cast<PyIpcChannel*>(sender()));
+
+    /* Every framed request is answered, so clients may pipeline them */
+    if (requestType.isEmpty())
+    {
+        channel->sendReply(id, QByteArray(), PyIpcChannel::STATUS_UNKNOWN_REQUEST);
+        return;
+    }
+
+    ReplyCallback respond = [channel, id](const QByteArray &reply)
+    {
+        if (!channel.isNull())
+            channel->sendReply(id, reply);
+    };
+
+    if (!dispatchRequest(requestType, args, respond))
+        respond(QByteArray());
+}
+
+bool PyProcess::dispatchRequest(QString requestType, const QMap<QString, QString> &args, ReplyCallback respond)
+{
+    /* Requests are never handled in a nested event loop. Dialogs are opened
+       and their reply is sent once they finish, so other requests are served
+       in the meantime. Returns true if respond is (or will be) called. */
+    if (runLog->isActive())
+    {
+        QStringList event(requestType);
+        for (auto arg = args.constBegin(); arg != args.constEnd(); ++arg)
+            event.append(QString("%1=\"%2\"").arg(arg.key(), arg.value()));
+        runLog->logEvent(event.join(" "));
+    }
 
     if (requestType == "spamrequest")
     {
-        QString spam = request.attribute("spam").value();
-        bool block = QString(request.attribute("block").value()).toLower().replace("true","1").toInt();
+        QString spam = args.value("spam");
+        bool block = QString(args.value("block")).toLower().replace("true","1").toInt();
+
+        if (headless)
+        {
+            emit pyProcessMessageSent(QMessageBox::Information, spam);
+            if (block)
+            {
+                respond("succes");
+                return true;
+            }
+            return false;
+        }
 
         /* Open message box */
         FramelessMessageBox *msg = new FramelessMessageBox(QMessageBox::Information, settings.getApplicationName(), "Info:", QMessageBox::Ok);
@@ -323,20 +774,27 @@ void PyProcess::processClientRequest(QLocalSocket *client)
 
         if (block)
         {
-            msg->exec();
-            client->write("succes");
-        }
-        else
-        {
-            msg->show();
-            msg->raise();
+            connect(msg, &QDialog::finished, this, [respond](){ respond("succes"); }, Qt::SingleShotConnection);
+            msg->open();
+            return true;
         }
+
+        msg->show();
+        msg->raise();
     }
 
     else if (requestType == "simplequestionrequest")
     {
-        QString question = request.attribute("question").value();
-        QString defaultReply = request.attribute("default-reply").value();
+        QString question = args.value("question");
+        QString defaultReply = args.value("default-reply");
+
+        /* Nobody can answer, take the default reply */
+        if (headless)
+        {
+            emit pyProcessMessageSent(QMessageBox::Question, question);
+            respond(defaultReply.toLower() == "yes" ? "yes" : "no");
+            return true;
+        }
 
         /* Open message box */
         FramelessMessageBox *msg = new FramelessMessageBox(QMessageBox::Question, settings.getApplicationName(), "Question:", QMessageBox::Yes | QMessageBox::No);
@@ -348,77 +806,112 @@ void PyProcess::processClientRequest(QLocalSocket *client)
         else
             msg->setDefaultButton(QMessageBox::No);
 
-        int reply = msg->exec();
+        connect(msg, &QDialog::finished, this, [respond](int answer)
+        {
+            if(answer == QMessageBox::Yes)
+                respond("yes");
+            else if (answer == QMessageBox::No)
+                respond("no");
+            else
+                respond("fail");
+        }, Qt::SingleShotConnection);
 
-        if(reply == QMessageBox::Yes)
-            client->write("yes");
-        else if (reply == QMessageBox::No)
-            client->write("no");
-        else
-            client->write("fail");
+        msg->open();
+        return true;
     }
 
     else if (requestType == "userinputrequest")
     {
-        QString text = request.attribute("text").value();
-        bool mask = bool(QString(request.attribute("mask").value()).toInt());
+        QString text = args.value("text");
+        bool mask = bool(args.value("mask").toInt());
+
+        if (headless)
+        {
+            respond(QByteArray());
+            return true;
+        }
 
         /* Open message box */
-        FramelessInputDialog dlg;
-        dlg.setSizeGripEnabled(false);
-        dlg.setDpiScale(settings.getGlobalDpiScale());
-        dlg.setWindowTitle(settings.getApplicationName());
-        dlg.setLabelText(text);
-        dlg.setInputMode(QInputDialog::TextInput);
+        FramelessInputDialog *dlg = new FramelessInputDialog();
+        dlg->setSizeGripEnabled(false);
+        dlg->setDpiScale(settings.getGlobalDpiScale());
+        dlg->setWindowTitle(settings.getApplicationName());
+        dlg->setLabelText(text);
+        dlg->setInputMode(QInputDialog::TextInput);
 
         if (mask)
-            dlg.setTextEchoMode(QLineEdit::Password);
+            dlg->setTextEchoMode(QLineEdit::Password);
 
-        dlg.setSizePolicy(QSizePolicy::Fixed, QSizePolicy::Fixed);
+        dlg->setSizePolicy(QSizePolicy::Fixed, QSizePolicy::Fixed);
+
+        connect(dlg, &QDialog::finished, this, [dlg, respond](int result)
+        {
+            QString input;
+            if (result)
+                input = dlg->textValue();
 
-        QString input;
-        if (dlg.exec())
-            input = dlg.textValue();
+            respond(input.toUtf8());
+            dlg->deleteLater();
+        }, Qt::SingleShotConnection);
 
-        client->write(input.toUtf8());
+        dlg->open();
+        return true;
     }
 
     else if (requestType == "getopenfilerequest")
     {
-        QString windowTitle = request.attribute("window-title").value();
-        QString nameFilter = request.attribute("name-filter").value();
-        QString directory = request.attribute("directory").value();
+        QString windowTitle = args.value("window-title");
+        QString nameFilter = args.value("name-filter");
+        QString directory = args.value("directory");
+
+        if (headless)
+        {
+            respond("fail");
+            return true;
+        }
 
         /* Open file dialog */
-        FramelessFileDialog fdlg;
+        FramelessFileDialog *fdlg = new FramelessFileDialog();
 
-        fdlg.setAcceptMode(QFileDialog::AcceptOpen);
-        fdlg.setFileMode(QFileDialog::ExistingFile);
+        fdlg->setAcceptMode(QFileDialog::AcceptOpen);
+        fdlg->setFileMode(QFileDialog::ExistingFile);
 
         if (!windowTitle.isEmpty())
-            fdlg.setWindowTitle(windowTitle);
+            fdlg->setWindowTitle(windowTitle);
 
         if (!directory.isEmpty() && QDir(directory).exists())
-            fdlg.setDirectory(directory);
+            fdlg->setDirectory(directory);
         else
-            fdlg.setDirectory(QStandardPaths::writableLocation(QStandardPaths::DesktopLocation));
+            fdlg->setDirectory(QStandardPaths::writableLocation(QStandardPaths::DesktopLocation));
 
         if (!nameFilter.isEmpty())
-            fdlg.setNameFilter(nameFilter);
+            fdlg->setNameFilter(nameFilter);
 
-        /* Execute */
-        QString openfile = "fail";
-        if(fdlg.exec())
-            openfile = QFileInfo(fdlg.selectedFiles().constFirst()).absoluteFilePath();
+        connect(fdlg, &QDialog::finished, this, [fdlg, respond](int result)
+        {
+            QString openfile = "fail";
+            if (result && !fdlg->selectedFiles().isEmpty())
+                openfile = QFileInfo(fdlg->selectedFiles().constFirst()).absoluteFilePath();
+
+            respond(openfile.toUtf8());
+            fdlg->deleteLater();
+        }, Qt::SingleShotConnection);
 
-        client->write(openfile.toUtf8());
+        fdlg->open();
+        return true;
     }
 
     else if (requestType == "getsavefilerequest")
     {
-        QString windowTitle = request.attribute("window-title").value();
-        QString nameFilter = request.attribute("name-filter").value();
-        QString directory = request.attribute("directory").value();
+        QString windowTitle = args.value("window-title");
+        QString nameFilter = args.value("name-filter");
+        QString directory = args.value("directory");
+
+        if (headless)
+        {
+            respond("fail");
+            return true;
+        }
 
         QString defaultsuffix;
 
@@ -434,83 +927,90 @@ void PyProcess::processClientRequest(QLocalSocket *client)
         }
 
         /* Open file dialog */
-        FramelessFileDialog fdlg;
-        fdlg.setAcceptMode(QFileDialog::AcceptSave);
-        fdlg.setFileMode(QFileDialog::AnyFile);
+        FramelessFileDialog *fdlg = new FramelessFileDialog();
+        fdlg->setAcceptMode(QFileDialog::AcceptSave);
+        fdlg->setFileMode(QFileDialog::AnyFile);
 
         if (!windowTitle.isEmpty())
-            fdlg.setWindowTitle(windowTitle);
+            fdlg->setWindowTitle(windowTitle);
 
         if (!directory.isEmpty() && QDir(directory).exists())
-            fdlg.setDirectory(directory);
+            fdlg->setDirectory(directory);
         else
-            fdlg.setDirectory(QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation));
+            fdlg->setDirectory(QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation));
 
         if (!nameFilter.isEmpty())
-            fdlg.setNameFilter(nameFilter);
+            fdlg->setNameFilter(nameFilter);
 
         if (!defaultsuffix.isEmpty())
-            fdlg.setDefaultSuffix(defaultsuffix);
+            fdlg->setDefaultSuffix(defaultsuffix);
+
+        connect(fdlg, &QDialog::finished, this, [fdlg, respond](int result)
+        {
+            QString savefile = "fail";
+            if (result && !fdlg->selectedFiles().isEmpty())
+                savefile = QFileInfo(fdlg->selectedFiles().constFirst()).absoluteFilePath();
 
-        /* Execute */
-        QString savefile = "fail";
-        if(fdlg.exec())
-            savefile = QFileInfo(fdlg.selectedFiles().constFirst()).absoluteFilePath();
+            respond(savefile.toUtf8());
+            fdlg->deleteLater();
+        }, Qt::SingleShotConnection);
 
-        client->write(savefile.toUtf8());
+        fdlg->open();
+        return true;
     }
 
     else if (requestType == "statusupdaterequest")
     {
-        QString status = request.attribute("status").value();
-        int timeout = QString(request.attribute("time-out").value()).toInt();
+        QString status = args.value("status");
+        int timeout = args.value("time-out").toInt();
         emit pyProcessStatusChanged(status, timeout);
     }
 
     else if (requestType == "taskkillrequest")
     {
-        QString im = request.attribute("im").value();
-        int pid = QString(request.attribute("pid").value()).toInt();
-        bool atexit = QString(request.attribute("at-exit").value()).toLower().trimmed().replace("true","1").toInt();
+        QString im = args.value("im");
+        int pid = args.value("pid").toInt();
+        bool atexit = QString(args.value("at-exit")).toLower().trimmed().replace("true","1").toInt();
 
         if (atexit)
             taskKillList.append(QPair<QString, int>(im, pid));
         else
         {
             if (terminateProcess(im, pid))
-                client->write("succes");
+                respond("succes");
             else
-                client->write("fail");
+                respond("fail");
+            return true;
         }
     }
 
     else if (requestType == "deletetaskkillrequest")
     {
-        QString im = request.attribute("im").value();
-        int pid = QString(request.attribute("pid").value()).toInt();
+        QString im = args.value("im");
+        int pid = args.value("pid").toInt();
         taskKillList.removeAll(QPair<QString, int>(im, pid));
     }
 
     else if (requestType == "xmlreadrequest")
     {
-        QFileInfo xmlfile(request.attribute("xmlfilepath").value());
+        QFileInfo xmlfile(args.value("xmlfilepath"));
 
         if (xmlfile.exists() && xmlfile.fileName().endsWith(".xml", Qt::CaseInsensitive))
         {
             emit readXml(xmlfile.absoluteFilePath());
-            QCoreApplication::processEvents(QEventLoop::ExcludeUserInputEvents);
-            client->write("succes");
+            respond("succes");
         }
         else
-            client->write("fail");
+            respond("fail");
+        return true;
     }
 
     else if (requestType == "xmlwriterequest")
     {
-        QString xmlfile = request.attribute("xmlfilepath").value();
+        QString xmlfile = args.value("xmlfilepath");
         emit writeXml(QFileInfo(xmlfile).absoluteFilePath());
-        QCoreApplication::processEvents(QEventLoop::ExcludeUserInputEvents);
-        client->write("succes");
+        respond("succes");
+        return true;
     }
 
     else if (requestType == "enableprintsrequest")
@@ -523,95 +1023,83 @@ void PyProcess::processClientRequest(QLocalSocket *client)
         printsEnabled = false;
     }
 
-    else if (requestType == "printregularrequest")
+    else if (requestType.startsWith("print") || requestType.endsWith("indentrequest"))
     {
-        emit printRegular();
-        QCoreApplication::processEvents(QEventLoop::ExcludeUserInputEvents);
-        client->write("succes");
-    }
+        /* Apply format after output that is already buffered */
+        readStandardOutput();
+
+        if (requestType == "printregularrequest")
+            emit printRegular();
+        else if (requestType == "printboldrequest")
+            emit printBold();
+        else if (requestType == "printcursiverequest")
+            emit printCursive();
+        else if (requestType == "printboldcursiverequest")
+            emit printBoldCursive();
+        else if (requestType == "printproportionalfontrequest")
+            emit printProportionalFont();
+        else if (requestType == "printmonospacefontrequest")
+            emit printMonospaceFont();
+        else if (requestType == "increaseindentrequest")
+            emit increaseIndent();
+        else if (requestType == "decreaseindentrequest")
+            emit decreaseIndent();
+        else if (requestType == "resetindentrequest")
+            emit resetIndent();
+        else
+            return false;
 
-    else if (requestType == "printboldrequest")
-    {
-        emit printBold();
-        QCoreApplication::processEvents(QEventLoop::ExcludeUserInputEvents);
-        client->write("succes");
+        respond("succes");
+        return true;
     }
 
-    else if (requestType == "printcursiverequest")
+    else if (requestType == "restartmodulerequest")
     {
+        if (pyTools == Q_NULLPTR)
+        {
+            respond("fail");
+            return true;
+        }
 
-        emit printCursive();
-        QCoreApplication::processEvents(QEventLoop::ExcludeUserInputEvents);
-        client->write("succes");
+        connect(this, &PyProcess::pyProcessFinished, pyTools, &PyTools::startModule, Qt::UniqueConnection);
+        respond("succes");
+        return true;
     }
 
-    else if (requestType == "printboldcursiverequest")
-    {
-        emit printBoldCursive();
-        QCoreApplication::processEvents(QEventLoop::ExcludeUserInputEvents);
-        client->write("succes");
-    }
+    return false;
+}
 
-    else if (requestType == "printproportionalfontrequest")
-    {
-        emit printProportionalFont();
-        QCoreApplication::processEvents(QEventLoop::ExcludeUserInputEvents);
-        client->write("succes");
-    }
+void PyProcess::readStandardOutput()
+{
+    setCurrentReadChannel(QProcess::StandardOutput);
 
-    else if (requestType == "printmonospacefontrequest")
+    /* Discard output of an idle interpreter */
+    if (!runActive)
     {
-        emit printMonospaceFont();
-        QCoreApplication::processEvents(QEventLoop::ExcludeUserInputEvents);
-        client->write("succes");
+        readAll();
+        return;
     }
 
-    else if (requestType == "increaseindentrequest")
+    /* Hand all complete lines to the terminal at once */
+    QString output;
+    while (canReadLine() && !outputFinished)
     {
-        emit increaseIndent();
-        QCoreApplication::processEvents(QEventLoop::ExcludeUserInputEvents);
-        client->write("succes");
-    }
+        QString line = readLine();
 
-    else if (requestType == "decreaseindentrequest")
-    {
-        emit decreaseIndent();
-        QCoreApplication::processEvents(QEventLoop::ExcludeUserInputEvents);
-        client->write("succes");
-    }
+        if (warmInterpreter)
+            line = takeRunFinishedMarker(line, false);
 
-    else if (requestType == "resetindentrequest")
-    {
-        emit resetIndent();
-        QCoreApplication::processEvents(QEventLoop::ExcludeUserInputEvents);
-        client->write("succes");
+        if (printsEnabled)
+            output += line;
     }
 
-    else if (requestType == "restartmodulerequest")
+    if (!output.isEmpty())
     {
-        connect(this, &PyProcess::pyProcessFinished, pyTools, &PyTools::startModule, Qt::UniqueConnection);
-        client->write("succes");
-        client->disconnectFromServer();
-        return;
+        runLog->logOutput(output);
+        emit readyReadPyProcessOutput(output);
     }
 
-    /* Disconnect */
-    if (client->state() != QLocalSocket::UnconnectedState && client->isOpen())
-        if (!client->waitForDisconnected(2500))
-            client->disconnectFromServer();
-}
-
-void PyProcess::readStandardOutput()
-{
-    setCurrentReadChannel(QProcess::StandardOutput);
-
-    while (canReadLine())
-    {
-        if (printsEnabled)
-            emit readyReadPyProcessOutput(readLine());
-        else
-            readLine();
-    }
+    checkRunFinished();
 }
 
 void PyProcess::readStandardError()
@@ -619,23 +1107,44 @@ void PyProcess::readStandardError()
     QString error;
     setCurrentReadChannel(QProcess::StandardError);
 
-    while (canReadLine())
+    /* Discard output of an idle interpreter */
+    if (!runActive)
+    {
+        readAll();
+        return;
+    }
+
+    while (canReadLine() && !errorFinished)
     {
+        QString line = readLine();
+
+        if (warmInterpreter)
+            line = takeRunFinishedMarker(line, true);
+
         if (printsEnabled)
-            error += readLine();
-        else
-            readLine();
+            error += line;
     }
 
     if (error.trimmed().length() > 1 && printsEnabled)
     {
+        runLog->logError(error);
         showErrorMessage(error);
         emit readyReadPyProcessError(error);
     }
+
+    checkRunFinished();
 }
 
 void PyProcess::showErrorMessage(QString text)
 {
+    /* Without a display the text on stderr is all there is */
+    if (headless)
+    {
+        if (text.contains("Exception:", Qt::CaseInsensitive) || text.contains("Error:", Qt::CaseInsensitive))
+            errorTermination = true;
+        return;
+    }
+
     /* Show message box */
     if (text.contains("Exception:", Qt::CaseInsensitive))
     {
@@ -0,0 +1,119 @@
+#include <PyProcessPool.h>
+
+#include <QTimer>
+
+#include <PyProcess.h>
+#include <PyTools.h>
+#include <Settings.h>
+
+
+PyProcessPool::PyProcessPool(PyTools *parent) : QObject(parent)
+{
+    pyTools = parent;
+    poolSize = settings.getInterpreterPoolSize();
+
+    /* Interpreters of another executable cannot be reused */
+    connect(&settings, &Settings::pythonPathChanged, this, [this](){ clear(); refill(); });
+    connect(&settings, &Settings::aboutToQuit, this, &PyProcessPool::clear);
+
+    /* Spawn idle interpreters once the event loop is running */
+    QTimer::singleShot(0, this, &PyProcessPool::refill);
+}
+
+PyProcessPool::~PyProcessPool()
+{
+    clear();
+}
+
+PyProcess* PyProcessPool::acquire()
+{
+    PyProcess *process = Q_NULLPTR;
+
+    /* Take the first interpreter that is ready */
+    for (int i = 0; i < idleProcesses.length(); ++i)
+    {
+        if (idleProcesses[i]->isWarm())
+        {
+            process = idleProcesses.takeAt(i);
+            break;
+        }
+    }
+
+    /* Fall back to a cold interpreter */
+    if (process == Q_NULLPTR && !idleProcesses.isEmpty())
+        process = idleProcesses.takeFirst();
+    else if (process == Q_NULLPTR)
+        process = new PyProcess(pyTools);
+
+    process->setKeepWarm(false);
+
+    /* Replace taken interpreter in the background */
+    QTimer::singleShot(0, this, &PyProcessPool::refill);
+    return process;
+}
+
+void PyProcessPool::release(PyProcess *process)
+{
+    if (process == Q_NULLPTR)
+        return;
+
+    /* Retire interpreters that crashed, ran too often, imported modules from
+       the script folder or exceed the pool size */
+    if (idleProcesses.length() >= poolSize || process->isRunning() || !process->isWarm() ||
+        process->getRunCount() >= settings.getInterpreterRecycleRuns() || process->hasLoadedModules())
+    {
+        process->shutdownInterpreter();
+        process->deleteLater();
+        return;
+    }
+
+    process->setKeepWarm(true);
+    idleProcesses.append(process);
+}
+
+void PyProcessPool::setPoolSize(int size)
+{
+    poolSize = std::max(0, size);
+
+    while (idleProcesses.length() > poolSize)
+    {
+        PyProcess *process = idleProcesses.takeLast();
+        process->shutdownInterpreter();
+        process->deleteLater();
+    }
+
+    refill();
+}
+
+int PyProcessPool::getPoolSize()
+{
+    return poolSize;
+}
+
+int PyProcessPool::idleCount()
+{
+    return int(idleProcesses.length());
+}
+
+void PyProcessPool::refill()
+{
+    if (!settings.warmInterpretersEnabled())
+        return;
+
+    while (idleProcesses.length() < poolSize)
+    {
+        PyProcess *process = new PyProcess(pyTools);
+        process->setKeepWarm(true);
+        idleProcesses.append(process);
+    }
+}
+
+void PyProcessPool::clear()
+{
+    while (!idleProcesses.isEmpty())
+    {
+        PyProcess *process = idleProcesses.takeFirst();
+        process->shutdownInterpreter();
+        process->deleteLater();
+    }
+}
@@ -0,0 +1,333 @@
+#include <PyRunLog.h>
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QThread>
+#include <QtEndian>
+
+#include <Settings.h>
+
+/* Size of the blocks written to disk */
+static const qsizetype blockSize = 64*1024;
+
+/* Logs that still have a writer on the writer thread */
+static QList<PyRunLog*> runLogs;
+
+static QThread *writerThread()
+{
+    static QThread *thread = Q_NULLPTR;
+    if (thread != Q_NULLPTR)
+        return thread;
+
+    thread = new QThread();
+    thread->setObjectName("PyRunLogWriter");
+    thread->start(QThread::LowPriority);
+
+    /* Close all logs and let the writers finish their queued records
+       before the thread stops, nothing runs on it afterwards */
+    QObject *anchor = new QObject();
+    anchor->moveToThread(thread);
+    QObject::connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, [anchor]()
+    {
+        for (PyRunLog *log : std::as_const(runLogs))
+            log->finish();
+        runLogs.clear();
+
+        QMetaObject::invokeMethod(anchor, [](){ QThread::currentThread()->quit(); }, Qt::QueuedConnection);
+        thread->wait(5000);
+    });
+
+    return thread;
+}
+
+static quint32 crc32(const QByteArray &data)
+{
+    static quint32 table[256] = {};
+    if (table[1] == 0)
+    {
+        for (quint32 i = 0; i < 256; ++i)
+        {
+            quint32 c = i;
+            for (int k = 0; k < 8; ++k)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : (c >> 1);
+            table[i] = c;
+        }
+    }
+
+    quint32 crc = 0xFFFFFFFFu;
+    for (char byte : data)
+        crc = table[(crc ^ quint8(byte)) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFFu;
+}
+
+PyRunLogWriter::PyRunLogWriter(QObject *parent) : QObject(parent)
+{
+    blockTimer = new QTimer(this);
+    blockTimer->setInterval(1000);
+    connect(blockTimer, &QTimer::timeout, this, &PyRunLogWriter::writeBlock);
+}
+
+PyRunLogWriter::~PyRunLogWriter()
+{
+    close();
+}
+
+void PyRunLogWriter::open(QString path, Config config)
+{
+    close();
+
+    this->config = config;
+    basePath = path;
+    part = 0;
+
+    QDir().mkpath(config.directory);
+    openPart();
+}
+
+void PyRunLogWriter::write(QList<PyRunLogWriter::Record> records)
+{
+    if (!file.isOpen())
+        return;
+
+    for (const Record &record : std::as_const(records))
+    {
+        QByteArray prefix = QDateTime::fromMSecsSinceEpoch(record.time).toString("yyyy-MM-dd HH:mm:ss.zzz").toUtf8();
+        prefix += ' ';
+        prefix += record.channel;
+        prefix += ' ';
+
+        /* One timestamped line per line of text */
+        QStringList lines = QString(record.text).remove('\r').split('\n');
+        if (lines.size() > 1 && lines.last().isEmpty())
+            lines.removeLast();
+
+        for (const QString &line : std::as_const(lines))
+        {
+            block += prefix;
+            block += line.toUtf8();
+            block += '\n';
+        }
+    }
+
+    if (block.size() >= blockSize)
+        writeBlock();
+}
+
+void PyRunLogWriter::close()
+{
+    if (!file.isOpen())
+        return;
+
+    blockTimer->stop();
+    closePart();
+    removeOldLogs();
+}
+
+bool PyRunLogWriter::gzipFile(QString path)
+{
+    QFile source(path);
+    if (!source.open(QIODevice::ReadOnly))
+        return false;
+
+    QByteArray data = source.readAll();
+    source.close();
+
+    /* qCompress returns a 4 byte size, a 2 byte zlib header, the raw
+       deflate stream and a 4 byte adler32 checksum. The deflate stream
+       is wrapped in a gzip header and trailer instead. */
+    QByteArray compressed = qCompress(data, 6);
+    if (compressed.size() < 10)
+        return false;
+
+    const char header[10] = {'\x1f', '\x8b', '\x08', 0, 0, 0, 0, 0, 0, '\xff'};
+    char trailer[8];
+    qToLittleEndian<quint32>(crc32(data), trailer);
+    qToLittleEndian<quint32>(quint32(data.size()), trailer + 4);
+
+    QSaveFile target(path + ".gz");
+    if (!target.open(QIODevice::WriteOnly))
+        return false;
+
+    target.write(header, sizeof(header));
+    target.write(compressed.constData() + 6, compressed.size() - 10);
+    target.write(trailer, sizeof(trailer));
+    if (!target.commit())
+        return false;
+
+    return QFile::remove(path);
+}
+
+void PyRunLogWriter::writeBlock()
+{
+    if (block.isEmpty() || !file.isOpen())
+        return;
+
+    fileSize += file.write(block);
+    file.flush();
+    block.clear();
+
+    /* Continue in a new part when the file is full */
+    if (config.maxFileSize > 0 && fileSize >= config.maxFileSize)
+    {
+        closePart();
+        ++part;
+        openPart();
+    }
+}
+
+void PyRunLogWriter::openPart()
+{
+    if (part == 0)
+        file.setFileName(basePath + ".log");
+    else
+        file.setFileName(basePath + QString(".part%1.log").arg(part));
+
+    fileSize = 0;
+    if (file.open(QIODevice::WriteOnly | QIODevice::Append))
+        blockTimer->start();
+}
+
+void PyRunLogWriter::closePart()
+{
+    if (!block.isEmpty())
+        file.write(block);
+    block.clear();
+    file.close();
+
+    if (config.compress)
+        gzipFile(file.fileName());
+}
+
+void PyRunLogWriter::removeOldLogs()
+{
+    QDir directory(config.directory);
+    QFileInfoList logs = directory.entryInfoList({"*.log", "*.log.gz"}, QDir::Files, QDir::Time);
+
+    /* Newest logs first, keep them until the size or age limit is reached */
+    QDateTime expired = QDateTime::currentDateTime().addDays(-config.maxAgeDays);
+    qint64 totalSize = 0;
+    for (const QFileInfo &log : std::as_const(logs))
+    {
+        totalSize += log.size();
+        if ((config.maxAgeDays > 0 && log.lastModified() < expired) || (config.maxTotalSize > 0 && totalSize > config.maxTotalSize))
+            QFile::remove(log.absoluteFilePath());
+    }
+}
+
+PyRunLog::PyRunLog(QObject *parent) : QObject(parent)
+{
+    writer = new PyRunLogWriter();
+    writer->moveToThread(writerThread());
+    runLogs.append(this);
+
+    flushTimer = new QTimer(this);
+    flushTimer->setSingleShot(true);
+    flushTimer->setInterval(250);
+    connect(flushTimer, &QTimer::timeout, this, &PyRunLog::flush);
+}
+
+PyRunLog::~PyRunLog()
+{
+    runLogs.removeOne(this);
+    finish();
+}
+
+void PyRunLog::finish()
+{
+    if (writer == Q_NULLPTR)
+        return;
+
+    if (active)
+        endRun(PyRunLog::tr("Log closed"));
+
+    /* Deleted on the writer thread after the queued close */
+    PyRunLogWriter *writer = this->writer;
+    QMetaObject::invokeMethod(writer, [writer](){ delete writer; }, Qt::QueuedConnection);
+    this->writer = Q_NULLPTR;
+}
+
+void PyRunLog::beginRun(QString script)
+{
+    if (writer == Q_NULLPTR)
+        return;
+
+    if (active)
+        endRun(PyRunLog::tr("Log closed"));
+
+    /* Unique name per run, processes may start within the same millisecond */
+    static int counter = 0;
+    QString directory = settings.getAppDataPath() + "/logs";
+    QString name = QDateTime::currentDateTime().toString("yyyyMMdd-HHmmss-zzz") + "-" + QString::number(++counter) + "-" + QFileInfo(script).completeBaseName();
+
+    PyRunLogWriter::Config config;
+    config.directory = directory;
+    config.compress = settings.runLogCompressionEnabled();
+    config.maxFileSize = settings.getRunLogMaxFileSize();
+    config.maxTotalSize = settings.getRunLogMaxTotalSize();
+    config.maxAgeDays = settings.getRunLogMaxAge();
+
+    PyRunLogWriter *writer = this->writer;
+    QString path = directory + "/" + name;
+    QMetaObject::invokeMethod(writer, [writer, path, config](){ writer->open(path, config); }, Qt::QueuedConnection);
+
+    active = true;
+    append('#', "Run " + QFileInfo(script).absoluteFilePath());
+}
+
+void PyRunLog::endRun(QString status)
+{
+    if (!active)
+        return;
+
+    append('#', status);
+    flush();
+    active = false;
+
+    PyRunLogWriter *writer = this->writer;
+    QMetaObject::invokeMethod(writer, [writer](){ writer->close(); }, Qt::QueuedConnection);
+}
+
+void PyRunLog::logOutput(const QString &text)
+{
+    append('O', text);
+}
+
+void PyRunLog::logError(const QString &text)
+{
+    append('E', text);
+}
+
+void PyRunLog::logEvent(const QString &text)
+{
+    append('I', text);
+}
+
+bool PyRunLog::isActive()
+{
+    return active;
+}
+
+void PyRunLog::append(char channel, const QString &text)
+{
+    if (!active || text.isEmpty())
+        return;
+
+    pending.append({QDateTime::currentMSecsSinceEpoch(), channel, text});
+    if (!flushTimer->isActive())
+        flushTimer->start();
+}
+
+void PyRunLog::flush()
+{
+    flushTimer->stop();
+    if (pending.isEmpty())
+        return;
+
+    PyRunLogWriter *writer = this->writer;
+    QList<PyRunLogWriter::Record> records;
+    records.swap(pending);
+    QMetaObject::invokeMethod(writer, [writer, records](){ writer->write(records); }, Qt::QueuedConnection);
+}
@@ -0,0 +1,350 @@
+#include <PyRunScheduler.h>
+
+#include <QDateTime>
+#include <QTimer>
+
+#include <PyProcess.h>
+#include <PyProcessPool.h>
+#include <Settings.h>
+
+/* Output kept per job, older output is dropped */
+static const qsizetype maxCapturedOutput = 1024*1024;
+
+PyRunScheduler::PyRunScheduler(PyProcess *terminal, PyProcessPool *pool, QObject *parent) : QObject(parent)
+{
+    terminalProcess = terminal;
+    processPool = pool;
+    maxParallel = settings.getMaxParallelRuns();
+}
+
+PyRunScheduler::~PyRunScheduler()
+{
+    for (Job &job : jobs)
+        for (const QMetaObject::Connection &connection : std::as_const(job.connections))
+            disconnect(connection);
+}
+
+int PyRunScheduler::submit(QString name, QString script, QString input, bool terminal, int priority, int batch, bool capture)
+{
+    Job job;
+    job.id = nextId++;
+    job.name = name;
+    job.script = script;
+    job.input = input;
+    job.terminal = terminal;
+    job.priority = priority;
+    job.batch = batch;
+    job.capture = capture && !terminal;
+    jobs.append(job);
+
+    emit jobAdded(job.id);
+
+    /* Start jobs once all jobs of a batch are submitted */
+    scheduleLater();
+    return job.id;
+}
+
+int PyRunScheduler::createBatch()
+{
+    return nextBatch++;
+}
+
+QList<int> PyRunScheduler::batchJobIds(int batch)
+{
+    QList<int> ids;
+    for (const Job &job : std::as_const(jobs))
+        if (job.batch == batch)
+            ids.append(job.id);
+    return ids;
+}
+
+bool PyRunScheduler::batchActive(int batch)
+{
+    for (const Job &job : std::as_const(jobs))
+        if (job.batch == batch && (job.status == JOB_QUEUED || job.status == JOB_RUNNING))
+            return true;
+    return false;
+}
+
+void PyRunScheduler::cancel(int id)
+{
+    int i = indexOf(id);
+    if (i < 0)
+        return;
+
+    Job &job = jobs[i];
+    if (job.status == JOB_QUEUED)
+    {
+        job.status = JOB_CANCELLED;
+        job.input.clear();
+        emit jobChanged(id);
+
+        if (job.batch > 0 && !batchActive(job.batch))
+            emit batchFinished(job.batch);
+        scheduleLater();
+    }
+    else if (job.status == JOB_RUNNING && job.process != Q_NULLPTR)
+        job.process->killPyProcess();
+}
+
+void PyRunScheduler::cancelQueued()
+{
+    QList<int> batches;
+    for (Job &job : jobs)
+    {
+        if (job.status != JOB_QUEUED)
+            continue;
+
+        job.status = JOB_CANCELLED;
+        job.input.clear();
+        emit jobChanged(job.id);
+
+        if (job.batch > 0 && !batches.contains(job.batch))
+            batches.append(job.batch);
+    }
+
+    for (int batch : std::as_const(batches))
+        if (!batchActive(batch))
+            emit batchFinished(batch);
+
+    scheduleLater();
+}
+
+void PyRunScheduler::clearHistory()
+{
+    for (qsizetype i = jobs.length() - 1; i >= 0; --i)
+    {
+        if (jobs[i].status == JOB_QUEUED || jobs[i].status == JOB_RUNNING)
+            continue;
+
+        int id = jobs.takeAt(i).id;
+        emit jobRemoved(id);
+    }
+}
+
+bool PyRunScheduler::contains(int id)
+{
+    return indexOf(id) >= 0;
+}
+
+PyRunScheduler::Job PyRunScheduler::job(int id)
+{
+    int i = indexOf(id);
+    if (i < 0)
+        return Job();
+
+    return jobs[i];
+}
+
+QList<int> PyRunScheduler::jobIds()
+{
+    QList<int> ids;
+    for (const Job &job : std::as_const(jobs))
+        ids.append(job.id);
+    return ids;
+}
+
+int PyRunScheduler::runningCount()
+{
+    int count = 0;
+    for (const Job &job : std::as_const(jobs))
+        if (job.status == JOB_RUNNING)
+            ++count;
+    return count;
+}
+
+int PyRunScheduler::queuedCount()
+{
+    int count = 0;
+    for (const Job &job : std::as_const(jobs))
+        if (job.status == JOB_QUEUED)
+            ++count;
+    return count;
+}
+
+void PyRunScheduler::setMaxParallel(int count)
+{
+    maxParallel = std::max(1, count);
+    scheduleLater();
+}
+
+int PyRunScheduler::getMaxParallel()
+{
+    return maxParallel;
+}
+
+QString PyRunScheduler::statusText(JobStatus status)
+{
+    switch (status)
+    {
+    case JOB_QUEUED:
+        return PyRunScheduler::tr("Queued");
+    case JOB_RUNNING:
+        return PyRunScheduler::tr("Running");
+    case JOB_FINISHED:
+        return PyRunScheduler::tr("Finished");
+    case JOB_FAILED:
+        return PyRunScheduler::tr("Failed");
+    case JOB_CANCELLED:
+        return PyRunScheduler::tr("Cancelled");
+    }
+
+    return QString();
+}
+
+int PyRunScheduler::indexOf(int id)
+{
+    for (int i = 0; i < jobs.length(); ++i)
+        if (jobs[i].id == id)
+            return i;
+    return -1;
+}
+
+bool PyRunScheduler::terminalBusy()
+{
+    if (terminalProcess->isRunning())
+        return true;
+
+    for (const Job &job : std::as_const(jobs))
+        if (job.terminal && job.status == JOB_RUNNING)
+            return true;
+
+    return false;
+}
+
+void PyRunScheduler::scheduleLater()
+{
+    if (schedulePending)
+        return;
+
+    schedulePending = true;
+    QTimer::singleShot(0, this, &PyRunScheduler::schedule);
+}
+
+void PyRunScheduler::schedule()
+{
+    schedulePending = false;
+    pruneHistory();
+
+    while (runningCount() < maxParallel)
+    {
+        /* Highest priority first, jobs of equal priority in order of submission */
+        int next = -1;
+        bool terminalFree = !terminalBusy();
+        for (int i = 0; i < jobs.length(); ++i)
+        {
+            if (jobs[i].status != JOB_QUEUED || (jobs[i].terminal && !terminalFree))
+                continue;
+
+            if (next < 0 || jobs[i].priority > jobs[next].priority)
+                next = i;
+        }
+
+        if (next < 0)
+            break;
+
+        startJob(jobs[next]);
+    }
+
+    if (runningCount() == 0 && queuedCount() == 0)
+        emit queueEmpty();
+}
+
+void PyRunScheduler::startJob(Job &job)
+{
+    int id = job.id;
+    job.status = JOB_RUNNING;
+    job.process = job.terminal ? terminalProcess : processPool->acquire();
+
+    /* A process that cannot start only emits pyProcessCancelled */
+    PyProcess *process = job.process;
+    job.connections.append(connect(process, &PyProcess::pyProcessFinished, this, [this, id](){ finishJob(id, true); }));
+    job.connections.append(connect(process, &PyProcess::pyProcessCancelled, this, [this, id](){ finishJob(id, false); }));
+
+    if (job.capture)
+    {
+        job.connections.append(connect(process, &PyProcess::readyReadPyProcessOutput, this, [this, id](QString text){ appendOutput(id, text, false); }));
+        job.connections.append(connect(process, &PyProcess::readyReadPyProcessError, this, [this, id](QString text){ appendOutput(id, text, true); }));
+    }
+
+    job.startTime = QDateTime::currentMSecsSinceEpoch();
+    emit jobChanged(id);
+
+    QString script = job.script;
+    QString input = job.input;
+    process->startPyProcess(script, input);
+}
+
+void PyRunScheduler::finishJob(int id, bool started)
+{
+    int i = indexOf(id);
+    if (i < 0 || jobs[i].status != JOB_RUNNING)
+        return;
+
+    Job &job = jobs[i];
+    for (const QMetaObject::Connection &connection : std::as_const(job.connections))
+        disconnect(connection);
+    job.connections.clear();
+
+    PyProcess *process = job.process;
+    if (!started)
+        job.status = JOB_FAILED;
+    else if (process->getLastRunResult() == PyProcess::RUN_TERMINATED)
+        job.status = JOB_CANCELLED;
+    else if (process->getLastRunResult() == PyProcess::RUN_FAILED)
+        job.status = JOB_FAILED;
+    else
+        job.status = JOB_FINISHED;
+
+    job.process = Q_NULLPTR;
+    job.input.clear();
+    job.endTime = QDateTime::currentMSecsSinceEpoch();
+    int batch = job.batch;
+
+    if (!job.terminal)
+        processPool->release(process);
+
+    emit jobChanged(id);
+    emit jobFinished(id);
+
+    if (batch > 0 && !batchActive(batch))
+        emit batchFinished(batch);
+
+    scheduleLater();
+}
+
+void PyRunScheduler::appendOutput(int id, QString text, bool error)
+{
+    int i = indexOf(id);
+    if (i < 0)
+        return;
+
+    QString &output = jobs[i].output;
+    output += text;
+    if (output.size() > maxCapturedOutput)
+        output.remove(0, output.size() - maxCapturedOutput);
+
+    emit jobOutput(id, text, error);
+}
+
+void PyRunScheduler::pruneHistory()
+{
+    int done = 0;
+    for (const Job &job : std::as_const(jobs))
+        if (job.status != JOB_QUEUED && job.status != JOB_RUNNING)
+            ++done;
+
+    /* Remove the oldest finished jobs, keep batches until they are done */
+    for (qsizetype i = 0; i < jobs.length() && done > historySize; )
+    {
+        if (jobs[i].status == JOB_QUEUED || jobs[i].status == JOB_RUNNING || (jobs[i].batch > 0 && batchActive(jobs[i].batch)))
+        {
+            ++i;
+            continue;
+        }
+
+        int id = jobs.takeAt(i).id;
+        --done;
+        emit jobRemoved(id);
+    }
+}
@@ -0,0 +1,544 @@
+#include <PyTerminal.h>
+
+#include <QApplication>
+#include <QClipboard>
+#include <QContextMenuEvent>
+#include <QMenu>
+#include <QPainter>
+#include <QScrollBar>
+#include <QTimer>
+
+#include <cmath>
+
+#include <Settings.h>
+
+/* Longer lines are continued on a new line to keep layouts cheap */
+static const qsizetype maxLineLength = 65536;
+
+PyTerminal::PyTerminal(QWidget *parent) : QAbstractScrollArea(parent)
+{
+    setFocusPolicy(Qt::StrongFocus);
+    setVerticalScrollBarPolicy(Qt::ScrollBarAsNeeded);
+
+    /* Rules of the stylesheet for text edits do not match the terminal, the
+       output colors are made for the dark background of the theme */
+    QColor background = settings.getColor("color/theme-dark");
+    setObjectName("Terminal");
+    setStyleSheet(QString("PyTerminal#Terminal {background-color: %1;}").arg(background.name()));
+
+    QPalette colors = viewport()->palette();
+    colors.setColor(QPalette::Base, background);
+    colors.setColor(QPalette::Window, background);
+    viewport()->setPalette(colors);
+    viewport()->setAutoFillBackground(true);
+    viewport()->setCursor(Qt::IBeamCursor);
+    verticalScrollBar()->setSingleStep(1);
+
+    connect(verticalScrollBar(), &QScrollBar::valueChanged, this, [this](int value)
+    {
+        followOutput = (value >= verticalScrollBar()->maximum());
+        viewport()->update();
+    });
+    connect(horizontalScrollBar(), &QScrollBar::valueChanged, viewport(), qOverload<>(&QWidget::update));
+
+    updateFonts();
+    clear();
+}
+
+void PyTerminal::clear()
+{
+    lines.clear();
+    lines.append(TerminalLine());
+    head = 0;
+    firstLine = 0;
+    droppedLines = 0;
+    followOutput = true;
+    selectionAnchor = Position();
+    selectionCursor = Position();
+    scheduleScrollUpdate();
+}
+
+void PyTerminal::append(QString text, QColor color)
+{
+    text.remove('\r');
+
+    qsizetype start = 0;
+    while (start <= text.size())
+    {
+        qsizetype end = text.indexOf('\n', start);
+        QStringView part = QStringView(text).mid(start, (end < 0 ? text.size() : end) - start);
+
+        while (!part.isEmpty())
+        {
+            TerminalLine &current = line(lineCount() - 1);
+            if (current.length >= maxLineLength)
+            {
+                pushLine();
+                continue;
+            }
+
+            QStringView piece = part.left(maxLineLength - current.length);
+            part = part.mid(piece.size());
+
+            /* Extend the last span if its style did not change */
+            if (!current.spans.isEmpty() && current.spans.last().color == color && current.spans.last().style == style)
+                current.spans.last().text += piece;
+            else
+                current.spans.append({piece.toString(), color, style});
+            current.length += piece.size();
+        }
+
+        if (end < 0)
+            break;
+
+        pushLine();
+        start = end + 1;
+    }
+
+    scheduleScrollUpdate();
+}
+
+void PyTerminal::beginLine(bool bold, bool cursive, bool monospace, qreal indent)
+{
+    style = (bold ? STYLE_BOLD : 0) | (cursive ? STYLE_CURSIVE : 0) | (monospace ? STYLE_MONOSPACE : 0);
+    this->indent = indent;
+
+    /* Start a new paragraph unless the current one is still empty */
+    if (line(lineCount() - 1).length > 0)
+        pushLine();
+
+    line(lineCount() - 1).indent = indent;
+    scheduleScrollUpdate();
+}
+
+void PyTerminal::setScrollbackLimit(qsizetype limit)
+{
+    limit = std::max<qsizetype>(1, limit);
+    if (limit == capacity)
+        return;
+
+    /* Keep the most recent lines in order */
+    QList<TerminalLine> kept;
+    qsizetype count = lineCount();
+    qsizetype first = std::max<qsizetype>(0, count - limit);
+    kept.reserve(count - first);
+    for (qsizetype i = first; i < count; ++i)
+        kept.append(std::move(line(i)));
+
+    lines = kept;
+    head = 0;
+    firstLine += first;
+    droppedLines += first;
+    capacity = limit;
+    scheduleScrollUpdate();
+}
+
+qsizetype PyTerminal::scrollbackLimit()
+{
+    return capacity;
+}
+
+qsizetype PyTerminal::lineCount()
+{
+    return lines.size();
+}
+
+void PyTerminal::setWordWrap(bool enable)
+{
+    wordWrap = enable;
+    setHorizontalScrollBarPolicy(enable ? Qt::ScrollBarAlwaysOff : Qt::ScrollBarAsNeeded);
+    scheduleScrollUpdate();
+}
+
+bool PyTerminal::wordWrapEnabled()
+{
+    return wordWrap;
+}
+
+void PyTerminal::setTabStopDistance(qreal distance)
+{
+    tabStop = distance;
+    viewport()->update();
+}
+
+qreal PyTerminal::tabStopDistance()
+{
+    return tabStop;
+}
+
+void PyTerminal::setFontFamilies(QString regular, QString monospace)
+{
+    regularFamily = regular;
+    monospaceFamily = monospace;
+    updateFonts();
+}
+
+QString PyTerminal::selectedText()
+{
+    Position start, end;
+    if (!selectionRange(start, end))
+        return QString();
+
+    QStringList text;
+    for (qint64 number = std::max(start.line, firstLine); number <= end.line; ++number)
+    {
+        QString full = lineText(number - firstLine);
+        int from = (number == start.line) ? start.column : 0;
+        int to = (number == end.line) ? end.column : int(full.size());
+        text.append(full.mid(from, to - from));
+    }
+
+    return text.join('\n');
+}
+
+void PyTerminal::copy()
+{
+    QString text = selectedText();
+    if (!text.isEmpty())
+        QApplication::clipboard()->setText(text);
+}
+
+void PyTerminal::selectAll()
+{
+    selectionAnchor = {firstLine, 0};
+    selectionCursor = {firstLine + lineCount() - 1, int(line(lineCount() - 1).length)};
+    viewport()->update();
+}
+
+void PyTerminal::scrollToBottom()
+{
+    followOutput = true;
+    verticalScrollBar()->setValue(verticalScrollBar()->maximum());
+}
+
+void PyTerminal::paintEvent(QPaintEvent *event)
+{
+    Q_UNUSED(event)
+
+    layoutVisibleLines();
+
+    QPainter painter(viewport());
+    qreal x = -horizontalScrollBar()->value();
+
+    Position start, end;
+    bool selection = selectionRange(start, end);
+
+    QTextCharFormat selectionFormat;
+    selectionFormat.setBackground(palette().brush(QPalette::Highlight));
+    selectionFormat.setForeground(palette().brush(QPalette::HighlightedText));
+
+    for (const VisibleLine &visible : std::as_const(visibleLines))
+    {
+        QList<QTextLayout::FormatRange> selections;
+        if (selection && visible.number >= start.line && visible.number <= end.line)
+        {
+            QTextLayout::FormatRange range;
+            range.start = (visible.number == start.line) ? start.column : 0;
+            range.length = ((visible.number == end.line) ? end.column : int(visible.layout->text().size()) + 1) - range.start;
+            range.format = selectionFormat;
+            selections.append(range);
+        }
+
+        visible.layout->draw(&painter, QPointF(x, visible.top), selections);
+    }
+}
+
+void PyTerminal::resizeEvent(QResizeEvent *event)
+{
+    QAbstractScrollArea::resizeEvent(event);
+    updateScrollBars();
+}
+
+void PyTerminal::changeEvent(QEvent *event)
+{
+    QAbstractScrollArea::changeEvent(event);
+
+    if (event->type() == QEvent::FontChange || event->type() == QEvent::StyleChange)
+    {
+        updateFonts();
+        scheduleScrollUpdate();
+    }
+}
+
+void PyTerminal::keyPressEvent(QKeyEvent *event)
+{
+    if (event == QKeySequence::Copy)
+        copy();
+    else if (event == QKeySequence::SelectAll)
+        selectAll();
+    else if (event->key() == Qt::Key_End && event->modifiers() & Qt::ControlModifier)
+        scrollToBottom();
+    else
+        QAbstractScrollArea::keyPressEvent(event);
+}
+
+void PyTerminal::mousePressEvent(QMouseEvent *event)
+{
+    if (event->button() != Qt::LeftButton)
+    {
+        QAbstractScrollArea::mousePressEvent(event);
+        return;
+    }
+
+    selecting = true;
+    selectionAnchor = hitTest(event->position().toPoint());
+    selectionCursor = selectionAnchor;
+    viewport()->update();
+}
+
+void PyTerminal::mouseMoveEvent(QMouseEvent *event)
+{
+    if (!selecting)
+        return;
+
+    /* Scroll while dragging outside of the viewport */
+    QPoint point = event->position().toPoint();
+    if (point.y() < 0)
+        verticalScrollBar()->triggerAction(QAbstractSlider::SliderSingleStepSub);
+    else if (point.y() > viewport()->height())
+        verticalScrollBar()->triggerAction(QAbstractSlider::SliderSingleStepAdd);
+
+    layoutVisibleLines();
+    selectionCursor = hitTest(point);
+    viewport()->update();
+}
+
+void PyTerminal::mouseReleaseEvent(QMouseEvent *event)
+{
+    if (event->button() == Qt::LeftButton)
+        selecting = false;
+
+    QAbstractScrollArea::mouseReleaseEvent(event);
+}
+
+void PyTerminal::contextMenuEvent(QContextMenuEvent *event)
+{
+    QMenu menu(this);
+
+    QAction *copyAction = menu.addAction(PyTerminal::tr("Copy"), this, &PyTerminal::copy);
+    copyAction->setShortcut(QKeySequence::Copy);
+    copyAction->setEnabled(!selectedText().isEmpty());
+
+    QAction *selectAllAction = menu.addAction(PyTerminal::tr("Select All"), this, &PyTerminal::selectAll);
+    selectAllAction->setShortcut(QKeySequence::SelectAll);
+
+    menu.exec(event->globalPos());
+}
+
+PyTerminal::TerminalLine &PyTerminal::line(qsizetype i)
+{
+    return lines[(head + i) % lines.size()];
+}
+
+QString PyTerminal::lineText(qsizetype i)
+{
+    QString text;
+    const TerminalLine &terminalLine = line(i);
+    text.reserve(terminalLine.length);
+    for (const TerminalSpan &span : terminalLine.spans)
+        text += span.text;
+    return text;
+}
+
+void PyTerminal::pushLine()
+{
+    TerminalLine terminalLine;
+    terminalLine.indent = indent;
+
+    if (lines.size() < capacity)
+    {
+        lines.append(terminalLine);
+        return;
+    }
+
+    /* Overwrite the oldest line */
+    lines[head] = terminalLine;
+    head = (head + 1) % lines.size();
+    ++firstLine;
+    ++droppedLines;
+}
+
+void PyTerminal::updateFonts()
+{
+    for (quint8 i = 0; i < 8; ++i)
+    {
+        QFont font = this->font();
+        if (i & STYLE_MONOSPACE)
+        {
+            if (!monospaceFamily.isEmpty())
+                font.setFamily(monospaceFamily);
+            else
+                font.setStyleHint(QFont::Monospace);
+        }
+        else if (!regularFamily.isEmpty())
+            font.setFamily(regularFamily);
+
+        font.setBold(i & STYLE_BOLD);
+        font.setItalic(i & STYLE_CURSIVE);
+        fonts[i] = font;
+    }
+}
+
+void PyTerminal::scheduleScrollUpdate()
+{
+    /* Coalesce all changes made in one pass of the event loop */
+    if (scrollUpdatePending)
+        return;
+
+    scrollUpdatePending = true;
+    QTimer::singleShot(0, this, &PyTerminal::updateScrollBars);
+}
+
+void PyTerminal::updateScrollBars()
+{
+    scrollUpdatePending = false;
+
+    /* Count the lines that fill the viewport at the end of the buffer */
+    qreal width = viewport()->width();
+    qreal height = viewport()->height();
+    qreal used = 0.0;
+    qsizetype fit = 0;
+    for (qsizetype i = lineCount() - 1; i >= 0; --i)
+    {
+        qreal lineHeight = createLayout(line(i), width)->boundingRect().height();
+        if (fit > 0 && used + lineHeight > height)
+            break;
+        used += lineHeight;
+        ++fit;
+    }
+
+    bool follow = followOutput;
+    QScrollBar *scrollBar = verticalScrollBar();
+
+    /* Keep the same text on screen when old lines were dropped */
+    int value = int(std::max<qsizetype>(0, scrollBar->value() - droppedLines));
+    droppedLines = 0;
+
+    QSignalBlocker blocker(scrollBar);
+    scrollBar->setRange(0, int(std::max<qsizetype>(0, lineCount() - fit)));
+    scrollBar->setPageStep(int(std::max<qsizetype>(1, fit)));
+    scrollBar->setValue(follow ? scrollBar->maximum() : value);
+    followOutput = follow || scrollBar->value() >= scrollBar->maximum();
+
+    viewport()->update();
+}
+
+void PyTerminal::layoutVisibleLines()
+{
+    visibleLines.clear();
+
+    qreal width = viewport()->width();
+    qreal height = viewport()->height();
+    qreal top = 0.0;
+    qreal naturalWidth = 0.0;
+
+    for (qsizetype i = verticalScrollBar()->value(); i < lineCount() && top < height; ++i)
+    {
+        QSharedPointer<QTextLayout> layout = createLayout(line(i), width);
+        QRectF rect = layout->boundingRect();
+        visibleLines.append({firstLine + i, layout, top, rect.height()});
+        naturalWidth = std::max(naturalWidth, rect.right());
+        top += rect.height();
+    }
+
+    /* Without word wrap the widest line on screen sets the scroll range */
+    if (!wordWrap)
+    {
+        QScrollBar *scrollBar = horizontalScrollBar();
+        scrollBar->setRange(0, std::max(0, int(std::ceil(naturalWidth - width))));
+        scrollBar->setPageStep(int(width));
+    }
+}
+
+QSharedPointer<QTextLayout> PyTerminal::createLayout(const TerminalLine &terminalLine, qreal width)
+{
+    QString text;
+    text.reserve(terminalLine.length);
+
+    QList<QTextLayout::FormatRange> formats;
+    for (const TerminalSpan &span : terminalLine.spans)
+    {
+        QTextLayout::FormatRange range;
+        range.start = int(text.size());
+        range.length = int(span.text.size());
+        range.format.setFont(fonts[span.style]);
+        range.format.setForeground(span.color);
+        formats.append(range);
+        text += span.text;
+    }
+
+    quint8 lineStyle = terminalLine.spans.isEmpty() ? style : terminalLine.spans.first().style;
+    QSharedPointer<QTextLayout> layout(new QTextLayout(text, fonts[lineStyle]));
+
+    QTextOption option;
+    option.setWrapMode(wordWrap ? QTextOption::WrapAtWordBoundaryOrAnywhere : QTextOption::NoWrap);
+    option.setTabStopDistance(tabStop);
+    layout->setTextOption(option);
+    layout->setFormats(formats);
+
+    qreal lineWidth = std::max(1.0, width - terminalLine.indent);
+    qreal y = 0.0;
+
+    layout->beginLayout();
+    forever
+    {
+        QTextLine textLine = layout->createLine();
+        if (!textLine.isValid())
+            break;
+
+        textLine.setLineWidth(lineWidth);
+        textLine.setPosition(QPointF(terminalLine.indent, y));
+        y += textLine.height();
+    }
+    layout->endLayout();
+
+    return layout;
+}
+
+PyTerminal::Position PyTerminal::hitTest(QPoint point)
+{
+    if (visibleLines.isEmpty())
+        return {firstLine + lineCount() - 1, int(line(lineCount() - 1).length)};
+
+    if (point.y() < 0)
+        return {visibleLines.first().number, 0};
+
+    qreal x = point.x() + horizontalScrollBar()->value();
+    for (const VisibleLine &visible : std::as_const(visibleLines))
+    {
+        if (point.y() >= visible.top + visible.height)
+            continue;
+
+        /* Find the wrapped line below the point */
+        QTextLayout *layout = visible.layout.data();
+        for (int i = 0; i < layout->lineCount(); ++i)
+        {
+            QTextLine textLine = layout->lineAt(i);
+            if (point.y() < visible.top + textLine.y() + textLine.height() || i == layout->lineCount() - 1)
+                return {visible.number, textLine.xToCursor(x)};
+        }
+    }
+
+    const VisibleLine &last = visibleLines.last();
+    return {last.number, int(last.layout->text().size())};
+}
+
+bool PyTerminal::selectionRange(Position &start, Position &end)
+{
+    if (selectionAnchor.line < 0 || selectionCursor.line < 0)
+        return false;
+
+    bool forward = selectionAnchor.line < selectionCursor.line ||
+                   (selectionAnchor.line == selectionCursor.line && selectionAnchor.column <= selectionCursor.column);
+    start = forward ? selectionAnchor : selectionCursor;
+    end = forward ? selectionCursor : selectionAnchor;
+
+    /* Lines that left the scrollback cannot be selected anymore */
+    if (end.line < firstLine || (start.line == end.line && start.column == end.column))
+        return false;
+
+    if (start.line < firstLine)
+        start = {firstLine, 0};
+
+    return true;
+}
@@ -5,7 +5,10 @@
 #include <DocumentationViewer.h>
 #include <ModuleInstaller.h>
 #include <FramelessFileDialog.h>
+#include <PyInterpreterCache.h>
 #include <PyProcess.h>
+#include <PyProcessPool.h>
+#include <PyRunScheduler.h>
 #include <PyDock.h>
 
 
@@ -35,6 +38,13 @@ PyTools::PyTools(QWidget *parent)  : FramelessMainWindow(parent)
     connect(pyDock->process(), &PyProcess::writeXml, this, &PyTools::saveSession);
     connect(this, &PyTools::dpiScaleChanged, pyDock, &PyDock::updateDpiScale);
 
+    /* Create pool of warm interpreters for silent actions */
+    processPool = new PyProcessPool(this);
+
+    /* Create queue for module runs and actions */
+    scheduler = new PyRunScheduler(pyDock->process(), processPool, this);
+    pyDock->setScheduler(scheduler);
+
     /* Create status bar */
     statusBar = new HdStatusBar(this);
     statusBar->setDynamicHeight(settings.getLabelHeight(statusBar)+4);
@@ -201,6 +211,14 @@ void PyTools::createSessionMenu()
                                                                 openSession(settings.getAppDataPath() + "/LastSession.xml"); });
     connect(this, &PyTools::languageChanged, restore, [restore](){ restore->setText(PyTools::tr("Restore previous session")); });
     sessionMenu->addAction(restore);
+
+    /* Add action Run all enabled tabs */
+    QAction *runAll = new QAction(PyTools::tr("Run all enabled tabs"), this);
+    runAll->setShortcut(QKeySequence("Shift+F5"));
+    connect(runAll, &QAction::triggered, this, &PyTools::runAllTabs);
+    connect(this, &PyTools::languageChanged, runAll, [runAll](){ runAll->setText(PyTools::tr("Run all enabled tabs")); });
+    connect(this, &PyTools::moduleChanged, runAll, [this, runAll](){ runAll->setEnabled(xmlApp->currentModule()->isExpandable()); });
+    sessionMenu->addAction(runAll);
 }
 
 void PyTools::createModulesMenu()
@@ -306,17 +324,13 @@ void PyTools::aboutMe()
     QString cpversion = QString::number(__GNUC__) + "." +\
                         QString::number(__GNUC_MINOR__) + "." + \
                         QString::number(__GNUC_PATCHLEVEL__);
-    QString pyversion = PyProcess::getEmbeddedPythonVersion();
     QString qwkversion = "1.4.1";
 
-    if (pyversion.split(" ").length() < 2 || !pyversion.startsWith("Py", Qt::CaseInsensitive))
-        pyversion.clear();
-    else if (pyversion.contains("32 bit", Qt::CaseInsensitive))
-        pyversion = "Python " + pyversion.split(" ").at(1) + " (32 bit)";
-    else if (pyversion.contains("64 bit", Qt::CaseInsensitive))
-        pyversion = "Python " + pyversion.split(" ").at(1) + " (64 bit)";
-    else
-        pyversion.clear();
+    /* Use cached interpreter metadata */
+    QString pyversion;
+    PyInterpreterInfo pyinfo = interpreterCache.getInfo(settings.getEmbeddedPythonPath());
+    if (pyinfo.isValid() && !pyinfo.architecture.isEmpty())
+        pyversion = "Python " + pyinfo.version.split(" ").first() + " (" + QString(pyinfo.architecture).replace("bit", " bit") + ")";
 
     QString szversion = ModuleInstaller::get7ZipVersion();
 
@@ -355,10 +369,12 @@ void PyTools::aboutMe()
 void PyTools::loadXmlFile(QString filepath, QString name)
 {
     QString last_session = QFileInfo(settings.getAppDataPath() + "/LastSession.xml").absoluteFilePath();
-    QString temp_session = QFileInfo(settings.getAppDataPath() + "/TempSession.xml").absoluteFilePath();
+    bool reload = QFileInfo(filepath).absoluteFilePath().toLower() == last_session.toLower();
 
-    if ((xmlApp->isValid()) && (QFileInfo(filepath).absoluteFilePath().toLower() == last_session.toLower()))
-        xmlApp->saveCurrentModule(temp_session);
+    /* On a reload the current session replaces the last session once it has been read */
+    QString current_session;
+    if ((xmlApp->isValid()) && reload)
+        current_session = xmlApp->currentModule()->toSessionString(last_session);
     else if (xmlApp->isValid())
         xmlApp->saveCurrentModule(last_session);
 
@@ -370,19 +386,8 @@ void PyTools::loadXmlFile(QString filepath, QString name)
             this->loadXmlFile(QFileInfo(settings.getApplicationPath() + "/FirstSession.xml").absoluteFilePath());
     }
 
-    if (QFileInfo(filepath).absoluteFilePath().toLower() == last_session.toLower())
-    {
-        QElapsedTimer timer;
-        timer.start();
-        while (QFile::exists(last_session) && timer.elapsed() <= 250)
-            QFile::remove(last_session);
-
-        QFile::rename(temp_session, last_session);
-
-        timer.restart();
-        while (QFile::exists(temp_session) && timer.elapsed() <= 250)
-            QFile::remove(temp_session);
-    }
+    if (!current_session.isEmpty())
+        XmlApplication::writeXmlFile(current_session, last_session);
 
     xmlApp->selectModule(name);
 
@@ -484,14 +489,9 @@ void PyTools::pyActionTriggered()
 {
     PyAction *action = static_cast<PyAction *>(sender());
 
-    if (action->getRunSilent())
-    {
-        PyProcess* process = new PyProcess(this);
-        connect(process, &PyProcess::pyProcessFinished, process, &PyProcess::deleteLater);
-        process->startPyProcess({QFileInfo(action->getFilePath()).absoluteFilePath()}, xmlApp->currentModule()->toString());
-    }
-    else
-        pyDock->process()->startPyProcess({QFileInfo(action->getFilePath()).absoluteFilePath()}, xmlApp->currentModule()->toString());
+    /* Actions are triggered interactively, run them before queued modules */
+    scheduler->submit(action->getName(), QFileInfo(action->getFilePath()).absoluteFilePath(), xmlApp->currentModule()->toString(),
+                      !action->getRunSilent(), PyRunScheduler::PRIORITY_HIGH);
 }
 
 void PyTools::runButtonClicked(bool checked)
@@ -504,8 +504,24 @@ void PyTools::runButtonClicked(bool checked)
 
 void PyTools::startModule()
 {
-    pyDock->process()->startPyProcess(xmlApp->currentModule()->getFilePath(), xmlApp->currentModule()->toString());
-    QCoreApplication::processEvents(QEventLoop::ExcludeUserInputEvents);
+    /* Input is taken now, so the module can be changed while the run is queued */
+    scheduler->submit(xmlApp->currentModule()->getName(), xmlApp->currentModule()->getFilePath(), xmlApp->currentModule()->toString());
+}
+
+void PyTools::runAllTabs()
+{
+    XmlModule *module = xmlApp->currentModule();
+    if (!module->isExpandable())
+    {
+        startModule();
+        return;
+    }
+
+    /* One silent run per enabled tab, the pool runs them in parallel */
+    int batch = scheduler->createBatch();
+    const QList<QPair<QString, QString>> tabs = module->toTabStrings();
+    for (const QPair<QString, QString> &tab : tabs)
+        scheduler->submit(module->getName() + " - " + tab.first, module->getFilePath(), tab.second, false, PyRunScheduler::PRIORITY_NORMAL, batch, true);
 }
 
 void PyTools::stopModule()
@@ -1,4 +1,57 @@
 #include <XmlAbstractObject.h>
 
+#include <QHash>
+
+/* Revision per module node or document, from a counter shared by all of them */
+static QHash<const void*, quint64> revisions;
+static quint64 revisionCounter = 0;
+static XmlAbstractObject::ChangeObserver changeObserver;
+
 XmlAbstractObject::~XmlAbstractObject()
 {}
+
+quint64 XmlAbstractObject::markModified(pugi::xml_node node, const char *attribute)
+{
+    pugi::xml_node scope = revisionScope(node);
+    if (!scope)
+        return 0;
+
+    quint64 revision = ++revisionCounter;
+    revisions.insert(scope.internal_object(), revision);
+
+    if (changeObserver)
+    {
+        pugi::xml_attribute changed = attribute != nullptr ? node.attribute(attribute) : pugi::xml_attribute();
+        changeObserver(node, attribute, changed ? changed.value() : nullptr);
+    }
+
+    return revision;
+}
+
+void XmlAbstractObject::setChangeObserver(ChangeObserver observer)
+{
+    changeObserver = observer;
+}
+
+quint64 XmlAbstractObject::getRevision(pugi::xml_node node)
+{
+    pugi::xml_node scope = revisionScope(node);
+    if (!scope)
+        return 0;
+
+    return revisions.value(scope.internal_object(), 0);
+}
+
+pugi::xml_node XmlAbstractObject::revisionScope(pugi::xml_node node)
+{
+    /* Module element below application/modules, otherwise the document */
+    for (pugi::xml_node n = node; n; n = n.parent())
+    {
+        pugi::xml_node parent = n.parent();
+        if (parent && std::strcmp(parent.name(), "modules") == 0 && parent.parent() && std::strcmp(parent.parent().name(), "application") == 0
+            && (std::strcmp(n.name(), "module") == 0 || std::strcmp(n.name(), "expandable-module") == 0))
+            return n;
+    }
+
+    return node.root();
+}
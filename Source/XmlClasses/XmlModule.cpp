@@ -1,5 +1,6 @@
 #include <XmlModule.h>
 
+#include <QDateTime>
 #include <QScrollArea>
 #include <QScrollBar>
 
@@ -15,8 +16,10 @@
 #include <XmlMultiFileSelection.h>
 #include <XmlSelectionBox.h>
 #include <XmlSpinBox.h>
+#include <XmlTableModel.h>
 #include <XmlTableWidget.h>
 #include <XmlTextBox.h>
+#include <XmlApplication.h>
 #include <PyTools.h>
 #include <DocumentationViewer.h>
 #include <Settings.h>
@@ -31,7 +34,10 @@ XmlModule::XmlModule(pugi::xml_node node, QWidget *parent) : HdWidget(parent), X
         moduleExpandable = false;
 
     if (!getAttribute("name"))
+    {
         xmlNode.prepend_attribute("name");
+        setModified();
+    }
 
     /* Create layout */
     QGridLayout *layout = new QGridLayout(this);
@@ -53,8 +59,16 @@ XmlModule::XmlModule(pugi::xml_node node, QWidget *parent) : HdWidget(parent), X
     /* Create stacked widget */
     stackedWidget = new HdStackedWidget(this);
     connect(tabBar, &FramelessTabBar::currentChanged, stackedWidget, &HdStackedWidget::setCurrentIndex);
+    connect(stackedWidget, &HdStackedWidget::currentChanged, this, &XmlModule::showTabPage);
     layout->addWidget(stackedWidget,1,0,-1,-1);
 
+    /* Drop widgets of tabs that have not been shown for a while */
+    evictionTimer = new QTimer(this);
+    evictionTimer->setInterval(60000);
+    connect(evictionTimer, &QTimer::timeout, this, &XmlModule::evictTabs);
+    if (settings.getTabEvictionTime() > 0)
+        evictionTimer->start();
+
     /* Add shadow to tab bar */
     HdShadowEffect *effect = new HdShadowEffect(tabBar, qreal(1.0), qreal(12.0), settings.getColor("drop-shadow/color"));
     effect->setDistance(1);
@@ -89,6 +103,65 @@ void XmlModule::changeCurrentTab(int index)
 
 QString XmlModule::toString()
 {
+    normalizeTabs();
+    XmlTableModel::writeColumnarData(xmlNode);
+    updateSerialized(serialized, QString());
+    return serialized.prefix + serialized.body + serialized.suffix;
+}
+
+QString XmlModule::toString(pugi::xml_node module_node)
+{
+    QString prefix, suffix;
+    int depth = serializeShell(module_node, prefix, suffix);
+    return prefix + serializeBody(module_node, depth) + suffix;
+}
+
+QString XmlModule::toSessionString(QString path)
+{
+    /* Same document with absolute paths replaced by placeholders, they only depend on the folder */
+    if (QFileInfo(serializedSession.path).absolutePath() != QFileInfo(path).absolutePath())
+        serializedSession = SerializedModule();
+
+    XmlTableModel::writeColumnarData(xmlNode);
+    updateSerialized(serializedSession, path);
+    return serializedSession.prefix + serializedSession.body + serializedSession.suffix;
+}
+
+void XmlModule::updateSerialized(SerializedModule &cache, QString path)
+{
+    quint64 documentRevision = getRevision(xmlNode.root());
+    quint64 moduleRevision = getRevision(xmlNode);
+
+    /* Everything around the module, changes when the application node does */
+    if (!cache.valid || cache.documentRevision != documentRevision)
+    {
+        cache.depth = serializeShell(xmlNode, cache.prefix, cache.suffix);
+        if (!path.isEmpty())
+        {
+            cache.prefix = XmlApplication::collapsePlaceholders(cache.prefix, path);
+            cache.suffix = XmlApplication::collapsePlaceholders(cache.suffix, path);
+        }
+        cache.documentRevision = documentRevision;
+        cache.valid = false;
+    }
+
+    /* The module itself */
+    if (!cache.valid || cache.moduleRevision != moduleRevision)
+    {
+        cache.body = serializeBody(xmlNode, cache.depth);
+        if (!path.isEmpty())
+            cache.body = XmlApplication::collapsePlaceholders(cache.body, path);
+        cache.moduleRevision = moduleRevision;
+    }
+
+    cache.path = path;
+    cache.valid = true;
+}
+
+int XmlModule::serializeShell(pugi::xml_node module_node, QString &prefix, QString &suffix)
+{
+    static const char marker[] = "pt-serialized-module";
+
     /* Create document */
     pugi::xml_document doc;
 
@@ -98,21 +171,110 @@ QString XmlModule::toString()
     decl.append_attribute("encoding") = "UTF-8";
     decl.append_attribute("standalone") = "yes";
 
-    /* Copy top level node */
-    doc.append_copy(xmlNode.root().child("application"));
-    pugi::xpath_node_set module_nodes = doc.child("application").select_nodes("./modules/*[self::module or self::expandable-module]");
-    for (size_t i = 0; i < module_nodes.size(); ++i)
+    /* Copy top level node without other modules, the module is replaced by a marker */
+    pugi::xml_node application = module_node.root().child("application");
+    pugi::xml_node shell = doc.append_child("application");
+    for (pugi::xml_attribute attribute: application.attributes())
+        shell.append_copy(attribute);
+
+    for (pugi::xml_node child: application.children())
     {
-        pugi::xml_node module = module_nodes[i].node();
-        if (QString(module.attribute("name").value()) != QString(xmlNode.attribute("name").value()) || QString(module.name()) != QString(xmlNode.name()))
-            module.parent().remove_child(module);
+        if (child.type() != pugi::node_element || QString(child.name()) != "modules")
+        {
+            shell.append_copy(child);
+            continue;
+        }
+
+        pugi::xml_node modules = shell.append_child("modules");
+        for (pugi::xml_attribute attribute: child.attributes())
+            modules.append_copy(attribute);
+
+        for (pugi::xml_node module: child.children())
+        {
+            QString type = module.name();
+            if (module == module_node)
+                modules.append_child(pugi::node_comment).set_value(marker);
+            else if (type != "module" && type != "expandable-module")
+                modules.append_copy(module);
+        }
     }
 
     /* Writer */
     xml_string_writer writer;
     doc.save(writer);
 
-    return QString(writer.result.c_str());
+    /* Split at the line of the marker, its indentation is the depth of the module */
+    const std::string &text = writer.result;
+    size_t position = text.find(std::string("<!--") + marker + "-->");
+    if (position == std::string::npos)
+    {
+        prefix = QString::fromStdString(text);
+        suffix.clear();
+        return 0;
+    }
+
+    size_t start = text.rfind('\n', position);
+    start = (start == std::string::npos) ? 0 : start + 1;
+    size_t end = text.find('\n', position);
+    end = (end == std::string::npos) ? text.size() : end + 1;
+
+    prefix = QString::fromUtf8(text.data(), qsizetype(start));
+    suffix = QString::fromUtf8(text.data() + end, qsizetype(text.size() - end));
+    return int(position - start);
+}
+
+QString XmlModule::serializeBody(pugi::xml_node module_node, int depth)
+{
+    xml_string_writer writer;
+    module_node.print(writer, "\t", pugi::format_default, pugi::encoding_utf8, unsigned(depth));
+    return QString::fromStdString(writer.result);
+}
+
+QList<QPair<QString, QString>> XmlModule::toTabStrings()
+{
+    QList<QPair<QString, QString>> tabs;
+    if (!moduleExpandable)
+        return tabs;
+
+    normalizeTabs();
+    XmlTableModel::writeColumnarData(xmlNode);
+
+    /* Everything around the module is the same for all tabs */
+    QString prefix, suffix;
+    int depth = serializeShell(xmlNode, prefix, suffix);
+
+    /* Copy of this module only */
+    pugi::xml_document doc;
+    pugi::xml_node module_copy = doc.append_copy(xmlNode);
+
+    /* Move tabs out of the module, so each one can be put back on its own */
+    pugi::xml_document tab_holder;
+    pugi::xml_node tabs_node = module_copy.child("tabs");
+    while (pugi::xml_node tab_node = tabs_node.child("tab"))
+    {
+        tab_holder.append_copy(tab_node);
+        tabs_node.remove_child(tab_node);
+    }
+    module_copy.remove_attribute("selected-tab");
+
+    /* One document per enabled tab */
+    for (pugi::xml_node tab_node: tab_holder.children("tab"))
+    {
+        if (tab_node.attribute("enabled") && !QString(tab_node.attribute("enabled").value()).toLower().replace("true","1").replace("false","0").toInt())
+            continue;
+
+        pugi::xml_node tab_copy = tabs_node.prepend_copy(tab_node);
+        tabs.append(QPair<QString, QString>(tab_node.attribute("name").value(), prefix + serializeBody(module_copy, depth) + suffix));
+
+        tabs_node.remove_child(tab_copy);
+    }
+
+    return tabs;
+}
+
+bool XmlModule::isExpandable()
+{
+    return moduleExpandable;
 }
 
 QString XmlModule::getName()
@@ -138,34 +300,49 @@ QString XmlModule::getDocumentationFilePath()
 int XmlModule::getObjectLabelWidth(pugi::xml_node node)
 {
     QList<QString> labels;
-    pugi::xpath_node_set all_nodes = node.select_nodes(".//*");
-    const QStringList itags = {"combo-box", "file-selection", "folder-selection", "line-edit", "multi-file-selection", "spin-box", "double-spin-box"};
-    const QStringList gtags = {"group-box", "expandable-box", "grid-layout", "horizontal-layout", "selection-box", "vertical-layout"};
+    if (QString(node.attribute("alignment").value()) != "vertical")
+        collectLabels(node, false, labels);
+
+    int width = std::max(60, settings.getLabelWidth(labels, this) + 16);
+    return width;
+}
 
-    for (size_t i = 0; i < all_nodes.size(); ++i)
+void XmlModule::collectLabels(pugi::xml_node node, bool local, QList<QString> &labels)
+{
+    /* Labels inside of boxes with a local label width are not aligned with the tab */
+    for (pugi::xml_node child: node.children())
     {
-        pugi::xml_node inode = all_nodes[i].node();
-        if (!itags.contains(inode.name()) || QString(node.attribute("alignment").value()) == "vertical" || inode.attribute("label-width"))
+        if (child.type() != pugi::node_element)
             continue;
 
-        QString label = inode.attribute("name").value();
-        pugi::xml_node pnode = inode.parent();
-
-        while (pnode && pnode != node)
+        bool child_local = local;
+        switch (elementType(child.name()))
         {
-            if (gtags.contains(pnode.name()) && QString(pnode.attribute("label-width").value()) == "local")
-            {
-                label.clear();
-                break;
-            }
-            pnode = pnode.parent();
+        case ELEMENT_COMBO_BOX:
+        case ELEMENT_FILE_SELECTION:
+        case ELEMENT_FOLDER_SELECTION:
+        case ELEMENT_LINE_EDIT:
+        case ELEMENT_MULTI_FILE_SELECTION:
+        case ELEMENT_SPIN_BOX:
+        case ELEMENT_DOUBLE_SPIN_BOX:
+            if (!local && !child.attribute("label-width") && *child.attribute("name").value() != '\0')
+                labels << child.attribute("name").value();
+            break;
+        case ELEMENT_GROUP_BOX:
+        case ELEMENT_EXPANDABLE_BOX:
+        case ELEMENT_GRID_LAYOUT:
+        case ELEMENT_HORIZONTAL_LAYOUT:
+        case ELEMENT_SELECTION_BOX:
+        case ELEMENT_VERTICAL_LAYOUT:
+            if (QString(child.attribute("label-width").value()) == "local")
+                child_local = true;
+            break;
+        default:
+            break;
         }
 
-        if (!label.isEmpty())
-            labels << label;
+        collectLabels(child, child_local, labels);
     }
-    int width = std::max(60, settings.getLabelWidth(labels, this) + 16);
-    return width;
 }
 
 int XmlModule::getRowHeight()
@@ -224,6 +401,7 @@ void XmlModule::reset()
         }
     }
 
+    setModified();
     initialize();
 }
 
@@ -231,12 +409,14 @@ void XmlModule::initialize()
 {
     /* Get selected tab */
     int selected = getAttributeValue("selected-tab", 0);
+    initializing = true;
 
     /* Clear ui */
     while (tabBar->count() > 0)
         tabBar->QTabBar::removeTab(0);
     while (stackedWidget->count() > 0)
         stackedWidget->HdStackedWidget::removeWidget(0);
+    tabPages.clear();
 
     /* Get sizes */
     tabBar->setDynamicHeight(settings.getTabBarHeight(this));
@@ -260,6 +440,7 @@ void XmlModule::initialize()
         pugi::xml_node tab_node = xmlNode.child("tabs").append_copy(xmlNode.child("items"));
         tab_node.set_name("tab");
         tab_node.append_attribute("enabled").set_value(1);
+        setModified();
 
         int index = tabBar->QTabBar::addTab("_tab_");
         generateTab(index, tab_node);
@@ -271,7 +452,10 @@ void XmlModule::initialize()
             pugi::xml_node tab_node = tab_nodes[i].node();
 
             if (!tab_node.attribute("enabled") && moduleExpandable && QString(tab_node.name()) != "table")
+            {
                 tab_node.append_attribute("enabled").set_value("1");
+                setModified();
+            }
 
             int index = tabBar->QTabBar::addTab("_tab_");
             generateTab(index, tab_node);
@@ -279,6 +463,10 @@ void XmlModule::initialize()
     }
 
     tabBar->setCurrentIndex(selected);
+
+    /* Only the selected tab is created */
+    initializing = false;
+    showTabPage(stackedWidget->currentIndex());
 }
 
 void XmlModule::moveTab(int from, int to)
@@ -294,6 +482,8 @@ void XmlModule::moveTab(int from, int to)
         xmlNode.child("tabs").insert_move_before(from_node, to_node);
     else
         xmlNode.child("tabs").insert_move_after(from_node, to_node);
+
+    setModified();
 }
 
 void XmlModule::renameTab(int index, QString name)
@@ -304,6 +494,7 @@ void XmlModule::renameTab(int index, QString name)
         for (size_t i = 0; i < tab_nodes.size(); ++i)
             if (i == size_t(index))
                 tab_nodes[i].node().attribute("name").set_value(name.toStdString().c_str());
+        setModified();
     }
 }
 
@@ -313,6 +504,7 @@ void XmlModule::toggleTab(int index, bool enable)
     {
         pugi::xpath_node_set tab_nodes = xmlNode.select_nodes("./tabs/*[self::tab or self::table]");
         tab_nodes[size_t(index)].node().attribute("enabled").set_value(int(enable));
+        setModified();
     }
 }
 
@@ -323,6 +515,7 @@ void XmlModule::newTab(int index)
         pugi::xml_node tab_node = xmlNode.child("tabs").append_copy(xmlNode.child("items"));
         tab_node.set_name("tab");
         tab_node.append_attribute("name").set_value(tabBar->tabText(index).toStdString().c_str());
+        setModified();
         generateTab(index, tab_node);
     }
 }
@@ -335,6 +528,7 @@ void XmlModule::copyTab(int original, int index)
         pugi::xml_node tab_orig = tab_nodes[size_t(original)].node();
         pugi::xml_node tab_copy = tab_orig.parent().append_copy(tab_orig);
         tab_copy.attribute("name").set_value(tabBar->tabText(index).toStdString().c_str());
+        setModified();
         generateTab(index, tab_copy);
         tabBar->setCurrentIndex(index);
     }
@@ -347,45 +541,84 @@ void XmlModule::closeTab(int index)
         pugi::xpath_node_set tab_nodes = xmlNode.select_nodes("./tabs/*[self::tab or self::table]");
         pugi::xml_node tab_node = tab_nodes[size_t(index)].node();
         tab_node.parent().remove_child(tab_node);
+        setModified();
     }
 }
 
 void XmlModule::generateTab(int index, pugi::xml_node tab_node)
 {
+    bool changed = false;
+
     /* Set tab enabled */
     if (moduleExpandable)
     {
         if (!tab_node.attribute("enabled"))
-            tab_node.append_attribute("enabled").set_value("1");
+            changed = tab_node.append_attribute("enabled").set_value("1");
         else if (!QString(tab_node.attribute("enabled").value()).toLower().replace("true","1").replace("false","0").toInt())
             tabBar->setTabEnabled(index, false);
     }
     else
-        tab_node.remove_attribute("enabled");
+        changed = tab_node.remove_attribute("enabled");
+
+    /* Set tab name */
+    if (QString(tab_node.name()) != "table" && !tab_node.attribute("name"))
+        changed = tab_node.prepend_attribute("name").set_value(QString(XmlModule::tr("Tab %1")).arg(index + 1).toStdString().c_str()) || changed;
+    tabBar->setTabText(index, tab_node.attribute("name").value());
+
+    if (changed)
+        setModified();
+
+    /* Empty page, the widgets of the tab are created when it is shown */
+    QWidget *page = new QWidget(this);
+    QBoxLayout *pageLayout = new QBoxLayout(QBoxLayout::TopToBottom, page);
+    pageLayout->setContentsMargins(0,0,0,0);
+    pageLayout->setSpacing(0);
+
+    TabPage tabPage;
+    tabPage.node = tab_node;
+    tabPages.insert(page, tabPage);
+    connect(page, &QObject::destroyed, this, [this, page](){ tabPages.remove(page); });
+
+    stackedWidget->insertWidget(index, page);
+    return;
+}
+
+void XmlModule::showTabPage(int index)
+{
+    if (initializing)
+        return;
+
+    QWidget *page = stackedWidget->widget(index);
+    if (!tabPages.contains(page))
+        return;
+
+    tabPages[page].lastShown = QDateTime::currentMSecsSinceEpoch();
+    if (tabPages[page].content == Q_NULLPTR)
+        createTabContent(page);
+}
+
+void XmlModule::createTabContent(QWidget *page)
+{
+    pugi::xml_node tab_node = tabPages.value(page).node;
+    QWidget *content;
 
     /* Table element */
     if (QString(tab_node.name()) == "table")
     {
         XmlTableWidget *tableWidget = XmlTableWidget::createFromXmlNode(this, tab_node, rowheight);
         tableWidget->setUseViewportSizeHintHeight(false);
-        tabBar->setTabText(index, tableWidget->getTitle());
-        stackedWidget->insertWidget(index, tableWidget);
+        content = tableWidget;
     }
     /* Tab element */
     else
     {
-        /* Set tab name */
-        if (!tab_node.attribute("name"))
-            tab_node.prepend_attribute("name").set_value(QString(XmlModule::tr("Tab %1")).arg(index + 1).toStdString().c_str());
-        tabBar->setTabText(index, tab_node.attribute("name").value());
-
         /* Scroll area */
-        QScrollArea *scrollArea = new QScrollArea(this);
+        QScrollArea *scrollArea = new QScrollArea(page);
         scrollArea->setAttribute(Qt::WA_Hover);
         scrollArea->setWidgetResizable(true);
         scrollArea->verticalScrollBar()->setSliderPosition(Qt::ScrollBegin);
         scrollArea->horizontalScrollBar()->setSliderPosition(Qt::ScrollBegin);
-        stackedWidget->insertWidget(index, scrollArea);
+        content = scrollArea;
 
         /* Main widget for ui elements */
         HdWidget *mainWidget = new HdWidget(scrollArea);
@@ -398,12 +631,20 @@ void XmlModule::generateTab(int index, pugi::xml_node tab_node)
         boxLayout->setDynamicMargins(12,12,12,12);
         connect(this, &XmlModule::dpiScaleChanged, boxLayout, &HdBoxLayout::updateDpiScale);
 
+        /* Tabs created after a scale change start with the current scale */
+        if (getDpiScale() != 1.0)
+        {
+            mainWidget->updateDpiScale(getDpiScale());
+            boxLayout->updateDpiScale(getDpiScale());
+        }
+
         /* Add child ui elements */
+        int labelwidth = getObjectLabelWidth(tab_node);
         for (pugi::xml_node node: tab_node.children())
-            generateXmlObject(this, boxLayout, node, rowheight, getObjectLabelWidth(tab_node), true);
+            generateXmlObject(this, boxLayout, node, rowheight, labelwidth, true);
 
         for (pugi::xml_node node: tab_node.children())
-            generateXmlObject(this, boxLayout, node, rowheight, getObjectLabelWidth(tab_node), false);
+            generateXmlObject(this, boxLayout, node, rowheight, labelwidth, false);
 
         /* Add spacer at bottom */
         QWidget *spacer = new QWidget(mainWidget);
@@ -411,25 +652,82 @@ void XmlModule::generateTab(int index, pugi::xml_node tab_node)
         boxLayout->addWidget(spacer,1);
     }
 
-    return;
+    page->layout()->addWidget(content);
+    tabPages[page].content = content;
+    tabPages[page].created = true;
 }
 
-bool XmlModule::generateXmlObject(XmlModule *module, HdBoxLayout *boxlayout, pugi::xml_node node, int rowheight, int labelwidth, bool test)
+void XmlModule::normalizeTabs()
+{
+    /* Widgets complete their nodes while they are created, tabs that were
+       never shown are created once and dropped again before a run. Unknown
+       nodes are kept without asking, they are reported when the tab is shown */
+    promptUnknown = false;
+    for (int i = 0; i < stackedWidget->count(); ++i)
+    {
+        QWidget *page = stackedWidget->widget(i);
+        if (!tabPages.contains(page) || tabPages.value(page).created)
+            continue;
+
+        createTabContent(page);
+        if (page != stackedWidget->currentWidget())
+            dropTabContent(page);
+    }
+    promptUnknown = true;
+
+    emit normalizing();
+}
+
+void XmlModule::dropTabContent(QWidget *page)
+{
+    if (tabPages.value(page).content == Q_NULLPTR)
+        return;
+
+    tabPages[page].content->deleteLater();
+    tabPages[page].content = Q_NULLPTR;
+}
+
+void XmlModule::evictTabs()
 {
-    const QStringList node_types = \
-    {"group-box", "table", "check-box", "combo-box", "double-spin-box", "expandable-box", "file-selection",
-     "folder-selection", "grid-layout", "horizontal-layout", "vertical-layout", "line-edit", "multi-file-selection",
-     "selection-box", "spacer", "spin-box", "text-box"};
+    /* The nodes keep all values, tabs are created again when they are shown */
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    qint64 limit = now - qint64(settings.getTabEvictionTime()) * 60000;
 
-    QString node_type = node.name();
+    const QList<QWidget*> pages = tabPages.keys();
+    for (QWidget *page : pages)
+    {
+        if (page == stackedWidget->currentWidget())
+            tabPages[page].lastShown = now;
+        else if (tabPages.value(page).lastShown < limit)
+            dropTabContent(page);
+    }
+}
+
+XmlModule::ElementType XmlModule::elementType(const char *name)
+{
+    /* Built once, element names are looked up by hash instead of comparing strings */
+    static const QHash<QByteArray, ElementType> types = \
+    {{"group-box", ELEMENT_GROUP_BOX}, {"table", ELEMENT_TABLE}, {"check-box", ELEMENT_CHECK_BOX},
+     {"combo-box", ELEMENT_COMBO_BOX}, {"double-spin-box", ELEMENT_DOUBLE_SPIN_BOX}, {"expandable-box", ELEMENT_EXPANDABLE_BOX},
+     {"file-selection", ELEMENT_FILE_SELECTION}, {"folder-selection", ELEMENT_FOLDER_SELECTION}, {"grid-layout", ELEMENT_GRID_LAYOUT},
+     {"horizontal-layout", ELEMENT_HORIZONTAL_LAYOUT}, {"vertical-layout", ELEMENT_VERTICAL_LAYOUT}, {"line-edit", ELEMENT_LINE_EDIT},
+     {"multi-file-selection", ELEMENT_MULTI_FILE_SELECTION}, {"selection-box", ELEMENT_SELECTION_BOX}, {"spacer", ELEMENT_SPACER},
+     {"spin-box", ELEMENT_SPIN_BOX}, {"text-box", ELEMENT_TEXT_BOX}};
+
+    return types.value(QByteArray::fromRawData(name, qsizetype(std::strlen(name))), ELEMENT_UNKNOWN);
+}
+
+bool XmlModule::generateXmlObject(XmlModule *module, HdBoxLayout *boxlayout, pugi::xml_node node, int rowheight, int labelwidth, bool test)
+{
+    ElementType type = elementType(node.name());
 
     /* Create object */
-    if (test && node_types.contains(node_type))
+    if (test && (type != ELEMENT_UNKNOWN || !module->promptUnknown))
         return true;
     else if (test)
     {
         FramelessMessageBox msg(QMessageBox::Question, settings.getApplicationName(),
-                                QString("Unknown XML node [%1].\nDelete element and proceed?").arg(node_type),
+                                QString("Unknown XML node [%1].\nDelete element and proceed?").arg(node.name()),
                                 QMessageBox::Yes | QMessageBox::Cancel);
         msg.setDefaultButton(QMessageBox::Yes);
 
@@ -439,42 +737,67 @@ bool XmlModule::generateXmlObject(XmlModule *module, HdBoxLayout *boxlayout, pug
             return false;
         else
         {
-            node.parent().remove_child(node);
+            pugi::xml_node parent = node.parent();
+            parent.remove_child(node);
+            markModified(parent);
             return true;
         }
     }
-    else if (node_type == "group-box")
+
+    switch (type)
+    {
+    case ELEMENT_GROUP_BOX:
         boxlayout->addWidget(XmlGroupBox::createFromXmlNode(module, node, rowheight, labelwidth));
-    else if (node_type == "table")
+        break;
+    case ELEMENT_TABLE:
         boxlayout->addWidget(XmlTableWidget::createFromXmlNode(module, node, rowheight));
-    else if (node_type == "check-box")
+        break;
+    case ELEMENT_CHECK_BOX:
         boxlayout->addWidget(XmlCheckBox::createFromXmlNode(module, node, rowheight));
-    else if (node_type == "combo-box")
+        break;
+    case ELEMENT_COMBO_BOX:
         boxlayout->addWidget(XmlComboBox::createFromXmlNode(module, node, rowheight, labelwidth));
-    else if (node_type == "double-spin-box")
+        break;
+    case ELEMENT_DOUBLE_SPIN_BOX:
         boxlayout->addWidget(XmlDoubleSpinBox::createFromXmlNode(module, node, rowheight, labelwidth));
-    else if (node_type == "expandable-box")
+        break;
+    case ELEMENT_EXPANDABLE_BOX:
         boxlayout->addWidget(XmlExpandableBox::createFromXmlNode(module, node, rowheight, labelwidth));
-    else if (node_type == "file-selection")
+        break;
+    case ELEMENT_FILE_SELECTION:
         boxlayout->addWidget(XmlFileSelection::createFromXmlNode(module, node, rowheight, labelwidth));
-    else if (node_type == "folder-selection")
+        break;
+    case ELEMENT_FOLDER_SELECTION:
         boxlayout->addWidget(XmlFolderSelection::createFromXmlNode(module, node, rowheight, labelwidth));
-    else if (node_type == "grid-layout")
+        break;
+    case ELEMENT_GRID_LAYOUT:
         boxlayout->addWidget(XmlGridLayout::createFromXmlNode(module, node, rowheight, labelwidth));
-    else if (node_type == "horizontal-layout" || node_type == "vertical-layout")
+        break;
+    case ELEMENT_HORIZONTAL_LAYOUT:
+    case ELEMENT_VERTICAL_LAYOUT:
         boxlayout->addWidget(XmlBoxLayout::createFromXmlNode(module, node, rowheight, labelwidth));
-    else if (node_type == "line-edit")
+        break;
+    case ELEMENT_LINE_EDIT:
         boxlayout->addWidget(XmlLineEdit::createFromXmlNode(module, node, rowheight, labelwidth));
-    else if (node_type == "multi-file-selection")
+        break;
+    case ELEMENT_MULTI_FILE_SELECTION:
         boxlayout->addWidget(XmlMultiFileSelection::createFromXmlNode(module, node, rowheight, labelwidth));
-    else if (node_type == "selection-box")
+        break;
+    case ELEMENT_SELECTION_BOX:
         boxlayout->addWidget(XmlSelectionBox::createFromXmlNode(module, node, rowheight, labelwidth));
-    else if (node_type == "spacer")
+        break;
+    case ELEMENT_SPACER:
         boxlayout->addWidget(XmlSpacer::createFromXmlNode(module, node),1);
-    else if (node_type == "spin-box")
+        break;
+    case ELEMENT_SPIN_BOX:
         boxlayout->addWidget(XmlSpinBox::createFromXmlNode(module, node, rowheight, labelwidth));
-    else if (node_type == "text-box")
+        break;
+    case ELEMENT_TEXT_BOX:
         boxlayout->addWidget(XmlTextBox::createFromXmlNode(module, node));
+        break;
+    default:
+        break;
+    }
 
     return true;
 }
@@ -0,0 +1,359 @@
+#include <XmlSessionAutosave.h>
+
+#include <QDir>
+#include <QLockFile>
+#include <QSaveFile>
+#include <QThread>
+
+#include <XmlAbstractObject.h>
+#include <XmlApplication.h>
+#include <XmlModule.h>
+#include <XmlTableModel.h>
+#include <Settings.h>
+
+/* Delay of records and of checkpoints after changes of the structure, in ms */
+static const int flushInterval = 250;
+static const int structureDelay = 1000;
+
+XmlSessionAutosaveWriter::XmlSessionAutosaveWriter(QObject *parent) : QObject(parent)
+{}
+
+void XmlSessionAutosaveWriter::open(QString checkpoint, QString journalpath)
+{
+    checkpointPath = checkpoint;
+    journal.setFileName(journalpath);
+}
+
+void XmlSessionAutosaveWriter::append(QByteArray records)
+{
+    /* Records before the first checkpoint have nothing to be replayed on */
+    if (!journal.isOpen())
+        return;
+
+    journal.write(records);
+    journal.flush();
+}
+
+void XmlSessionAutosaveWriter::writeCheckpoint(QString data, quint64 generation)
+{
+    QSaveFile file(checkpointPath);
+    if (!file.open(QIODevice::WriteOnly))
+        return;
+
+    file.write(data.toUtf8());
+    file.write(QString("<!-- pt-autosave %1 -->\n").arg(generation).toUtf8());
+    if (!file.commit())
+        return;
+
+    /* Records of the previous journal are part of the checkpoint */
+    journal.close();
+    if (journal.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        journal.write("#pt-journal " + QByteArray::number(generation) + "\n");
+        journal.flush();
+    }
+}
+
+void XmlSessionAutosaveWriter::discard()
+{
+    journal.close();
+    QFile::remove(journal.fileName());
+    QFile::remove(checkpointPath);
+}
+
+XmlSessionAutosave::XmlSessionAutosave(QString sessionpath, QObject *parent) : QObject(parent)
+{
+    QString directory = settings.getAppDataPath();
+    checkpointPath = directory + "/Autosave.xml";
+    journalPath = directory + "/Autosave.journal";
+
+    if (!settings.autosaveEnabled())
+        return;
+
+    /* The lock of an instance that crashed is stale and taken over */
+    QDir().mkpath(directory);
+    lock = new QLockFile(directory + "/Autosave.lock");
+    if (!lock->tryLock(0))
+    {
+        delete lock;
+        lock = Q_NULLPTR;
+        return;
+    }
+
+    /* A checkpoint is only left behind by a session that was not closed */
+    if (QFile::exists(checkpointPath))
+        recover(checkpointPath, journalPath, sessionpath);
+
+    QFile::remove(checkpointPath);
+    QFile::remove(journalPath);
+
+    thread = new QThread(this);
+    thread->setObjectName("XmlSessionAutosave");
+    writer = new XmlSessionAutosaveWriter();
+    writer->open(checkpointPath, journalPath);
+    writer->moveToThread(thread);
+    thread->start(QThread::LowPriority);
+
+    flushTimer = new QTimer(this);
+    flushTimer->setSingleShot(true);
+    flushTimer->setInterval(flushInterval);
+    connect(flushTimer, &QTimer::timeout, this, &XmlSessionAutosave::flush);
+
+    checkpointTimer = new QTimer(this);
+    checkpointTimer->setSingleShot(true);
+    connect(checkpointTimer, &QTimer::timeout, this, &XmlSessionAutosave::checkpoint);
+
+    XmlAbstractObject::setChangeObserver([this](pugi::xml_node node, const char *attribute, const char *value){ recordChange(node, attribute, value); });
+}
+
+XmlSessionAutosave::~XmlSessionAutosave()
+{
+    /* Without discard the checkpoint is kept and restored on the next start */
+    stop();
+}
+
+bool XmlSessionAutosave::isEnabled()
+{
+    return writer != Q_NULLPTR;
+}
+
+void XmlSessionAutosave::setSource(std::function<QString(QString)> function)
+{
+    source = function;
+}
+
+void XmlSessionAutosave::discard()
+{
+    if (writer == Q_NULLPTR)
+        return;
+
+    /* Session was saved, the autosave is not needed anymore */
+    pending.clear();
+    XmlSessionAutosaveWriter *target = writer;
+    QMetaObject::invokeMethod(writer, [target](){ target->discard(); }, Qt::QueuedConnection);
+    stop();
+}
+
+bool XmlSessionAutosave::recover(QString checkpoint, QString journalpath, QString sessionpath)
+{
+    pugi::xml_document document;
+    QString error, details;
+    if (!XmlApplication::parseXmlFile(checkpoint, document, error, details))
+        return false;
+
+    QMap<QString, pugi::xml_node> modules = XmlApplication::getModuleNodes(document);
+    if (modules.isEmpty())
+        return false;
+
+    /* Records of an older checkpoint are already part of this one */
+    QFile journal(journalpath);
+    if (journal.open(QIODevice::ReadOnly) && journal.readLine().trimmed() == "#pt-journal " + QByteArray::number(readGeneration(checkpoint)))
+    {
+        while (!journal.atEnd())
+        {
+            /* Stop at a change of the structure or at a record that was cut off */
+            QByteArray line = journal.readLine();
+            if (!line.endsWith('\n') || line.startsWith('!'))
+                break;
+
+            QList<QByteArray> fields = line.chopped(1).split('\t');
+            if (fields.size() < 4)
+                continue;
+
+            pugi::xml_node scope = document;
+            if (!fields[1].isEmpty())
+                scope = modules.value(QString::fromUtf8(unescape(fields[1])));
+
+            pugi::xml_node node = findNode(scope, fields[2]);
+            QByteArray attribute = unescape(fields[3]);
+            if (!node || attribute.isEmpty())
+                continue;
+
+            if (fields[0] == "D")
+                node.remove_attribute(attribute.constData());
+            else if (fields[0] == "S" && fields.size() >= 5)
+            {
+                pugi::xml_attribute target = node.attribute(attribute.constData());
+                if (!target)
+                    target = node.append_attribute(attribute.constData());
+                target.set_value(unescape(fields[4]).constData());
+            }
+        }
+    }
+
+    XmlTableModel::relocateColumnarData(modules.first(), sessionpath);
+    return XmlApplication::saveModuleFile(XmlModule::toString(modules.first()), sessionpath);
+}
+
+void XmlSessionAutosave::recordChange(pugi::xml_node node, const char *attribute, const char *value)
+{
+    if (attribute == nullptr)
+    {
+        /* Following records only apply to the next checkpoint */
+        if (!pending.endsWith("!\n"))
+            pending += "!\n";
+
+        if (!checkpointTimer->isActive() || checkpointTimer->remainingTime() > structureDelay)
+            checkpointTimer->start(structureDelay);
+    }
+    else
+    {
+        pugi::xml_node scope = XmlAbstractObject::revisionScope(node);
+        const char *module = scope == node.root() ? "" : scope.attribute("name").value();
+
+        pending += value != nullptr ? "S\t" : "D\t";
+        pending += escape(module) + '\t' + nodePath(node, scope) + '\t' + escape(attribute);
+        if (value != nullptr)
+            pending += '\t' + escape(value);
+        pending += '\n';
+
+        /* Records are only journaled once a checkpoint exists, the first one is written soon */
+        if (generation == 0 && (!checkpointTimer->isActive() || checkpointTimer->remainingTime() > structureDelay))
+            checkpointTimer->start(structureDelay);
+        else if (!checkpointTimer->isActive())
+            checkpointTimer->start(settings.getAutosaveInterval() * 1000);
+    }
+
+    if (!flushTimer->isActive())
+        flushTimer->start();
+}
+
+void XmlSessionAutosave::flush()
+{
+    if (pending.isEmpty() || writer == Q_NULLPTR)
+        return;
+
+    XmlSessionAutosaveWriter *target = writer;
+    QByteArray records = pending;
+    QMetaObject::invokeMethod(writer, [target, records](){ target->append(records); }, Qt::QueuedConnection);
+    pending.clear();
+}
+
+void XmlSessionAutosave::checkpoint()
+{
+    /* Serialized on the GUI thread, unchanged modules come from the cache */
+    flush();
+    QString data = source ? source(checkpointPath) : QString();
+    if (data.isEmpty() || writer == Q_NULLPTR)
+        return;
+
+    XmlSessionAutosaveWriter *target = writer;
+    quint64 next = ++generation;
+    QMetaObject::invokeMethod(writer, [target, data, next](){ target->writeCheckpoint(data, next); }, Qt::QueuedConnection);
+}
+
+void XmlSessionAutosave::stop()
+{
+    if (writer == Q_NULLPTR)
+        return;
+
+    XmlAbstractObject::setChangeObserver(XmlAbstractObject::ChangeObserver());
+    flushTimer->stop();
+    checkpointTimer->stop();
+    flush();
+
+    /* Quit after the queued writes */
+    QMetaObject::invokeMethod(writer, [](){ QThread::currentThread()->quit(); }, Qt::QueuedConnection);
+    thread->wait();
+    delete writer;
+    writer = Q_NULLPTR;
+
+    lock->unlock();
+    delete lock;
+    lock = Q_NULLPTR;
+}
+
+QByteArray XmlSessionAutosave::nodePath(pugi::xml_node node, pugi::xml_node scope)
+{
+    /* Element names with their position among equally named siblings */
+    QByteArrayList steps;
+    for (pugi::xml_node n = node; n && n != scope; n = n.parent())
+    {
+        int index = 1;
+        for (pugi::xml_node sibling = n.previous_sibling(n.name()); sibling; sibling = sibling.previous_sibling(n.name()))
+            ++index;
+        steps.prepend(QByteArray(n.name()) + '[' + QByteArray::number(index) + ']');
+    }
+
+    return steps.join('/');
+}
+
+pugi::xml_node XmlSessionAutosave::findNode(pugi::xml_node scope, const QByteArray &path)
+{
+    pugi::xml_node node = scope;
+    if (!node || path.isEmpty())
+        return node;
+
+    const QList<QByteArray> steps = path.split('/');
+    for (const QByteArray &step : steps)
+    {
+        qsizetype bracket = step.indexOf('[');
+        if (bracket < 1 || !step.endsWith(']'))
+            return pugi::xml_node();
+
+        QByteArray name = step.left(bracket);
+        int index = step.mid(bracket + 1, step.size() - bracket - 2).toInt();
+
+        pugi::xml_node child = node.child(name.constData());
+        for (int i = 1; i < index && child; ++i)
+            child = child.next_sibling(name.constData());
+
+        if (!child || index < 1)
+            return pugi::xml_node();
+        node = child;
+    }
+
+    return node;
+}
+
+QByteArray XmlSessionAutosave::escape(const char *text)
+{
+    QByteArray result;
+    for (const char *c = text; *c != '\0'; ++c)
+    {
+        switch (*c)
+        {
+        case '\\': result += "\\\\"; break;
+        case '\t': result += "\\t"; break;
+        case '\n': result += "\\n"; break;
+        case '\r': result += "\\r"; break;
+        default: result += *c;
+        }
+    }
+    return result;
+}
+
+QByteArray XmlSessionAutosave::unescape(const QByteArray &text)
+{
+    QByteArray result;
+    for (qsizetype i = 0; i < text.size(); ++i)
+    {
+        if (text[i] != '\\' || i + 1 >= text.size())
+        {
+            result += text[i];
+            continue;
+        }
+
+        char c = text[++i];
+        result += (c == 't') ? '\t' : (c == 'n') ? '\n' : (c == 'r') ? '\r' : c;
+    }
+    return result;
+}
+
+quint64 XmlSessionAutosave::readGeneration(QString checkpoint)
+{
+    /* Generation is written in a comment behind the application node */
+    QFile file(checkpoint);
+    if (!file.open(QIODevice::ReadOnly))
+        return 0;
+
+    file.seek(std::max<qint64>(0, file.size() - 64));
+    QByteArray tail = file.readAll();
+    qsizetype start = tail.lastIndexOf("pt-autosave ");
+    if (start < 0)
+        return 0;
+
+    start += qsizetype(std::strlen("pt-autosave "));
+    qsizetype end = tail.indexOf(' ', start);
+    return tail.mid(start, end - start).toULongLong();
+}
@@ -0,0 +1,171 @@
+#include <XmlTableImport.h>
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QFileInfo>
+#include <QPointer>
+#include <QThread>
+
+/* Texts up to this length are parsed right away, in characters */
+static const int threadedLength = 16384;
+
+void XmlTableImport::parseText(QString text, QChar separator, XmlNumericFormat format, int minrows, int mincolumns, QObject *context, Callback done)
+{
+    if (text.size() <= threadedLength)
+    {
+        done(parse(text, separator, format, minrows, mincolumns));
+        return;
+    }
+
+    start([text, separator, format, minrows, mincolumns](){ return parse(text, separator, format, minrows, mincolumns); }, context, done);
+}
+
+void XmlTableImport::parseFile(QString path, XmlNumericFormat format, QObject *context, Callback done)
+{
+    start([path, format]()
+    {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly))
+            return XmlTableModel::CellBlock();
+
+        QString text = QString::fromUtf8(file.readAll());
+        if (text.startsWith(QChar(0xFEFF)))
+            text.remove(0, 1);
+
+        return parse(text, detectSeparator(text, path), format);
+    }, context, done);
+}
+
+XmlTableModel::CellBlock XmlTableImport::parse(QString text, QChar separator, const XmlNumericFormat &format, int minrows, int mincolumns)
+{
+    XmlTableModel::CellBlock block;
+
+    while (text.startsWith("\r") || text.startsWith("\n"))
+        text.remove(0, 1);
+
+    while (text.endsWith("\r") || text.endsWith("\n"))
+        text.chop(1);
+
+    if (text.isEmpty())
+        return block;
+
+    QList<QStringList> fields = split(text, separator);
+
+    /* Repeat the block to fill the selection, like a single pasted cell */
+    int length = int(fields.size());
+    for (int e = 0; e < minrows - length; ++e)
+        fields.append(fields.at(e));
+
+    block.texts.reserve(fields.size());
+    block.values.reserve(fields.size());
+
+    for (QStringList &row: fields)
+    {
+        int width = int(row.size());
+        for (int e = 0; e < mincolumns - width; ++e)
+            row.append(row.at(e));
+
+        QStringList texts, values;
+        texts.reserve(row.size());
+        values.reserve(row.size());
+
+        for (const QString &field: std::as_const(row))
+        {
+            QString cell = format.format(field);
+            values.append(format.format(cell, true));
+            texts.append(cell);
+        }
+
+        block.texts.append(texts);
+        block.values.append(values);
+    }
+
+    return block;
+}
+
+QChar XmlTableImport::detectSeparator(QString text, QString path)
+{
+    QString suffix = QFileInfo(path).suffix().toLower();
+    QString line = text.left(text.indexOf('\n'));
+
+    if (suffix == "tsv" || suffix == "tab" || line.contains('\t'))
+        return '\t';
+
+    /* Semicolons separate files that use decimal commas */
+    if (line.contains(';'))
+        return ';';
+
+    if (suffix == "csv" || line.contains(','))
+        return ',';
+
+    return '\t';
+}
+
+void XmlTableImport::start(std::function<XmlTableModel::CellBlock()> task, QObject *context, Callback done)
+{
+    QPointer<QObject> receiver(context);
+
+    QThread *thread = QThread::create([task, receiver, done]()
+    {
+        XmlTableModel::CellBlock block = task();
+
+        /* Delivered through the application, the receiver may be gone */
+        QMetaObject::invokeMethod(QCoreApplication::instance(), [receiver, done, block]()
+        {
+            if (receiver)
+                done(block);
+        }, Qt::QueuedConnection);
+    });
+
+    thread->setObjectName("XmlTableImport");
+    QObject::connect(thread, &QThread::finished, thread, &QObject::deleteLater);
+    thread->start(QThread::LowPriority);
+}
+
+QList<QStringList> XmlTableImport::split(const QString &text, QChar separator)
+{
+    QList<QStringList> rows;
+    QStringList row;
+    QString field;
+    bool quoted = false;
+
+    /* Quoted fields may hold separators, line breaks and doubled quotes */
+    for (qsizetype n = 0; n < text.size(); ++n)
+    {
+        QChar c = text.at(n);
+
+        if (quoted)
+        {
+            if (c != '"')
+                field += c;
+            else if (n + 1 < text.size() && text.at(n + 1) == '"')
+                field += text.at(++n);
+            else
+                quoted = false;
+        }
+        else if (c == '"' && field.isEmpty())
+            quoted = true;
+        else if (c == separator)
+        {
+            row.append(field);
+            field.clear();
+        }
+        else if (c == '\n' || c == '\r')
+        {
+            if (c == '\r' && n + 1 < text.size() && text.at(n + 1) == '\n')
+                ++n;
+
+            row.append(field);
+            rows.append(row);
+            field.clear();
+            row.clear();
+        }
+        else
+            field += c;
+    }
+
+    row.append(field);
+    rows.append(row);
+
+    return rows;
+}
@@ -0,0 +1,1057 @@
+#include <XmlTableModel.h>
+
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QRegularExpression>
+#include <QSet>
+#include <QUuid>
+#include <charconv>
+#include <cstring>
+
+#include <XmlTableStorage.h>
+#include <Settings.h>
+
+/* Models of all tables, side-car files are written before serializing */
+static QList<XmlTableModel*> liveModels;
+
+/* Age after which private side-car files are removed, in days */
+static const int staleDays = 7;
+
+
+/* Word characters of \b, a number only starts and ends at a word boundary */
+static bool isWordChar(QChar c)
+{
+    return c.isLetterOrNumber() || c == u'_';
+}
+
+static bool isDigit(QChar c)
+{
+    return c >= u'0' && c <= u'9';
+}
+
+static bool isWordBoundary(const QChar *data, qsizetype size, qsizetype n)
+{
+    return (n > 0 && isWordChar(data[n-1])) != (n < size && isWordChar(data[n]));
+}
+
+/* End of the number at start, the same match as \b[0-9]+[.,][0-9,.]+[Ee+-0-9]*\b
+   including its backtracking, or -1 */
+static qsizetype matchNumber(const QChar *data, qsizetype size, qsizetype start)
+{
+    qsizetype n = start;
+    while (n < size && isDigit(data[n]))
+        ++n;
+
+    if (n >= size || (data[n] != u'.' && data[n] != u','))
+        return -1;
+
+    qsizetype fraction = ++n;
+    while (n < size && (isDigit(data[n]) || data[n] == u'.' || data[n] == u','))
+        ++n;
+
+    for (qsizetype k = n; k > fraction; --k)
+    {
+        qsizetype e = k;
+        while (e < size && (isDigit(data[e]) || data[e] == u'e' || data[e] == u'E' || data[e] == u'+' || data[e] == u'-'))
+            ++e;
+
+        for (qsizetype m = e; m >= k; --m)
+            if (isWordBoundary(data, size, m))
+                return m;
+    }
+
+    return -1;
+}
+
+/* Reads a number like QLocale::toDouble, group separators are only accepted
+   in groups of three digits before the decimal point */
+static bool readNumber(const QChar *data, qsizetype size, QChar decimal, QChar group, double &value)
+{
+    char buffer[128];
+    if (size >= qsizetype(sizeof(buffer)))
+        return false;
+
+    qsizetype length = 0;
+    qsizetype n = 0;
+    int digits = 0;
+    bool grouped = false;
+    bool point = false;
+
+    for (; n < size; ++n)
+    {
+        QChar c = data[n];
+        if (isDigit(c))
+        {
+            buffer[length++] = char(c.unicode());
+            ++digits;
+        }
+        else if (c == group && !point)
+        {
+            if (digits < 1 || digits > 3 || (grouped && digits != 3))
+                return false;
+            grouped = true;
+            digits = 0;
+        }
+        else if (c == decimal && !point)
+        {
+            if (grouped && digits != 3)
+                return false;
+            buffer[length++] = '.';
+            point = true;
+        }
+        else
+            break;
+    }
+
+    if (grouped && !point && digits != 3)
+        return false;
+
+    if (n < size && (data[n] == u'e' || data[n] == u'E'))
+    {
+        buffer[length++] = 'e';
+        if (++n < size && (data[n] == u'+' || data[n] == u'-'))
+            buffer[length++] = char(data[n++].unicode());
+
+        qsizetype exponent = n;
+        for (; n < size && isDigit(data[n]); ++n)
+            buffer[length++] = char(data[n].unicode());
+
+        if (n == exponent)
+            return false;
+    }
+
+    if (n != size)
+        return false;
+
+    std::from_chars_result result = std::from_chars(buffer, buffer + length, value);
+    return result.ec == std::errc() && result.ptr == buffer + length;
+}
+
+XmlNumericFormat::XmlNumericFormat(QLocale locale)
+{
+    loc = locale;
+    loc.setNumberOptions(QLocale::OmitGroupSeparator);
+
+    QString point = loc.decimalPoint();
+    QString separator = loc.groupSeparator();
+    decimal = point.size() == 1 ? point.at(0) : QChar();
+    group = separator.size() == 1 ? separator.at(0) : QChar();
+
+    /* Locales that write numbers like the cpp locale except for the decimal point */
+    plainDigits = !decimal.isNull() && loc.zeroDigit() == "0" && loc.negativeSign() == "-" && loc.positiveSign() == "+" &&
+                  loc.exponential().compare("e", Qt::CaseInsensitive) == 0;
+}
+
+QLocale XmlNumericFormat::getLocale() const
+{
+    return loc;
+}
+
+QString XmlNumericFormat::format(QString text, bool useCppLocale) const
+{
+    const QChar *data = text.constData();
+    const qsizetype size = text.size();
+
+    QString formatted;
+    qsizetype copied = 0;
+
+    for (qsizetype n = 0; n < size; ++n)
+    {
+        if (!isDigit(data[n]) || (n > 0 && isWordChar(data[n-1])))
+            continue;
+
+        qsizetype end = matchNumber(data, size, n);
+        if (end < 0)
+            continue;
+
+        /* Try locale format, then default format, then european format */
+        double value;
+        if (readNumber(data + n, end - n, decimal, group, value) ||
+            readNumber(data + n, end - n, u'.', u',', value) ||
+            readNumber(data + n, end - n, u',', u'.', value))
+        {
+            if (formatted.isNull())
+                formatted.reserve(size + 8);
+
+            formatted.append(data + copied, n - copied);
+            appendNumber(formatted, value, useCppLocale);
+            copied = end;
+        }
+
+        n = end - 1;
+    }
+
+    if (copied == 0)
+        return text;
+
+    formatted.append(data + copied, size - copied);
+    return formatted;
+}
+
+void XmlNumericFormat::appendNumber(QString &formatted, double value, bool useCppLocale) const
+{
+    if (!useCppLocale && !plainDigits)
+    {
+        QString s = loc.toString(value);
+        if (!s.contains(loc.decimalPoint()) && !s.contains("e", Qt::CaseInsensitive))
+            s += loc.decimalPoint() + "0";
+        formatted += s;
+        return;
+    }
+
+    /* Same digits as QLocale::toString(value), 'g' with precision 6 */
+    char buffer[32];
+    std::to_chars_result result = std::to_chars(buffer, buffer + sizeof(buffer), value, std::chars_format::general, 6);
+    QChar point = useCppLocale ? QChar(u'.') : decimal;
+    bool fraction = false;
+
+    for (const char *c = buffer; c != result.ptr; ++c)
+    {
+        if (*c == '.')
+            formatted += point;
+        else
+            formatted += QLatin1Char(*c);
+
+        fraction = fraction || *c == '.' || *c == 'e';
+    }
+
+    if (!fraction)
+        formatted += QString(point) + u'0';
+}
+
+XmlTableModel::XmlTableModel(pugi::xml_node node, QObject *parent) : QAbstractTableModel(parent), XmlAbstractObject(node)
+{
+    liveModels.append(this);
+}
+
+XmlTableModel::~XmlTableModel()
+{
+    liveModels.removeOne(this);
+
+    /* The document may already be gone, only the file is written */
+    if (dirty)
+        writeColumnar(dataFile);
+}
+
+void XmlTableModel::initialize()
+{
+    beginResetModel();
+
+    rowNodes.clear();
+    cells.clear();
+    columnHeaders.clear();
+    maxRow = -1;
+    maxColumn = -1;
+
+    columnar = getAttributeValue("storage", QString()).trimmed() == "columnar";
+    dataFile = getAttributeValue("data-file", QString()).trimmed();
+    scopeNode = revisionScope(xmlNode);
+
+    /* Only node fixes raise the revision */
+    bool changed = readColumns();
+    changed = readRows() || changed;
+    if (changed)
+        setModified();
+
+    if (columnar)
+        readColumnar();
+
+    endResetModel();
+}
+
+int XmlTableModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : rows;
+}
+
+int XmlTableModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : columns;
+}
+
+void XmlTableModel::setRowCount(int count)
+{
+    count = std::max(0, count);
+
+    /* Cells outside of the table are kept in the xml */
+    if (count > rows)
+    {
+        beginInsertRows(QModelIndex(), rows, count-1);
+        rows = count;
+        endInsertRows();
+    }
+    else if (count < rows)
+    {
+        beginRemoveRows(QModelIndex(), count, rows-1);
+        rows = count;
+        endRemoveRows();
+    }
+
+    setAttributeValue("row-count", rows);
+}
+
+void XmlTableModel::setColumnCount(int count)
+{
+    count = std::max(0, count);
+
+    if (count > columns)
+    {
+        beginInsertColumns(QModelIndex(), columns, count-1);
+        columns = count;
+        endInsertColumns();
+    }
+    else if (count < columns)
+    {
+        beginRemoveColumns(QModelIndex(), count, columns-1);
+        columns = count;
+        endRemoveColumns();
+    }
+
+    setAttributeValue("column-count", columns);
+}
+
+int XmlTableModel::getMaxRow() const
+{
+    return maxRow;
+}
+
+int XmlTableModel::getMaxColumn() const
+{
+    return maxColumn;
+}
+
+QVariant XmlTableModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || (role != Qt::DisplayRole && role != Qt::EditRole))
+        return QVariant();
+
+    QHash<quint64, Cell>::const_iterator cell = cells.constFind(cellKey(index.row(), index.column()));
+    if (cell == cells.constEnd())
+        return QVariant();
+
+    return cell->text;
+}
+
+bool XmlTableModel::setData(const QModelIndex &index, const QVariant &value, int role)
+{
+    if (!index.isValid() || role != Qt::EditRole)
+        return false;
+
+    int i = index.row();
+    int j = index.column();
+    QHash<quint64, Cell>::iterator cell = cells.find(cellKey(i, j));
+
+    if (cell != cells.end() && cell->readOnly)
+        return false;
+
+    /* Cells are shown in the table locale, the xml holds the cpp locale */
+    QString text = formatNumeric(value.toString());
+    QString stored = formatNumeric(text, true);
+
+    /* Unchanged cells keep the revision */
+    if (cell != cells.end() && !stored.isEmpty() && cell->text == text)
+        return true;
+
+    if (stored.isEmpty())
+    {
+        if (cell == cells.end())
+            return false;
+
+        removeItemNode(i, j);
+        setModified();
+    }
+    else if (cell != cells.end() && columnar)
+    {
+        cell->text = text;
+        cell->value = stored;
+        setModified();
+    }
+    else if (cell != cells.end())
+    {
+        cell->text = text;
+        cell->node.attribute("value").set_value(stored.toStdString().c_str());
+        markModified(cell->node, "value");
+    }
+    else
+    {
+        Cell created;
+        created.text = text;
+        created.value = stored;
+
+        if (!columnar)
+        {
+            pugi::xml_node row_node = rowNodes.value(i);
+            if (!row_node)
+                row_node = createRowNode(i);
+
+            created.node = createItemNode(row_node, i, j);
+            created.node.append_attribute("value").set_value(stored.toStdString().c_str());
+        }
+
+        cells.insert(cellKey(i, j), created);
+        setModified();
+    }
+
+    markDirty();
+    emit dataChanged(index, index, {Qt::DisplayRole, Qt::EditRole});
+    return true;
+}
+
+QVariant XmlTableModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (role == Qt::DisplayRole && orientation == Qt::Horizontal)
+    {
+        QHash<int, QString>::const_iterator header = columnHeaders.constFind(section);
+        if (header != columnHeaders.constEnd())
+            return *header;
+    }
+    else if (role == Qt::DisplayRole && orientation == Qt::Vertical)
+    {
+        QString header = QString(rowNodes.value(section).attribute("header").value());
+        if (!header.trimmed().isEmpty())
+            return header;
+    }
+
+    return QAbstractTableModel::headerData(section, orientation, role);
+}
+
+Qt::ItemFlags XmlTableModel::flags(const QModelIndex &index) const
+{
+    Qt::ItemFlags flags = QAbstractTableModel::flags(index);
+    if (!index.isValid())
+        return flags;
+
+    QHash<quint64, Cell>::const_iterator cell = cells.constFind(cellKey(index.row(), index.column()));
+    if (cell == cells.constEnd() || !cell->readOnly)
+        flags |= Qt::ItemIsEditable;
+
+    return flags;
+}
+
+bool XmlTableModel::insertRows(int row, int count, const QModelIndex &parent)
+{
+    if (parent.isValid() || count < 1 || row < 0 || row > rows)
+        return false;
+
+    beginInsertRows(QModelIndex(), row, row+count-1);
+    shiftRows(row, count);
+    rows += count;
+    endInsertRows();
+
+    markDirty();
+    setModified();
+    setAttributeValue("row-count", rows);
+    return true;
+}
+
+bool XmlTableModel::removeRows(int row, int count, const QModelIndex &parent)
+{
+    if (parent.isValid() || count < 1 || row < 0 || row+count > rows)
+        return false;
+
+    beginRemoveRows(QModelIndex(), row, row+count-1);
+
+    QMap<int, pugi::xml_node>::iterator it = rowNodes.lowerBound(row);
+    while (it != rowNodes.end() && it.key() < row+count)
+    {
+        it.value().parent().remove_child(it.value());
+        it = rowNodes.erase(it);
+    }
+
+    cells.removeIf([row, count](const QHash<quint64, Cell>::iterator &cell){
+        return cellRow(cell.key()) >= row && cellRow(cell.key()) < row+count;
+    });
+
+    shiftRows(row+count, -count);
+    rows -= count;
+    endRemoveRows();
+
+    markDirty();
+    setModified();
+    setAttributeValue("row-count", rows);
+    return true;
+}
+
+bool XmlTableModel::insertColumns(int column, int count, const QModelIndex &parent)
+{
+    if (parent.isValid() || count < 1 || column < 0 || column > columns)
+        return false;
+
+    beginInsertColumns(QModelIndex(), column, column+count-1);
+    shiftColumns(column, count);
+    columns += count;
+    endInsertColumns();
+
+    markDirty();
+    setModified();
+    setAttributeValue("column-count", columns);
+    return true;
+}
+
+bool XmlTableModel::removeColumns(int column, int count, const QModelIndex &parent)
+{
+    if (parent.isValid() || count < 1 || column < 0 || column+count > columns)
+        return false;
+
+    beginRemoveColumns(QModelIndex(), column, column+count-1);
+
+    for (pugi::xml_node column_node = xmlNode.child("columns").child("column"); column_node; )
+    {
+        pugi::xml_node next = column_node.next_sibling("column");
+        int j = column_node.attribute("j").as_int();
+
+        if (j >= column && j < column+count)
+            column_node.parent().remove_child(column_node);
+
+        column_node = next;
+    }
+
+    for (int j = column; j < column+count; ++j)
+        columnHeaders.remove(j);
+
+    cells.removeIf([column, count](const QHash<quint64, Cell>::iterator &cell){
+        int j = cellColumn(cell.key());
+        if (j < column || j >= column+count)
+            return false;
+
+        cell.value().node.parent().remove_child(cell.value().node);
+        return true;
+    });
+
+    shiftColumns(column+count, -count);
+    columns -= count;
+    endRemoveColumns();
+
+    markDirty();
+    setModified();
+    setAttributeValue("column-count", columns);
+    return true;
+}
+
+void XmlTableModel::setCellBlock(int top, int left, const CellBlock &block)
+{
+    int bottom = std::min(rows, top + int(block.values.size())) - 1;
+    int right = left - 1;
+
+    /* Rows and items are appended in order, the index finds their position */
+    for (int i = top; i <= bottom; ++i)
+    {
+        const QStringList &texts = block.texts.at(i - top);
+        const QStringList &values = block.values.at(i - top);
+        pugi::xml_node row_node = rowNodes.value(i);
+
+        int last = std::min(columns, left + int(values.size())) - 1;
+        right = std::max(right, last);
+
+        for (int j = left; j <= last; ++j)
+        {
+            QHash<quint64, Cell>::iterator cell = cells.find(cellKey(i, j));
+            const QString &value = values.at(j - left);
+
+            if (cell != cells.end() && cell->readOnly)
+                continue;
+
+            if (value.isEmpty())
+            {
+                if (cell != cells.end())
+                {
+                    removeItemNode(i, j);
+                    row_node = rowNodes.value(i);
+                }
+            }
+            else if (cell != cells.end())
+            {
+                cell->text = texts.at(j - left);
+                cell->value = value;
+                cell->node.attribute("value").set_value(value.toStdString().c_str());
+            }
+            else
+            {
+                Cell created;
+                created.text = texts.at(j - left);
+                created.value = value;
+
+                if (!columnar)
+                {
+                    if (!row_node)
+                        row_node = createRowNode(i);
+
+                    created.node = createItemNode(row_node, i, j);
+                    created.node.append_attribute("value").set_value(value.toStdString().c_str());
+                }
+
+                cells.insert(cellKey(i, j), created);
+            }
+        }
+    }
+
+    if (bottom < top || right < left)
+        return;
+
+    markDirty();
+    setModified();
+    emit dataChanged(index(top, left), index(bottom, right), {Qt::DisplayRole, Qt::EditRole});
+}
+
+void XmlTableModel::setLocale(QLocale locale)
+{
+    numeric = XmlNumericFormat(locale);
+}
+
+QLocale XmlTableModel::getLocale() const
+{
+    return numeric.getLocale();
+}
+
+XmlNumericFormat XmlTableModel::getNumericFormat() const
+{
+    return numeric;
+}
+
+QString XmlTableModel::formatNumeric(QString text, bool useCppLocale) const
+{
+    return numeric.format(text, useCppLocale);
+}
+
+bool XmlTableModel::isColumnar() const
+{
+    return columnar;
+}
+
+void XmlTableModel::writeColumnarData(pugi::xml_node scope)
+{
+    /* Nodes are only compared, models of a replaced document are still written */
+    pugi::xml_node target = revisionScope(scope);
+    for (XmlTableModel *model: std::as_const(liveModels))
+        if (model->dirty && model->scopeNode == target && model->writeColumnar(model->dataFile))
+            model->dirty = false;
+}
+
+void XmlTableModel::relocateColumnarData(pugi::xml_node scope, QString sessionpath)
+{
+    writeColumnarData(scope);
+
+    QFileInfo session(sessionpath);
+    QSet<QString> used;
+
+    pugi::xpath_node_set table_nodes = scope.select_nodes(".//table[@storage='columnar'][@data-file]");
+    for (size_t n = 0; n < table_nodes.size(); ++n)
+    {
+        pugi::xml_node table_node = table_nodes[n].node();
+        QString source = QFileInfo(QString(table_node.attribute("data-file").value()).trimmed()).absoluteFilePath();
+
+        /* Named after the session and the table */
+        QString name = QString(table_node.attribute("name").value()).trimmed();
+        name.replace(QRegularExpression("[^A-Za-z0-9_-]"), "_");
+        if (name.isEmpty())
+            name = "table";
+
+        QString base = session.absolutePath() + "/" + session.completeBaseName() + "." + name;
+        QString target = base + ".ptcol";
+        for (int k = 2; used.contains(target); ++k)
+            target = base + "-" + QString::number(k) + ".ptcol";
+        used.insert(target);
+
+        if (source == target || !QFile::exists(source))
+            continue;
+
+        QFile::remove(target);
+        if (!QFile::copy(source, target))
+            continue;
+
+        table_node.attribute("data-file").set_value(target.toStdString().c_str());
+        markModified(table_node, "data-file");
+    }
+}
+
+void XmlTableModel::removeStaleColumnarData()
+{
+    QDateTime limit = QDateTime::currentDateTime().addDays(-staleDays);
+    QDirIterator it(columnarDirectory(), QStringList() << "*.ptcol", QDir::Files);
+    while (it.hasNext())
+    {
+        QFileInfo info(it.next());
+        if (info.lastModified() < limit)
+            QFile::remove(info.absoluteFilePath());
+    }
+}
+
+bool XmlTableModel::readColumns()
+{
+    bool changed = false;
+
+    if (!xmlNode.child("columns") && xmlNode.child("delegates"))
+        changed = !xmlNode.insert_child_after("columns", xmlNode.child("delegates")).empty();
+    else if (!xmlNode.child("columns"))
+        changed = !xmlNode.prepend_child("columns").empty();
+
+    for (pugi::xml_node columns_node: xmlNode.children("columns"))
+    {
+        QMap<int, pugi::xml_node> ordered;
+        bool sort_columns = false;
+
+        for (pugi::xml_node column_node = columns_node.child("column"); column_node; )
+        {
+            pugi::xml_node next = column_node.next_sibling("column");
+
+            /* Check consistency of column index */
+            bool ok = false;
+            int j = QString(column_node.attribute("j").value()).toInt(&ok);
+
+            if (j < 0 || !ok || ordered.contains(j) || !column_node.attribute("j"))
+            {
+                changed = columns_node.remove_child(column_node) || changed;
+                column_node = next;
+                continue;
+            }
+
+            if (!ordered.isEmpty() && j < ordered.lastKey())
+                sort_columns = true;
+            ordered.insert(j, column_node);
+
+            QString header = QString(column_node.attribute("header").value());
+            if (!header.trimmed().isEmpty())
+                columnHeaders.insert(j, header);
+
+            column_node = next;
+        }
+
+        /* Reorder columns */
+        if (sort_columns)
+        {
+            for (pugi::xml_node column_node: std::as_const(ordered))
+                columns_node.append_move(column_node);
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+bool XmlTableModel::readRows()
+{
+    bool changed = false;
+
+    if (!xmlNode.child("rows"))
+        changed = !xmlNode.insert_child_after("rows", xmlNode.child("columns")).empty();
+
+    for (pugi::xml_node rows_node: xmlNode.children("rows"))
+    {
+        QMap<int, pugi::xml_node> ordered;
+        bool sort_rows = false;
+
+        for (pugi::xml_node row_node = rows_node.child("row"); row_node; )
+        {
+            pugi::xml_node next_row = row_node.next_sibling("row");
+
+            /* Check consistency of row index */
+            bool ok = false;
+            int i = QString(row_node.attribute("i").value()).toInt(&ok);
+
+            if (i < 0 || !ok || rowNodes.contains(i) || !row_node.attribute("i"))
+            {
+                changed = rows_node.remove_child(row_node) || changed;
+                row_node = next_row;
+                continue;
+            }
+
+            if (!ordered.isEmpty() && i < ordered.lastKey())
+                sort_rows = true;
+            ordered.insert(i, row_node);
+            rowNodes.insert(i, row_node);
+            maxRow = std::max(maxRow, i);
+
+            /* Header attribute */
+            if (!row_node.attribute("header"))
+                changed = row_node.insert_attribute_after("header", row_node.attribute("i")) || changed;
+
+            /* Items */
+            QMap<int, pugi::xml_node> items;
+            bool sort_items = false;
+
+            for (pugi::xml_node item_node = row_node.child("item"); item_node; )
+            {
+                pugi::xml_node next_item = item_node.next_sibling("item");
+
+                /* Check consistency of item row index */
+                if (!item_node.attribute("i"))
+                    changed = item_node.prepend_attribute("i").set_value(i) || changed;
+                else if (QString(item_node.attribute("i").value()).toInt(&ok) != i || !ok)
+                {
+                    changed = row_node.remove_child(item_node) || changed;
+                    item_node = next_item;
+                    continue;
+                }
+
+                /* Check consistency of item column index and value */
+                int j = QString(item_node.attribute("j").value()).toInt(&ok);
+                if (j < 0 || !ok || items.contains(j) || !item_node.attribute("j") || item_node.attribute("value").empty())
+                {
+                    changed = row_node.remove_child(item_node) || changed;
+                    item_node = next_item;
+                    continue;
+                }
+
+                if (!items.isEmpty() && j < items.lastKey())
+                    sort_items = true;
+                items.insert(j, item_node);
+                maxColumn = std::max(maxColumn, j);
+
+                /* Fix compatibility */
+                if (item_node.attribute("is-editable"))
+                {
+                    if (!item_node.attribute("read-only") && !QString(item_node.attribute("is-editable").value()).toLower().replace("true","1").replace("false","0").toInt())
+                        item_node.insert_attribute_after("read-only", item_node.attribute("is-editable")).set_value("1");
+                    changed = item_node.remove_attribute("is-editable") || changed;
+                }
+
+                Cell cell;
+                cell.node = item_node;
+                cell.text = formatNumeric(item_node.attribute("value").value());
+
+                /* Read-only property */
+                if (item_node.attribute("read-only"))
+                {
+                    if (QString(item_node.attribute("read-only").value()).toLower().replace("true","1").replace("false","0").toInt())
+                        cell.readOnly = true;
+                    else
+                        changed = item_node.remove_attribute("read-only") || changed;
+                }
+
+                cells.insert(cellKey(i, j), cell);
+                item_node = next_item;
+            }
+
+            /* Reorder items */
+            if (sort_items)
+            {
+                for (pugi::xml_node item_node: std::as_const(items))
+                    row_node.append_move(item_node);
+                changed = true;
+            }
+
+            row_node = next_row;
+        }
+
+        /* Reorder rows */
+        if (sort_rows)
+        {
+            for (pugi::xml_node row_node: std::as_const(ordered))
+                rows_node.append_move(row_node);
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+void XmlTableModel::readColumnar()
+{
+    /* Items move to the side-car, read-only items stay in the xml */
+    bool migrated = false;
+    for (QHash<quint64, Cell>::iterator cell = cells.begin(); cell != cells.end(); ++cell)
+    {
+        if (cell->readOnly)
+            continue;
+
+        pugi::xml_node row_node = cell->node.parent();
+        cell->value = cell->node.attribute("value").value();
+        row_node.remove_child(cell->node);
+        cell->node = pugi::xml_node();
+        migrated = true;
+
+        if (!row_node.child("item") && QString(row_node.attribute("header").value()).trimmed().isEmpty())
+        {
+            rowNodes.remove(cellRow(cell.key()));
+            row_node.parent().remove_child(row_node);
+        }
+    }
+
+    /* Items of the xml take precedence over the file */
+    if (!dataFile.isEmpty())
+    {
+        XmlTableStorage::read(dataFile, [this](int i, int j, const QString &value)
+        {
+            quint64 key = cellKey(i, j);
+            if (cells.contains(key))
+                return;
+
+            Cell cell;
+            cell.text = formatNumeric(value);
+            cell.value = value;
+            cells.insert(key, cell);
+
+            maxRow = std::max(maxRow, i);
+            maxColumn = std::max(maxColumn, j);
+        });
+    }
+
+    if (migrated)
+    {
+        markDirty();
+        setModified();
+    }
+}
+
+void XmlTableModel::markDirty()
+{
+    if (!columnar)
+        return;
+
+    /* Files next to a session are only replaced when the session is saved */
+    dataFile = getAttributeValue("data-file", QString()).trimmed();
+    if (dataFile.isEmpty() || QFileInfo(dataFile).absolutePath() != QFileInfo(columnarDirectory()).absoluteFilePath())
+    {
+        dataFile = columnarDirectory() + "/" + QUuid::createUuid().toString(QUuid::WithoutBraces) + ".ptcol";
+        setAttributeValue("data-file", dataFile);
+    }
+
+    dirty = true;
+}
+
+bool XmlTableModel::writeColumnar(QString path)
+{
+    int height = 0;
+    int width = 0;
+    for (QHash<quint64, Cell>::const_iterator cell = cells.constBegin(); cell != cells.constEnd(); ++cell)
+    {
+        if (cell->node)
+            continue;
+
+        height = std::max(height, cellRow(cell.key()) + 1);
+        width = std::max(width, cellColumn(cell.key()) + 1);
+    }
+
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    return XmlTableStorage::write(path, height, width, [this](int i, int j)
+    {
+        QHash<quint64, Cell>::const_iterator cell = cells.constFind(cellKey(i, j));
+        return (cell != cells.constEnd() && !cell->node) ? cell->value : QString();
+    });
+}
+
+QString XmlTableModel::columnarDirectory()
+{
+    return settings.getAppDataPath() + "/Tables";
+}
+
+pugi::xml_node XmlTableModel::createRowNode(int i)
+{
+    /* Insert new row node before the next row */
+    QMap<int, pugi::xml_node>::iterator next = rowNodes.upperBound(i);
+    pugi::xml_node row_node;
+
+    if (next != rowNodes.end())
+        row_node = next.value().parent().insert_child_before("row", next.value());
+    else
+        row_node = xmlNode.child("rows").append_child("row");
+
+    row_node.append_attribute("i").set_value(i);
+    row_node.append_attribute("header");
+    rowNodes.insert(i, row_node);
+
+    return row_node;
+}
+
+pugi::xml_node XmlTableModel::createItemNode(pugi::xml_node row_node, int i, int j)
+{
+    /* Rows are mostly filled from left to right, search backwards */
+    pugi::xml_node next;
+    for (pugi::xml_node child = row_node.last_child(); child; child = child.previous_sibling())
+    {
+        if (std::strcmp(child.name(), "item") != 0)
+            continue;
+        if (child.attribute("j").as_int() < j)
+            break;
+        next = child;
+    }
+
+    pugi::xml_node item_node = next ? row_node.insert_child_before("item", next) : row_node.append_child("item");
+    item_node.append_attribute("i").set_value(i);
+    item_node.append_attribute("j").set_value(j);
+
+    return item_node;
+}
+
+void XmlTableModel::removeItemNode(int i, int j)
+{
+    QHash<quint64, Cell>::iterator cell = cells.find(cellKey(i, j));
+    if (cell == cells.end())
+        return;
+
+    pugi::xml_node item_node = cell->node;
+    cells.erase(cell);
+
+    /* Cells of the side-car have no node */
+    if (!item_node)
+        return;
+
+    pugi::xml_node row_node = item_node.parent();
+    row_node.remove_child(item_node);
+
+    /* Delete row node if entire row is empty */
+    if (!row_node.child("item") && QString(row_node.attribute("header").value()).trimmed().isEmpty())
+    {
+        rowNodes.remove(i);
+        row_node.parent().remove_child(row_node);
+    }
+}
+
+void XmlTableModel::shiftRows(int first, int delta)
+{
+    QMap<int, pugi::xml_node> shifted;
+    for (QMap<int, pugi::xml_node>::iterator it = rowNodes.begin(); it != rowNodes.end(); ++it)
+    {
+        int i = it.key();
+        if (i >= first)
+        {
+            i += delta;
+            it.value().attribute("i").set_value(i);
+            for (pugi::xml_node item_node: it.value().children("item"))
+                item_node.attribute("i").set_value(i);
+        }
+        shifted.insert(i, it.value());
+    }
+    rowNodes.swap(shifted);
+
+    QHash<quint64, Cell> moved;
+    moved.reserve(cells.size());
+    for (QHash<quint64, Cell>::const_iterator it = cells.constBegin(); it != cells.constEnd(); ++it)
+    {
+        int i = cellRow(it.key());
+        moved.insert(cellKey(i >= first ? i+delta : i, cellColumn(it.key())), it.value());
+    }
+    cells.swap(moved);
+}
+
+void XmlTableModel::shiftColumns(int first, int delta)
+{
+    for (pugi::xml_node column_node: xmlNode.child("columns").children("column"))
+    {
+        int j = column_node.attribute("j").as_int();
+        if (j >= first)
+            column_node.attribute("j").set_value(j+delta);
+    }
+
+    QHash<int, QString> headers;
+    for (QHash<int, QString>::const_iterator it = columnHeaders.constBegin(); it != columnHeaders.constEnd(); ++it)
+        headers.insert(it.key() >= first ? it.key()+delta : it.key(), it.value());
+    columnHeaders.swap(headers);
+
+    QHash<quint64, Cell> moved;
+    moved.reserve(cells.size());
+    for (QHash<quint64, Cell>::const_iterator it = cells.constBegin(); it != cells.constEnd(); ++it)
+    {
+        int j = cellColumn(it.key());
+        if (j >= first)
+        {
+            j += delta;
+            it.value().node.attribute("j").set_value(j);
+        }
+        moved.insert(cellKey(cellRow(it.key()), j), it.value());
+    }
+    cells.swap(moved);
+}
@@ -0,0 +1,226 @@
+#include <XmlTableStorage.h>
+
+#include <QFile>
+#include <QLocale>
+#include <QSaveFile>
+#include <QtEndian>
+#include <cstring>
+
+static const char magic[] = "PTCOL";
+static const quint16 version = 1;
+
+template <typename T>
+static void appendValue(QByteArray &data, T value)
+{
+    T little = qToLittleEndian(value);
+    data.append(reinterpret_cast<const char*>(&little), sizeof(T));
+}
+
+static void appendPadding(QByteArray &data)
+{
+    data.append(QByteArray((8 - data.size() % 8) % 8, '\0'));
+}
+
+static quint64 paddedSize(quint64 size)
+{
+    return (size + 7) / 8 * 8;
+}
+
+bool XmlTableStorage::write(QString path, int rows, int columns, ValueReader value)
+{
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QByteArray header(magic, sizeof(magic));
+    appendValue<quint16>(header, version);
+    appendValue<quint32>(header, quint32(std::max(0, rows)));
+    appendValue<quint32>(header, quint32(std::max(0, columns)));
+    file.write(header);
+
+    for (int j = 0; j < columns; ++j)
+    {
+        /* Narrowest type that restores every value */
+        QStringList values;
+        values.reserve(rows);
+        bool empty = true;
+        bool integers = true;
+        bool floats = true;
+
+        for (int i = 0; i < rows; ++i)
+        {
+            values.append(value(i, j));
+            const QString &text = values.last();
+            if (text.isEmpty())
+                continue;
+
+            empty = false;
+            bool ok = false;
+
+            if (integers)
+                integers = QString::number(text.toLongLong(&ok)) == text && ok;
+            if (floats)
+                floats = formatFloat(text.toDouble(&ok)) == text && ok;
+        }
+
+        ColumnType type = empty ? COLUMN_EMPTY : integers ? COLUMN_INT64 : floats ? COLUMN_FLOAT64 : COLUMN_STRING;
+        QByteArray payload;
+
+        if (type != COLUMN_EMPTY)
+        {
+            QByteArray bitmap((rows + 7) / 8, '\0');
+            for (int i = 0; i < rows; ++i)
+                if (!values.at(i).isEmpty())
+                    bitmap[i / 8] = char(bitmap.at(i / 8) | (1 << (i % 8)));
+
+            payload = bitmap;
+            appendPadding(payload);
+        }
+
+        if (type == COLUMN_INT64 || type == COLUMN_FLOAT64)
+        {
+            payload.reserve(payload.size() + qsizetype(rows) * 8);
+            for (const QString &text: std::as_const(values))
+            {
+                quint64 bits = 0;
+                if (type == COLUMN_INT64)
+                    bits = quint64(text.toLongLong());
+                else if (!text.isEmpty())
+                {
+                    double number = text.toDouble();
+                    std::memcpy(&bits, &number, sizeof(bits));
+                }
+                appendValue<quint64>(payload, bits);
+            }
+        }
+        else if (type == COLUMN_STRING)
+        {
+            QByteArray bytes;
+            appendValue<quint64>(payload, 0);
+            for (const QString &text: std::as_const(values))
+            {
+                bytes += text.toUtf8();
+                appendValue<quint64>(payload, quint64(bytes.size()));
+            }
+
+            payload += bytes;
+            appendPadding(payload);
+        }
+
+        QByteArray column;
+        column.append(char(type));
+        column.append(QByteArray(7, '\0'));
+        appendValue<quint64>(column, quint64(payload.size()));
+        file.write(column);
+        file.write(payload);
+    }
+
+    return file.commit();
+}
+
+bool XmlTableStorage::read(QString path, ValueWriter cell)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    /* Columns are read from the map, only their values are copied */
+    QByteArray contents;
+    quint64 size = quint64(file.size());
+    const uchar *data = size > 0 ? file.map(0, qint64(size)) : Q_NULLPTR;
+    if (data == Q_NULLPTR)
+    {
+        contents = file.readAll();
+        data = reinterpret_cast<const uchar*>(contents.constData());
+        size = quint64(contents.size());
+    }
+
+    if (size < 16 || std::memcmp(data, magic, sizeof(magic)) != 0 || qFromLittleEndian<quint16>(data + 6) != version)
+        return false;
+
+    quint64 rows = qFromLittleEndian<quint32>(data + 8);
+    quint64 columns = qFromLittleEndian<quint32>(data + 12);
+    quint64 offset = 16;
+
+    for (quint64 j = 0; j < columns; ++j)
+    {
+        if (size - offset < 16)
+            return false;
+
+        ColumnType type = ColumnType(data[offset]);
+        quint64 length = qFromLittleEndian<quint64>(data + offset + 8);
+        offset += 16;
+
+        if (length > size - offset)
+            return false;
+
+        const uchar *payload = data + offset;
+        offset += length;
+
+        if (type == COLUMN_EMPTY)
+            continue;
+
+        quint64 bitmap = paddedSize((rows + 7) / 8);
+        if (length < bitmap)
+            return false;
+
+        const uchar *values = payload + bitmap;
+        quint64 available = length - bitmap;
+
+        if (type == COLUMN_INT64 || type == COLUMN_FLOAT64)
+        {
+            if (available / 8 < rows)
+                return false;
+
+            for (quint64 i = 0; i < rows; ++i)
+            {
+                if (!(payload[i / 8] & (1 << (i % 8))))
+                    continue;
+
+                quint64 bits = qFromLittleEndian<quint64>(values + i * 8);
+                if (type == COLUMN_INT64)
+                    cell(int(i), int(j), QString::number(qint64(bits)));
+                else
+                {
+                    double number;
+                    std::memcpy(&number, &bits, sizeof(number));
+                    cell(int(i), int(j), formatFloat(number));
+                }
+            }
+        }
+        else if (type == COLUMN_STRING)
+        {
+            if (available / 8 < rows + 1)
+                return false;
+
+            const uchar *bytes = values + (rows + 1) * 8;
+            quint64 count = available - (rows + 1) * 8;
+
+            for (quint64 i = 0; i < rows; ++i)
+            {
+                if (!(payload[i / 8] & (1 << (i % 8))))
+                    continue;
+
+                quint64 begin = qFromLittleEndian<quint64>(values + i * 8);
+                quint64 end = qFromLittleEndian<quint64>(values + (i + 1) * 8);
+                if (begin > end || end > count)
+                    return false;
+
+                cell(int(i), int(j), QString::fromUtf8(reinterpret_cast<const char*>(bytes + begin), qsizetype(end - begin)));
+            }
+        }
+        else
+            return false;
+    }
+
+    return true;
+}
+
+QString XmlTableStorage::formatFloat(double value)
+{
+    /* Same texts as the cpp locale values of the xml, with a decimal point */
+    QString text = QString::number(value, 'g', QLocale::FloatingPointShortest);
+    if (!text.contains('.') && !text.contains('e') && !text.contains("inf") && !text.contains("nan"))
+        text += ".0";
+    return text;
+}
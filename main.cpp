@@ -1,13 +1,25 @@
 #include <QFontDatabase>
 #include <QDirIterator>
 #include <PyTools.h>
+#include <PyBatchRunner.h>
+#include <PyInterpreterCache.h>
 
 Settings settings;
+PyInterpreterCache interpreterCache;
 
 int main(int argc, char *argv[])
 {
     /* qputenv("QT_ENABLE_HIGHDPI_SCALING", QByteArray("1")); */
 
+    /* Headless batch run, no widgets are created */
+    if (PyBatchRunner::isRequested(argc, argv))
+    {
+        QCoreApplication a(argc, argv);
+        settings.load();
+        interpreterCache.load();
+        return PyBatchRunner::exec(QCoreApplication::arguments());
+    }
+
     QApplication::setAttribute(Qt::AA_DontCreateNativeWidgetSiblings);
     QApplication::setHighDpiScaleFactorRoundingPolicy(Qt::HighDpiScaleFactorRoundingPolicy::Floor);
 
@@ -17,6 +29,7 @@ int main(int argc, char *argv[])
 
     /* Load settings immediately after creating application */
     settings.load();
+    interpreterCache.load();
 
     /* Install application fonts */
     QDirIterator fontfiles(settings.getApplicationPath() + "/fonts/", QStringList() << "*.ttf" << "*.otf", QDir::Files);